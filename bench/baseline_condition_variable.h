@@ -0,0 +1,91 @@
+#ifndef DP_BENCH_BASELINE_CONDITION_VARIABLE
+#define DP_BENCH_BASELINE_CONDITION_VARIABLE
+
+//The condition_variable_any this library shipped before it was rebuilt on a futex, kept so the benchmarks can compare against it.
+//Every wait takes an internal mutex through a copied shared_ptr and sleeps on a std::condition_variable, every notify takes
+//that mutex whether or not anyone is waiting, and every stop-aware wait registers a stop_callback of its own which calls notify_all().
+//Only the waits the benchmarks use are kept.
+
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+
+#include "stop_token.h"
+
+namespace dp::bench::baseline {
+
+	class condition_variable_any {
+
+		std::condition_variable     m_cond;
+		std::shared_ptr<std::mutex> m_mut;
+
+		template<typename Lock>
+		class scoped_unlock {
+			Lock& m_lck;
+
+		public:
+			explicit scoped_unlock(Lock& lck) : m_lck{ lck } { lck.unlock(); }
+			~scoped_unlock() { m_lck.lock(); }
+
+			scoped_unlock(const scoped_unlock&) = delete;
+			scoped_unlock& operator=(const scoped_unlock&) = delete;
+		};
+
+	public:
+
+		condition_variable_any() : m_cond{}, m_mut{ std::make_shared<std::mutex>() } {}
+
+		condition_variable_any(const condition_variable_any&) = delete;
+		condition_variable_any& operator=(const condition_variable_any&) = delete;
+
+		void notify_one() noexcept {
+			std::lock_guard lck{ *m_mut };
+			m_cond.notify_one();
+		}
+
+		void notify_all() noexcept {
+			std::lock_guard lck{ *m_mut };
+			m_cond.notify_all();
+		}
+
+		template<typename Lock>
+		void wait(Lock& lock) {
+			auto mut{ m_mut };
+			std::unique_lock outer_lock{ *mut };
+			scoped_unlock<Lock> param_unlock{ lock };
+			std::unique_lock inner_lock{ std::move(outer_lock) };
+			m_cond.wait(inner_lock);
+		}
+
+		template<typename Lock, typename Pred>
+		void wait(Lock& lock, Pred pred) {
+			while (!pred()) {
+				wait(lock);
+			}
+		}
+
+		template<typename Lock, typename Pred>
+		bool wait(Lock& lock, dp::stop_token token, Pred pred) {
+			if (token.stop_requested()) {
+				return pred();
+			}
+
+			[[maybe_unused]] dp::stop_callback callback{ token, [this] { notify_all(); } };
+
+			std::shared_ptr mut{ m_mut };
+			while (!pred()) {
+				std::unique_lock outer_lock{ *mut };
+				if (token.stop_requested()) {
+					return false;
+				}
+				scoped_unlock<Lock> param_unlock{ lock };
+				std::unique_lock inner_lock{ std::move(outer_lock) };
+				m_cond.wait(inner_lock);
+			}
+			return true;
+		}
+	};
+
+}
+
+#endif
@@ -0,0 +1,70 @@
+#ifndef DP_BENCH_BENCH
+#define DP_BENCH_BENCH
+
+//Small helpers shared by the benchmarks. Each benchmark is a plain executable which prints one line per measurement.
+//Counts are taken from the command line, so that the same binary serves for a quick smoke run and a careful one.
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+namespace dp::bench {
+
+	using clock = std::chrono::steady_clock;
+
+	//The index-th command line argument as a number, or fallback if it wasn't given
+	inline long arg(int argc, char** argv, int index, long fallback) noexcept {
+		return index < argc ? std::strtol(argv[index], nullptr, 10) : fallback;
+	}
+
+	//How long func takes to run, in seconds
+	template<typename Func>
+	double seconds(Func&& func) {
+		const auto start{ clock::now() };
+		func();
+		return std::chrono::duration<double>(clock::now() - start).count();
+	}
+
+	inline void report(const char* name, double value, const char* unit) noexcept {
+		std::printf("%-56s %14.3f %s\n", name, value, unit);
+	}
+
+	//Collects latency samples and reports their distribution
+	class histogram {
+		std::vector<clock::duration> m_samples{};
+
+		double percentile(double fraction) const noexcept {
+			const std::size_t index{ static_cast<std::size_t>(fraction * static_cast<double>(m_samples.size() - 1)) };
+			return std::chrono::duration<double, std::micro>(m_samples[index]).count();
+		}
+
+	public:
+		void reserve(std::size_t count) {
+			m_samples.reserve(count);
+		}
+
+		void add(clock::duration sample) {
+			m_samples.push_back(sample);
+		}
+
+		void merge(const histogram& other) {
+			m_samples.insert(m_samples.end(), other.m_samples.begin(), other.m_samples.end());
+		}
+
+		//Prints the median, tail percentiles and maximum in microseconds
+		void report(const char* name) {
+			if (m_samples.empty()) {
+				std::printf("%-56s no samples\n", name);
+				return;
+			}
+			std::sort(m_samples.begin(), m_samples.end());
+			std::printf("%-56s p50 %9.2f  p90 %9.2f  p99 %9.2f  p99.9 %9.2f  max %9.2f us\n", name,
+				percentile(0.5), percentile(0.9), percentile(0.99), percentile(0.999), percentile(1.0));
+		}
+	};
+
+}
+
+#endif
@@ -0,0 +1,81 @@
+//64 threads wait on one condition variable and are released together by notify_all, round after round.
+//Reports the time from the broadcast until every waiter has been through the mutex, with and without requeueing the
+//waiters onto a dp::mutex, where only one of them is runnable at a time instead of all of them fighting for the lock.
+//Usage: cv_broadcast [rounds] [waiters]
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "bench.h"
+#include "condition_variable.h"
+#include "jthread.h"
+#include "mutex.h"
+
+namespace {
+
+	template<typename Mutex, typename CondVar>
+	double broadcast_us(CondVar& cv, long rounds, long waiters) {
+		Mutex mut{};
+		long generation{ 0 };
+		std::atomic<long> ready{ 0 };
+		std::atomic<long> done{ 0 };
+		double total{ 0 };
+
+		std::vector<dp::jthread> threads{};
+		for (long i = 0; i < waiters; ++i) {
+			threads.emplace_back([&] {
+				for (long seen = 0; seen < rounds;) {
+					std::unique_lock lck{ mut };
+					ready.fetch_add(1);
+					cv.wait(lck, [&] { return generation > seen; });
+					seen = generation;
+					done.fetch_add(1);
+				}
+			});
+		}
+		for (long round = 1; round <= rounds; ++round) {
+			while (ready.load() < round * waiters) {
+				std::this_thread::yield();
+			}
+			//Once we hold the lock the last waiter has released it, and so is waiting
+			std::unique_lock lck{ mut };
+			total += dp::bench::seconds([&] {
+				++generation;
+				cv.notify_all();
+				lck.unlock();
+				while (done.load() < round * waiters) {
+					std::this_thread::yield();
+				}
+			});
+		}
+		return total * 1e6 / static_cast<double>(rounds);
+	}
+
+}
+
+int main(int argc, char** argv) {
+	const long rounds{ dp::bench::arg(argc, argv, 1, 500) };
+	const long waiters{ dp::bench::arg(argc, argv, 2, 64) };
+
+	{
+		std::condition_variable_any cv{};
+		dp::bench::report("std::condition_variable_any, std::mutex", broadcast_us<std::mutex>(cv, rounds, waiters), "us per broadcast");
+	}
+	{
+		dp::condition_variable_any cv{};
+		dp::bench::report("dp::condition_variable_any, std::mutex", broadcast_us<std::mutex>(cv, rounds, waiters), "us per broadcast");
+	}
+	{
+		dp::condition_variable_any cv{};
+		dp::bench::report("dp::condition_variable_any, dp::mutex", broadcast_us<dp::mutex>(cv, rounds, waiters), "us per broadcast");
+	}
+	{
+		dp::wait_policy requeue{};
+		requeue.requeue = true;
+		dp::condition_variable_any cv{ requeue };
+		dp::bench::report("dp::condition_variable_any, dp::mutex, requeue", broadcast_us<dp::mutex>(cv, rounds, waiters), "us per broadcast");
+	}
+}
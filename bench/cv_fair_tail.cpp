@@ -0,0 +1,74 @@
+//Several consumers wait on one queue and a producer feeds it one item at a time, so every item is a race between the waiters.
+//Reports how long each consumer waited for an item, in the default mode and in fair mode, where notify_one always wakes
+//the longest waiter. The tail of the distribution is where unfair wakeups starve a consumer.
+//Usage: cv_fair_tail [items] [consumers]
+
+#include <atomic>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "bench.h"
+#include "condition_variable.h"
+#include "jthread.h"
+#include "stop_token.h"
+
+namespace {
+
+	dp::bench::histogram wait_times(dp::wait_policy policy, long items, long consumers) {
+		std::mutex mut{};
+		dp::condition_variable_any cv{ policy };
+		std::deque<long> queue{};
+		dp::stop_source done{};
+		std::vector<dp::bench::histogram> waits(static_cast<std::size_t>(consumers));
+
+		{
+			std::vector<dp::jthread> threads{};
+			for (auto& samples : waits) {
+				threads.emplace_back([&] {
+					std::unique_lock lck{ mut };
+					for (;;) {
+						const auto start{ dp::bench::clock::now() };
+						if (!cv.wait(lck, done.get_token(), [&] { return !queue.empty(); })) {
+							return;
+						}
+						samples.add(dp::bench::clock::now() - start);
+						queue.pop_front();
+					}
+				});
+			}
+			for (long i = 0; i < items; ++i) {
+				{
+					std::lock_guard lck{ mut };
+					queue.push_back(i);
+					cv.notify_one();
+				}
+				//Hand out one item at a time, so that the consumers are waiting rather than working
+				for (bool empty = false; !empty; std::this_thread::yield()) {
+					std::lock_guard lck{ mut };
+					empty = queue.empty();
+				}
+			}
+			done.request_stop();
+		}
+
+		dp::bench::histogram all{};
+		for (const auto& samples : waits) {
+			all.merge(samples);
+		}
+		return all;
+	}
+
+}
+
+int main(int argc, char** argv) {
+	const long items{ dp::bench::arg(argc, argv, 1, 50000) };
+	const long consumers{ dp::bench::arg(argc, argv, 2, 8) };
+
+	wait_times(dp::wait_policy{}, items, consumers).report("default mode, time each consumer waits");
+
+	dp::wait_policy fair{};
+	fair.fair = true;
+	wait_times(fair, items, consumers).report("fair mode, time each consumer waits");
+}
@@ -0,0 +1,48 @@
+//Two threads hand a turn back and forth through one condition variable, so each round trip is two waits and two notifies.
+//Compares dp::condition_variable_any with the version it replaced and with std::condition_variable_any.
+//Usage: cv_ping_pong [round trips]
+
+#include <condition_variable>
+#include <mutex>
+
+#include "bench.h"
+#include "baseline_condition_variable.h"
+#include "condition_variable.h"
+#include "jthread.h"
+
+namespace {
+
+	template<typename CondVar>
+	double ping_pong(long rounds) {
+		std::mutex mut{};
+		CondVar cv{};
+		bool ping{ false };
+
+		const double elapsed{ dp::bench::seconds([&] {
+			dp::jthread partner{ [&] {
+				for (long i = 0; i < rounds; ++i) {
+					std::unique_lock lck{ mut };
+					cv.wait(lck, [&] { return ping; });
+					ping = false;
+					cv.notify_one();
+				}
+			} };
+			for (long i = 0; i < rounds; ++i) {
+				std::unique_lock lck{ mut };
+				ping = true;
+				cv.notify_one();
+				cv.wait(lck, [&] { return !ping; });
+			}
+		}) };
+		return elapsed * 1e9 / static_cast<double>(rounds);
+	}
+
+}
+
+int main(int argc, char** argv) {
+	const long rounds{ dp::bench::arg(argc, argv, 1, 100000) };
+
+	dp::bench::report("std::condition_variable_any round trip", ping_pong<std::condition_variable_any>(rounds), "ns");
+	dp::bench::report("baseline dp::condition_variable_any round trip", ping_pong<dp::bench::baseline::condition_variable_any>(rounds), "ns");
+	dp::bench::report("dp::condition_variable_any round trip", ping_pong<dp::condition_variable_any>(rounds), "ns");
+}
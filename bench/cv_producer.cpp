@@ -0,0 +1,60 @@
+//Producers push onto a shared queue and notify on every push, as thread_safe_queue does, while a consumer drains it.
+//The consumer is rarely asleep, so most notifications find nobody waiting and the cost of notifying is pure overhead.
+//Usage: cv_producer [items per producer] [producers]
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <vector>
+
+#include "bench.h"
+#include "baseline_condition_variable.h"
+#include "condition_variable.h"
+#include "jthread.h"
+
+namespace {
+
+	template<typename CondVar>
+	double items_per_second(long items, long producers) {
+		std::mutex mut{};
+		CondVar cv{};
+		std::deque<long> queue{};
+		long remaining{ items * producers };
+
+		const double elapsed{ dp::bench::seconds([&] {
+			dp::jthread consumer{ [&] {
+				std::deque<long> batch{};
+				std::unique_lock lck{ mut };
+				while (remaining > 0) {
+					cv.wait(lck, [&] { return !queue.empty(); });
+					batch.swap(queue);
+					remaining -= static_cast<long>(batch.size());
+					lck.unlock();
+					batch.clear();
+					lck.lock();
+				}
+			} };
+			std::vector<dp::jthread> threads{};
+			for (long p = 0; p < producers; ++p) {
+				threads.emplace_back([&] {
+					for (long i = 0; i < items; ++i) {
+						std::lock_guard lck{ mut };
+						queue.push_back(i);
+						cv.notify_one();
+					}
+				});
+			}
+		}) };
+		return static_cast<double>(items * producers) / elapsed / 1e6;
+	}
+
+}
+
+int main(int argc, char** argv) {
+	const long items{ dp::bench::arg(argc, argv, 1, 1000000) };
+	const long producers{ dp::bench::arg(argc, argv, 2, 2) };
+
+	dp::bench::report("std::condition_variable_any", items_per_second<std::condition_variable_any>(items, producers), "M items/s");
+	dp::bench::report("baseline dp::condition_variable_any", items_per_second<dp::bench::baseline::condition_variable_any>(items, producers), "M items/s");
+	dp::bench::report("dp::condition_variable_any", items_per_second<dp::condition_variable_any>(items, producers), "M items/s");
+}
@@ -0,0 +1,60 @@
+//Many threads wait on one condition variable with the same stop token, and we time how long a stop takes to release them all.
+//The old condition variable registered a callback per waiter, each of which woke every waiter, so a stop cost N broadcasts.
+//Usage: cv_shutdown [waiters]
+
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "bench.h"
+#include "baseline_condition_variable.h"
+#include "condition_variable.h"
+#include "jthread.h"
+#include "stop_token.h"
+
+namespace {
+
+	template<typename CondVar>
+	double shutdown_ms(long waiters) {
+		std::mutex mut{};
+		CondVar cv{};
+		dp::stop_source source{};
+		std::atomic<long> waiting{ 0 };
+		std::atomic<long> released{ 0 };
+
+		std::vector<dp::jthread> threads{};
+		threads.reserve(static_cast<std::size_t>(waiters));
+		for (long i = 0; i < waiters; ++i) {
+			threads.emplace_back([&] {
+				std::unique_lock lck{ mut };
+				waiting.fetch_add(1);
+				cv.wait(lck, source.get_token(), [] { return false; });
+				released.fetch_add(1);
+			});
+		}
+		while (waiting.load() != waiters) {
+			std::this_thread::yield();
+		}
+		//Taking the lock once more means the last waiter has released it, and so is asleep
+		{
+			std::lock_guard lck{ mut };
+		}
+
+		const double elapsed{ dp::bench::seconds([&] {
+			source.request_stop();
+			while (released.load() != waiters) {
+				std::this_thread::yield();
+			}
+		}) };
+		return elapsed * 1e3;
+	}
+
+}
+
+int main(int argc, char** argv) {
+	const long waiters{ dp::bench::arg(argc, argv, 1, 1000) };
+
+	dp::bench::report("baseline dp::condition_variable_any stop", shutdown_ms<dp::bench::baseline::condition_variable_any>(waiters), "ms");
+	dp::bench::report("dp::condition_variable_any stop", shutdown_ms<dp::condition_variable_any>(waiters), "ms");
+}
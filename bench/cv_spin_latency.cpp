@@ -0,0 +1,57 @@
+//Measures how long a waiting thread takes to wake after being notified, under each wait policy, as a latency histogram.
+//Each round the notifier stamps the time, hands over the turn and waits for it back, so the waiter is always freshly waiting.
+//Spinning is disabled on a single CPU, where the notifier can't run while the waiter spins, so all modes match there.
+//Usage: cv_spin_latency [rounds]
+
+#include <chrono>
+#include <mutex>
+
+#include "bench.h"
+#include "condition_variable.h"
+#include "jthread.h"
+
+namespace {
+
+	dp::bench::histogram wake_latency(dp::wait_policy policy, long rounds) {
+		std::mutex mut{};
+		dp::condition_variable_any cv{ policy };
+		bool turn{ false };
+		dp::bench::clock::time_point stamp{};
+		dp::bench::histogram latency{};
+		latency.reserve(static_cast<std::size_t>(rounds));
+
+		dp::jthread waiter{ [&] {
+			for (long i = 0; i < rounds; ++i) {
+				std::unique_lock lck{ mut };
+				cv.wait(lck, [&] { return turn; });
+				latency.add(dp::bench::clock::now() - stamp);
+				turn = false;
+				cv.notify_one();
+			}
+		} };
+		for (long i = 0; i < rounds; ++i) {
+			std::unique_lock lck{ mut };
+			stamp = dp::bench::clock::now();
+			turn = true;
+			cv.notify_one();
+			cv.wait(lck, [&] { return !turn; });
+		}
+		waiter.join();
+		return latency;
+	}
+
+}
+
+int main(int argc, char** argv) {
+	const long rounds{ dp::bench::arg(argc, argv, 1, 50000) };
+
+	wake_latency(dp::wait_policy{}, rounds).report("park immediately");
+
+	dp::wait_policy adaptive{};
+	adaptive.spin = true;
+	wake_latency(adaptive, rounds).report("spin then park, adaptive budget");
+
+	dp::wait_policy fixed{ adaptive };
+	fixed.adaptive = false;
+	wake_latency(fixed, rounds).report("spin then park, fixed budget");
+}
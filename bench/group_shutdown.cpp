@@ -0,0 +1,40 @@
+//Threads which each take a while to notice a stop request, stopped and joined as a std::vector<dp::jthread> and as a dp::jthread_group.
+//The vector stops and joins one thread at a time, so its shutdown takes the sum of every thread's reaction time.
+//The group requests every stop before joining anything, so its shutdown takes about one thread's reaction time.
+//Usage: group_shutdown [threads] [reaction time in ms]
+
+#include <chrono>
+#include <thread>
+#include <vector>
+
+#include "bench.h"
+#include "jthread.h"
+#include "jthread_group.h"
+
+int main(int argc, char** argv) {
+	const long threads{ dp::bench::arg(argc, argv, 1, 256) };
+	const std::chrono::milliseconds reaction{ dp::bench::arg(argc, argv, 2, 10) };
+
+	auto slow_to_notice{ [reaction](dp::stop_token token) {
+		while (!token.stop_requested()) {
+			std::this_thread::sleep_for(reaction);
+		}
+	} };
+
+	{
+		std::vector<dp::jthread> vec{};
+		for (long i = 0; i < threads; ++i) {
+			vec.emplace_back(slow_to_notice);
+		}
+		std::this_thread::sleep_for(reaction * 2);
+		dp::bench::report("std::vector<dp::jthread> shutdown", dp::bench::seconds([&] { vec.clear(); }) * 1e3, "ms");
+	}
+	{
+		dp::jthread_group group{};
+		for (long i = 0; i < threads; ++i) {
+			group.emplace(slow_to_notice);
+		}
+		std::this_thread::sleep_for(reaction * 2);
+		dp::bench::report("dp::jthread_group shutdown", dp::bench::seconds([&] { group.stop_and_join(); }) * 1e3, "ms");
+	}
+}
@@ -0,0 +1,72 @@
+//Starts many threads which sit idle waiting for a stop, and reports how much resident memory they cost, first on the default
+//stacks and then on small stacks from a stack provider. Reads VmRSS from /proc, so the figures are Linux only.
+//Usage: idle_threads [threads] [stack KiB]
+
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "bench.h"
+#include "jthread.h"
+#include "stack_provider.h"
+#include "thread_attributes.h"
+#include "this_thread.h"
+
+using namespace std::chrono_literals;
+
+namespace {
+
+	//In KiB, or 0 where /proc isn't available
+	long resident_kib() {
+		std::ifstream status{ "/proc/self/status" };
+		for (std::string line{}; std::getline(status, line);) {
+			if (line.rfind("VmRSS:", 0) == 0) {
+				return std::stol(line.substr(6));
+			}
+		}
+		return 0;
+	}
+
+	void idle_threads(const char* name, const dp::thread_attributes& attributes, long threads) {
+		std::atomic<long> started{ 0 };
+		const long before{ resident_kib() };
+		std::vector<dp::jthread> workers{};
+		workers.reserve(static_cast<std::size_t>(threads));
+		const double elapsed{ dp::bench::seconds([&] {
+			for (long i = 0; i < threads; ++i) {
+				workers.emplace_back(attributes, [&](dp::stop_token token) {
+					started.fetch_add(1);
+					dp::this_thread::sleep_for(token, 1h);
+				});
+			}
+			while (started.load() != threads) {
+				std::this_thread::yield();
+			}
+		}) };
+		const long after{ resident_kib() };
+
+		const std::string label{ name };
+		dp::bench::report((label + ", start").c_str(), elapsed * 1e6 / static_cast<double>(threads), "us per thread");
+		dp::bench::report((label + ", resident").c_str(), static_cast<double>(after - before) / static_cast<double>(threads), "KiB per thread");
+		dp::bench::report((label + ", resident total").c_str(), static_cast<double>(after - before) / 1024.0, "MiB");
+	}
+
+}
+
+int main(int argc, char** argv) {
+	const long threads{ dp::bench::arg(argc, argv, 1, 10000) };
+	const long stack_kib{ dp::bench::arg(argc, argv, 2, 64) };
+
+	idle_threads("default stacks", dp::thread_attributes{}, threads);
+
+	dp::stack_options options{};
+	options.size = static_cast<std::size_t>(stack_kib) * 1024;
+	idle_threads("mmap stacks", dp::thread_attributes{}.set_stack_provider(std::make_shared<dp::mmap_stack_provider>(options)), threads);
+
+	auto pool{ std::make_shared<dp::stack_pool>(std::make_shared<dp::mmap_stack_provider>(options), static_cast<std::size_t>(threads)) };
+	idle_threads("preallocated stack pool", dp::thread_attributes{}.set_stack_provider(pool), threads);
+}
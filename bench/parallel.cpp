@@ -0,0 +1,152 @@
+//Scaling and early exit of the dp::parallel algorithms.
+//reduce and for_each are timed with the process confined to 1, 2, 4... of its CPUs (Linux only; elsewhere just all of them), on a pool
+//sized to match. Then find_if is timed with the match at the end of the range and 1% of the way in, and a cancelled for_each reports
+//how long it takes to return after the stop is requested.
+//Usage: parallel [elements] [repeats]
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <numeric>
+#include <string>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+#include "bench.h"
+#include "jthread.h"
+#include "parallel.h"
+#include "thread_pool.h"
+
+#if defined(__linux__)
+#include <sched.h>
+#endif
+
+namespace {
+
+	template<typename Func>
+	double best_ms(long repeats, Func func) {
+		double best{ 1e300 };
+		for (long i = 0; i < repeats; ++i) {
+			best = std::min(best, dp::bench::seconds(func) * 1e3);
+		}
+		return best;
+	}
+
+	void scaling(const std::vector<long>& values, long repeats) {
+		std::vector<unsigned int> counts{};
+		unsigned int allowed{ dp::jthread::effective_concurrency() };
+#if defined(__linux__)
+		cpu_set_t original{};
+		sched_getaffinity(0, sizeof(original), &original);
+		std::vector<int> cpus{};
+		for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+			if (CPU_ISSET(cpu, &original)) {
+				cpus.push_back(cpu);
+			}
+		}
+		allowed = std::min<unsigned int>(allowed, static_cast<unsigned int>(cpus.size()));
+#endif
+		for (unsigned int n = 1; n < allowed; n *= 2) {
+			counts.push_back(n);
+		}
+		counts.push_back(allowed);
+
+		volatile long sink{ 0 };
+		double single{ 0 };
+		for (const unsigned int n : counts) {
+#if defined(__linux__)
+			cpu_set_t confined{};
+			CPU_ZERO(&confined);
+			for (unsigned int i = 0; i < n; ++i) {
+				CPU_SET(cpus[i], &confined);
+			}
+			sched_setaffinity(0, sizeof(confined), &confined);
+#endif
+			dp::jthread::refresh_concurrency();
+			double reduce_ms{ 0 };
+			double for_each_ms{ 0 };
+			{
+				//The pool's threads inherit the confined affinity
+				dp::thread_pool pool{ std::max<std::size_t>(n, 2) - 1 };
+				reduce_ms = best_ms(repeats, [&] { sink = dp::parallel::reduce(pool, values.begin(), values.end(), 0L); });
+				for_each_ms = best_ms(repeats, [&] {
+					std::atomic<long> matches{ 0 };
+					dp::parallel::for_each(pool, values.begin(), values.end(), [&](long value) {
+						if (value % 1'000'003 == 1) {
+							matches.fetch_add(1, std::memory_order_relaxed);
+						}
+					});
+					sink = matches.load();
+				});
+			}
+			if (n == 1) {
+				single = reduce_ms;
+			}
+			const std::string cpus_label{ std::to_string(n) + (n == 1 ? " CPU" : " CPUs") };
+			dp::bench::report(("reduce, " + cpus_label).c_str(), reduce_ms, "ms");
+			dp::bench::report(("reduce speedup, " + cpus_label).c_str(), single / reduce_ms, "x");
+			dp::bench::report(("for_each, " + cpus_label).c_str(), for_each_ms, "ms");
+		}
+#if defined(__linux__)
+		sched_setaffinity(0, sizeof(original), &original);
+#endif
+		dp::jthread::refresh_concurrency();
+
+		const double serial{ best_ms(repeats, [&] { sink = std::accumulate(values.begin(), values.end(), 0L); }) };
+		dp::bench::report("std::accumulate", serial, "ms");
+	}
+
+	void early_exit(const std::vector<long>& values, long repeats) {
+		volatile long sink{ 0 };
+		const long last{ values.back() };
+		const long early{ values[values.size() / 100] };
+		dp::bench::report("std::find_if, match at the end", best_ms(repeats, [&] {
+			sink = *std::find_if(values.begin(), values.end(), [last](long value) { return value == last; });
+		}), "ms");
+		dp::bench::report("parallel::find_if, match at the end", best_ms(repeats, [&] {
+			sink = *dp::parallel::find_if(values.begin(), values.end(), [last](long value) { return value == last; });
+		}), "ms");
+		dp::bench::report("parallel::find_if, match at 1%", best_ms(repeats, [&] {
+			sink = *dp::parallel::find_if(values.begin(), values.end(), [early](long value) { return value == early; });
+		}), "ms");
+		dp::bench::report("parallel::any_of, match at 1%", best_ms(repeats, [&] {
+			sink = dp::parallel::any_of(values.begin(), values.end(), [early](long value) { return value == early; });
+		}), "ms");
+
+		//Each element takes about a microsecond, so the range would take seconds to finish
+		dp::bench::histogram latency{};
+		for (long i = 0; i < repeats; ++i) {
+			dp::stop_source source{};
+			std::atomic<dp::bench::clock::time_point> requested{};
+			dp::jthread canceller{ [&] {
+				std::this_thread::sleep_for(std::chrono::milliseconds{ 5 });
+				requested = dp::bench::clock::now();
+				source.request_stop();
+			} };
+			try {
+				dp::parallel::for_each(source.get_token(), values.begin(), values.end(), [](long) {
+					const auto until{ dp::bench::clock::now() + std::chrono::microseconds{ 1 } };
+					while (dp::bench::clock::now() < until) {}
+				});
+			}
+			catch (const std::system_error&) {
+				latency.add(dp::bench::clock::now() - requested.load());
+			}
+		}
+		latency.report("parallel::for_each, stop request to return");
+	}
+
+}
+
+int main(int argc, char** argv) {
+	const long elements{ dp::bench::arg(argc, argv, 1, 20'000'000) };
+	const long repeats{ dp::bench::arg(argc, argv, 2, 5) };
+
+	std::vector<long> values(static_cast<std::size_t>(elements));
+	std::iota(values.begin(), values.end(), 0L);
+
+	scaling(values, repeats);
+	early_exit(values, repeats);
+}
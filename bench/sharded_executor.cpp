@@ -0,0 +1,77 @@
+//Several producers each send tiny tasks round-robin to a set of workers, which count them in state of their own.
+//On dp::sharded_executor each task goes to one shard's inbox and the counters need no synchronisation. On dp::thread_pool every task
+//goes through the one shared injection queue and the counter has to be atomic.
+//Usage: sharded_executor [tasks per producer] [producers]
+
+#include <atomic>
+#include <cstddef>
+#include <thread>
+#include <vector>
+
+#include "bench.h"
+#include "sharded_executor.h"
+#include "thread_pool.h"
+
+namespace {
+
+	template<typename Submit, typename Finished>
+	double ns_per_task(long tasks, long producers, Submit submit, Finished finished) {
+		const double elapsed{ dp::bench::seconds([&] {
+			std::vector<std::thread> threads{};
+			for (long p = 0; p < producers; ++p) {
+				threads.emplace_back([&] {
+					for (long i = 0; i < tasks; ++i) {
+						submit(static_cast<std::size_t>(i));
+					}
+				});
+			}
+			for (auto& thread : threads) {
+				thread.join();
+			}
+			while (!finished()) {
+				std::this_thread::yield();
+			}
+		}) };
+		return elapsed * 1e9 / static_cast<double>(tasks * producers);
+	}
+
+}
+
+int main(int argc, char** argv) {
+	const long tasks{ dp::bench::arg(argc, argv, 1, 200000) };
+	const long producers{ dp::bench::arg(argc, argv, 2, 4) };
+
+	dp::sharded_executor executor{};
+	const std::size_t shards{ executor.size() };
+	{
+		struct alignas(64) counter {
+			long m_count{ 0 };
+			std::atomic<long> m_published{ 0 };
+		};
+		std::vector<counter> counters(shards);
+		const double ns{ ns_per_task(tasks, producers, [&](std::size_t i) {
+			const std::size_t shard{ i % shards };
+			executor.submit_to(shard, [&counters, shard] {
+				counter& own{ counters[shard] };
+				own.m_published.store(++own.m_count, std::memory_order_release);
+			});
+		}, [&] {
+			long total{ 0 };
+			for (const auto& own : counters) {
+				total += own.m_published.load(std::memory_order_acquire);
+			}
+			return total == tasks * producers;
+		}) };
+		dp::bench::report("sharded_executor, per-shard inboxes", ns, "ns per task");
+	}
+	{
+		dp::thread_pool pool{ shards };
+		std::atomic<long> count{ 0 };
+		const double ns{ ns_per_task(tasks, producers, [&](std::size_t) {
+			pool.submit([&count] { count.fetch_add(1, std::memory_order_relaxed); });
+		}, [&] {
+			return count.load(std::memory_order_relaxed) == tasks * producers;
+		}) };
+		dp::bench::report("thread_pool, one shared queue", ns, "ns per task");
+	}
+}
@@ -0,0 +1,39 @@
+//Threads which poll their stop token between sleeps, as in the README's example, and the time taken to stop and join them all.
+//With std::this_thread::sleep_for each thread only notices the stop once its current sleep is over. dp::this_thread::sleep_for
+//returns as soon as the stop is requested.
+//Usage: sleep_shutdown [threads] [sleep in ms]
+
+#include <chrono>
+#include <thread>
+#include <vector>
+
+#include "bench.h"
+#include "jthread.h"
+#include "this_thread.h"
+
+namespace {
+
+	template<typename Sleep>
+	double shutdown_ms(long threads, Sleep sleep) {
+		std::vector<dp::jthread> sleepers{};
+		for (long i = 0; i < threads; ++i) {
+			sleepers.emplace_back([sleep](dp::stop_token token) {
+				while (!token.stop_requested()) {
+					sleep(token);
+				}
+			});
+		}
+		//Let every thread get into its sleep
+		std::this_thread::sleep_for(std::chrono::milliseconds{ 20 });
+		return dp::bench::seconds([&] { sleepers.clear(); }) * 1e3;
+	}
+
+}
+
+int main(int argc, char** argv) {
+	const long threads{ dp::bench::arg(argc, argv, 1, 16) };
+	const std::chrono::milliseconds sleep{ dp::bench::arg(argc, argv, 2, 200) };
+
+	dp::bench::report("std::this_thread::sleep_for", shutdown_ms(threads, [sleep](const dp::stop_token&) { std::this_thread::sleep_for(sleep); }), "ms");
+	dp::bench::report("dp::this_thread::sleep_for(token)", shutdown_ms(threads, [sleep](const dp::stop_token& token) { dp::this_thread::sleep_for(token, sleep); }), "ms");
+}
@@ -0,0 +1,35 @@
+//Starts and joins short-lived threads one after another, as request fan-out does, with and without the thread cache.
+//Usage: spawn_join [threads]
+
+#include <atomic>
+#include <thread>
+
+#include "bench.h"
+#include "jthread.h"
+#include "thread_cache.h"
+
+namespace {
+
+	template<typename Thread>
+	double spawns_per_second(long threads) {
+		std::atomic<long> ran{ 0 };
+		const double elapsed{ dp::bench::seconds([&] {
+			for (long i = 0; i < threads; ++i) {
+				Thread worker{ [&] { ran.fetch_add(1, std::memory_order_relaxed); } };
+				worker.join();
+			}
+		}) };
+		return static_cast<double>(threads) / elapsed;
+	}
+
+}
+
+int main(int argc, char** argv) {
+	const long threads{ dp::bench::arg(argc, argv, 1, 20000) };
+
+	dp::bench::report("std::thread spawn and join", spawns_per_second<std::thread>(threads), "threads/s");
+	dp::bench::report("dp::jthread spawn and join", spawns_per_second<dp::jthread>(threads), "threads/s");
+	dp::thread_cache::enable();
+	dp::bench::report("dp::jthread spawn and join, thread cache", spawns_per_second<dp::jthread>(threads), "threads/s");
+	dp::thread_cache::disable();
+}
@@ -0,0 +1,97 @@
+//Runs three workloads on dp::thread_pool: recursive fork-join fib, a chunked sum of a large array, and a flood of tiny tasks
+//submitted from outside the pool (through the injection queue) and from inside it (onto a worker's own deque).
+//Usage: thread_pool [threads] [fib n] [tiny tasks]
+
+#include <atomic>
+#include <cstddef>
+#include <numeric>
+#include <vector>
+
+#include "bench.h"
+#include "jthread.h"
+#include "thread_pool.h"
+
+namespace {
+
+	long serial_fib(int n) {
+		return n < 2 ? n : serial_fib(n - 1) + serial_fib(n - 2);
+	}
+
+	long fib(dp::thread_pool& pool, int n) {
+		if (n < 16) {
+			return serial_fib(n);
+		}
+		std::atomic<bool> done{ false };
+		long left{ 0 };
+		pool.submit([&] {
+			left = fib(pool, n - 1);
+			done.store(true, std::memory_order_release);
+		});
+		const long right{ fib(pool, n - 2) };
+		pool.help_until([&] { return done.load(std::memory_order_acquire); });
+		return left + right;
+	}
+
+	long chunked_sum(dp::thread_pool& pool, const std::vector<long>& values, std::size_t chunks) {
+		std::atomic<long> sum{ 0 };
+		std::atomic<std::size_t> left{ chunks };
+		const std::size_t chunk{ values.size() / chunks };
+		for (std::size_t i = 0; i < chunks; ++i) {
+			pool.submit([&, i] {
+				const auto first{ values.begin() + static_cast<std::ptrdiff_t>(i * chunk) };
+				const auto last{ i + 1 == chunks ? values.end() : first + static_cast<std::ptrdiff_t>(chunk) };
+				sum.fetch_add(std::accumulate(first, last, 0L), std::memory_order_relaxed);
+				left.fetch_sub(1, std::memory_order_release);
+			});
+		}
+		pool.help_until([&] { return left.load(std::memory_order_acquire) == 0; });
+		return sum.load();
+	}
+
+	void tiny_tasks(dp::thread_pool& pool, long tasks, bool from_worker) {
+		std::atomic<long> ran{ 0 };
+		const auto flood{ [&] {
+			for (long i = 0; i < tasks; ++i) {
+				pool.submit([&] { ran.fetch_add(1, std::memory_order_relaxed); });
+			}
+		} };
+		const double elapsed{ dp::bench::seconds([&] {
+			if (from_worker) {
+				pool.submit(flood);
+			}
+			else {
+				flood();
+			}
+			pool.help_until([&] { return ran.load(std::memory_order_relaxed) == tasks; });
+		}) };
+		dp::bench::report(from_worker ? "tiny tasks submitted from a worker" : "tiny tasks submitted from outside", elapsed * 1e9 / static_cast<double>(tasks), "ns per task");
+	}
+
+}
+
+int main(int argc, char** argv) {
+	const auto threads{ static_cast<std::size_t>(dp::bench::arg(argc, argv, 1, dp::jthread::effective_concurrency())) };
+	const int n{ static_cast<int>(dp::bench::arg(argc, argv, 2, 32)) };
+	const long tasks{ dp::bench::arg(argc, argv, 3, 1000000) };
+
+	dp::thread_pool pool{ threads };
+
+	long result{ 0 };
+	dp::bench::report("fib serial", dp::bench::seconds([&] { result = serial_fib(n); }) * 1e3, "ms");
+	dp::bench::report("fib fork-join on the pool", dp::bench::seconds([&] { result -= fib(pool, n); }) * 1e3, "ms");
+	if (result != 0) {
+		return 1;
+	}
+
+	std::vector<long> values(std::size_t{ 1 } << 24);
+	std::iota(values.begin(), values.end(), 0L);
+	long sum{ 0 };
+	dp::bench::report("sum serial", dp::bench::seconds([&] { sum = std::accumulate(values.begin(), values.end(), 0L); }) * 1e3, "ms");
+	dp::bench::report("sum in 256 chunks on the pool", dp::bench::seconds([&] { sum -= chunked_sum(pool, values, 256); }) * 1e3, "ms");
+	if (sum != 0) {
+		return 1;
+	}
+
+	tiny_tasks(pool, tasks, false);
+	tiny_tasks(pool, tasks, true);
+}
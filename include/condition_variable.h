@@ -9,11 +9,18 @@
 */
 #include <mutex>
 #include <condition_variable>
-#include <memory>
+#include <atomic>
+#include <array>
+#include <optional>
+#include <cstdint>
+#include <cstddef>
 #include <chrono>
+#include <thread>
 #include <utility>
 
 #include "stop_token.h"
+#include "futex.h"
+#include "mutex.h"
 
 
 namespace dp {
@@ -26,26 +33,132 @@ namespace dp {
 
 
 
+	//Controls how a condition_variable_any waits. By default a waiter sleeps in the kernel straight away.
+	//Latency-sensitive handoffs can instead spin for a while before sleeping, catching notifications which arrive within
+	//a few microseconds without paying for the kernel wakeup.
+	struct wait_policy {
+		//Spin before sleeping
+		bool spin{ false };
+		//Whether the spin budget tunes itself to how often spinning pays off, or always uses max_spins
+		bool adaptive{ true };
+		//Upper bound on the number of pause iterations spent spinning per wait
+		std::uint32_t max_spins{ 4000 };
+		//Queue waiters in arrival order, so that notify_one() always wakes the thread which has waited longest and wakes only that thread.
+		//This bounds tail latency under load at the cost of a short internal lock on every wait and notify.
+		bool fair{ false };
+		//When every waiter uses the same dp::mutex, have notify_all() wake one waiter and move the rest straight onto the mutex's
+		//wait queue, so they are released one at a time as the mutex is handed on rather than all racing for it at once.
+		//Not available in fair mode, and falls back to waking everyone on platforms without a requeue operation.
+		bool requeue{ false };
+	};
+
+
+	//The outcome of waiting on several stop tokens at once
+	struct stop_wait_result {
+		//The value of the predicate when the wait returned
+		bool satisfied;
+		//The index of the first token found to have had a stop requested, if any
+		std::optional<std::size_t> stopped;
+
+		explicit operator bool() const noexcept {
+			return satisfied;
+		}
+	};
+
+
+	namespace detail {
+		//Lock types whose underlying futex word we know, and so which waiters can be requeued onto
+		template<typename Lock>
+		struct requeue_traits {
+			static constexpr bool requeueable{ false };
+		};
+
+		template<>
+		struct requeue_traits<dp::mutex> {
+			static constexpr bool requeueable{ true };
+			static dp::mutex* mutex_of(dp::mutex& mut) noexcept { return &mut; }
+			static void lock_contended(dp::mutex& mut) noexcept { mut.lock_contended(); }
+		};
+
+		template<>
+		struct requeue_traits<std::unique_lock<dp::mutex>> {
+			static constexpr bool requeueable{ true };
+			static dp::mutex* mutex_of(std::unique_lock<dp::mutex>& lck) noexcept { return lck.mutex(); }
+			static void lock_contended(std::unique_lock<dp::mutex>& lck) noexcept {
+				dp::mutex* mut{ lck.release() };
+				mut->lock_contended();
+				lck = std::unique_lock<dp::mutex>{ *mut, std::adopt_lock };
+			}
+		};
+	}
+
+
 	//Condition variable any can be a somewhat expensive class to manage with many implementations holding their own locks
-	//Equally, we need to make sure that our own lock is acquired on attempts to notify as well as attempts to wait
-	//As such, it is probably simpler to reimplement condition_variable_any from scratch then to have to ensure that we don't get a mismatch
-	//of one set of waits acquiring an internal lock and another acquiring an external lock.
+	//Rather than layering an internal mutex and a std::condition_variable underneath the user's lock, we build directly on a futex.
+	//Every notify advances a sequence counter, and a waiter snapshots that counter while it still holds the user's lock.
+	//Any notify which follows the waiter releasing its lock must therefore move the counter on, and the futex wait
+	//will not sleep on a stale value, so no wakeup can be lost.
+	//In fair mode the sequence is replaced by a FIFO queue of waiters, each sleeping on a word of its own.
 	class condition_variable_any {
 
-		std::condition_variable     m_cond;
-		std::shared_ptr<std::mutex> m_mut;
+		std::atomic<std::uint32_t> m_seq{ 0 };
+		//Threads between taking their snapshot and finishing their futex wait. Lets notify skip all work when nobody is waiting
+		//and lets the destructor wait out threads which have been notified but have not yet stopped touching this object.
+		std::atomic<std::uint32_t> m_waiters{ 0 };
+		//The subset of waiters actually asleep in the kernel and not yet woken. Waiters which are still spinning don't need a syscall to be woken.
+		std::atomic<std::uint32_t> m_sleepers{ 0 };
+
+		wait_policy m_policy{};
+		std::atomic<std::uint32_t> m_spin_budget{ 0 };
+
+		//Everything one wait needs to carry from registering under the user's lock to sleeping without it.
+		//Lives on the waiting thread's stack. In fair mode it is also the node queued on the condition variable, and
+		//each waiter sleeps on its own state word so that it can be woken individually.
+		struct waiter {
+			static constexpr std::uint32_t spinning{ 0 };
+			static constexpr std::uint32_t sleeping{ 1 };
+			static constexpr std::uint32_t signalled{ 2 };
+
+			std::uint32_t m_seq{ 0 };
+			//Set if a requeueing notify_all() came after our snapshot, in which case we may have been moved onto the mutex
+			bool m_requeued{ false };
+			waiter* m_prev{ nullptr };
+			waiter* m_next{ nullptr };
+			std::atomic<std::uint32_t> m_state{ spinning };
+		};
+
+		//The futex word of the mutex every waiter has used so far, if requeueing is enabled and they have all used the same dp::mutex
+		std::atomic<const std::atomic<std::uint32_t>*> m_requeue_target{ nullptr };
+		//The sequence value published by the most recent notify_all() which requeued
+		std::atomic<std::uint32_t> m_requeue_seq{ 0 };
+
+		//Fair mode's queue of waiters, oldest first
+		std::mutex m_queue_mut{};
+		waiter* m_head{ nullptr };
+		waiter* m_tail{ nullptr };
 
 
 		//We need a lot of well-planned locking and unlocking of mutexes as we go. This helper class will serve the same purpose.
 		//There's a consistent pattern here - while looping or waiting, locks must be unlocked and relocked every time.
 		//This class allows us to schedule that relative to other locks to keep things consistent.
+		//Waiters which may have been requeued onto their mutex must relock it as contended, so the chain of hand-offs isn't broken.
+		//Whether to relock as contended is only known once the wait is over, so it is read at destruction.
 		template<typename Lock>
 		class scoped_unlock {
 			Lock& m_lck;
+			const bool& m_contended;
 
 		public:
-			explicit scoped_unlock(Lock& lck) : m_lck{ lck } { lck.unlock(); }
-			~scoped_unlock() { m_lck.lock(); }
+			explicit scoped_unlock(Lock& lck, const bool& contended) : m_lck{ lck }, m_contended{ contended } { lck.unlock(); }
+			~scoped_unlock() {
+				if constexpr (detail::requeue_traits<Lock>::requeueable) {
+					if (m_contended) {
+						detail::requeue_traits<Lock>::lock_contended(m_lck);
+						return;
+					}
+				}
+				m_lck.lock();
+			}
 
 			scoped_unlock(const scoped_unlock&) = delete;
 			scoped_unlock& operator=(const scoped_unlock&) = delete;
@@ -53,13 +166,171 @@ namespace dp {
 			scoped_unlock& operator=(scoped_unlock&&) = delete;
 		};
 		template<typename Lock>
-		scoped_unlock(Lock) -> scoped_unlock<Lock>;
+		scoped_unlock(Lock, const bool&) -> scoped_unlock<Lock>;
+
+
+		//Must be called with the user's lock held
+		void begin_wait(waiter& w) noexcept;
+
+		template<typename Lock>
+		void begin_wait(waiter& w, Lock& lock) noexcept {
+			if (m_policy.requeue) {
+				if constexpr (detail::requeue_traits<Lock>::requeueable) {
+					note_requeue_target(&detail::requeue_traits<Lock>::mutex_of(lock)->word());
+				}
+				else {
+					note_requeue_target(nullptr);
+				}
+			}
+			begin_wait(w);
+		}
+
+		//Records the word a waiter could be requeued onto. A null word, or a word different to a previous waiter's,
+		//permanently disables requeueing for this condition variable.
+		void note_requeue_target(const std::atomic<std::uint32_t>* word) noexcept;
+
+		//Must be called before the user's lock is reacquired, otherwise a thread which destroys us while holding that lock would deadlock
+		void end_wait(waiter& w) noexcept;
+
+		bool has_waiters() const noexcept;
+
+		//Spin on word for as long as the policy allows. Returns true if it moved on from expected.
+		bool spin(const std::atomic<std::uint32_t>& word, std::uint32_t expected) noexcept;
+
+		//Requeue bookkeeping: notify_all() publishes its sequence value, and a waiter compares its snapshot against it on waking
+		void publish_requeue(std::uint32_t seq) noexcept;
+		void note_requeued(waiter& w) noexcept;
+
+		//Takes sleepers which a notify has woken out of the count, so that later notifies don't wake them again
+		void uncount_sleepers(std::uint32_t woken) noexcept;
+
+		//Blocks until notified, which may happen spuriously
+		void park(waiter& w) noexcept;
+		void park_for(waiter& w, std::chrono::nanoseconds rel_time) noexcept;
+
+		//Fair mode's notification. Signals up to count of the oldest waiters.
+		void signal_queued(std::size_t count) noexcept;
+
+
+
+		//Every stop state which waiters arrive with needs a callback registered to wake us when a stop is requested.
+		//Rather than each waiter registering its own, waiters on the same stop state share a single hook, so a stop
+		//with N threads waiting costs one broadcast rather than N broadcasts which each wake everyone.
+		//Hooks are claimed, joined and released with a CAS on m_word, so waiters never serialise on a lock of ours to use them.
+		class stop_hook : public detail::stop_callback_node {
+		public:
+			//The low bits count the hook's users. The busy bit is held while the hook is being set up or torn down, by whichever
+			//thread is doing so, and the generation in the high half moves on with every set up so a stale word can never be CASed.
+			static constexpr std::uint64_t users_mask{ 0x7fff'ffff };
+			static constexpr std::uint64_t busy_bit{ 0x8000'0000 };
+			static constexpr std::uint64_t generation_unit{ std::uint64_t{ 1 } << 32 };
+
+			condition_variable_any* m_cv{ nullptr };
+			std::atomic<std::uint64_t> m_word{ 0 };
+			//The stop state being watched, for matching against without touching the shared_ptr. Published by m_word.
+			std::atomic<const detail::stop_state*> m_key{ nullptr };
+			//Only touched while holding the busy bit
+			std::shared_ptr<detail::stop_state> m_state{};
+			bool m_registered{ false };
+
+			stop_hook() noexcept : detail::stop_callback_node{ &stop_hook::invoke } {}
+
+			static void invoke(detail::stop_callback_node* node) noexcept;
+		};
+
+		//A handful of hooks covers the common case of one or two tokens (say, a job's own token and a global shutdown token) per
+		//condition variable. Should they all be taken, a waiter falls back to a private callback of its own.
+		static constexpr std::size_t shared_stop_hooks{ 4 };
+		std::array<stop_hook, shared_stop_hooks> m_hooks{};
+
+		struct broadcast {
+			condition_variable_any* m_cv;
+			void operator()() const noexcept { m_cv->notify_all(); }
+		};
+
+		//Held by a stop-aware waiter for the duration of its wait. The stop state is kept for the whole call, but the hook which wakes us
+		//is only attached around each sleep: it must be detached before end_wait(), while the waiter still keeps us alive, as the
+		//waiting thread may not get back to us until after another thread has notified and destroyed the condition variable.
+		class stop_registration {
+			condition_variable_any& m_cv;
+			const dp::stop_token& m_token;
+			std::shared_ptr<detail::stop_state> m_state;
+			stop_hook* m_hook{ nullptr };
+			std::optional<dp::stop_callback<broadcast>> m_own_callback{};
+
+		public:
+			stop_registration(condition_variable_any& cv, const dp::stop_token& token) noexcept
+				: m_cv{ cv }, m_token{ token }, m_state{ token.m_state.load(std::memory_order_acquire) } {}
+			~stop_registration();
+
+			stop_registration(const stop_registration&) = delete;
+			stop_registration& operator=(const stop_registration&) = delete;
+			stop_registration(stop_registration&&) = delete;
+			stop_registration& operator=(stop_registration&&) = delete;
+
+			void attach();
+			void detach() noexcept;
+
+			bool stop_requested() const noexcept {
+				return m_state && m_state->stop_requested();
+			}
+
+			//A stop is published before the hook notifies. Checking for it after registering as a waiter means either we see
+			//the stop here, or the hook's notify lands after our registration and the wait returns.
+			//The fence is what makes that true, as the stop flag itself is not read with sequential consistency.
+			bool stop_requested_since_snapshot() const noexcept {
+				std::atomic_thread_fence(std::memory_order_seq_cst);
+				return stop_requested();
+			}
+		};
+
+		template<std::size_t N, std::size_t... Is>
+		std::array<stop_registration, N> register_stops(const std::array<dp::stop_token, N>& tokens, std::index_sequence<Is...>) noexcept {
+			return { { stop_registration{ *this, tokens[Is] }... } };
+		}
+
+		template<std::size_t N>
+		void attach_stops(std::array<stop_registration, N>& stops) {
+			for (auto& stop : stops) {
+				stop.attach();
+			}
+		}
+
+		template<std::size_t N>
+		void detach_stops(std::array<stop_registration, N>& stops) noexcept {
+			for (auto& stop : stops) {
+				stop.detach();
+			}
+		}
+
+		//Index of the first token with a stop requested, if any. The fence serves the same purpose as in stop_requested_since_snapshot().
+		template<std::size_t N>
+		static std::optional<std::size_t> first_stopped(const std::array<stop_registration, N>& stops) noexcept {
+			std::atomic_thread_fence(std::memory_order_seq_cst);
+			for (std::size_t i = 0; i < N; ++i) {
+				if (stops[i].stop_requested()) {
+					return i;
+				}
+			}
+			return std::nullopt;
+		}
 
 
 
 	public:
 
-		condition_variable_any() : m_cond{}, m_mut{ std::make_shared<std::mutex>() } {}
+		condition_variable_any() noexcept : condition_variable_any{ wait_policy{} } {}
+
+		explicit condition_variable_any(wait_policy policy) noexcept : m_policy{ policy }, m_spin_budget{ policy.max_spins } {
+			m_policy.requeue = policy.requeue && !policy.fair;
+			for (auto& hook : m_hooks) {
+				hook.m_cv = this;
+			}
+		}
+
+		//Notified threads may still be on their way out of a wait when we are destroyed, which the standard permits.
+		//That window is only a handful of instructions long, so we simply yield until they have left.
+		~condition_variable_any();
 
 		condition_variable_any(const condition_variable_any&) = delete;
 		condition_variable_any& operator=(const condition_variable_any&) = delete;
@@ -69,14 +340,16 @@ namespace dp {
 		void notify_one() noexcept;
 		void notify_all() noexcept;
 
+		//Wakes up to count waiting threads. Exact in fair mode; otherwise threads which are still spinning may also see the notification.
+		void notify_n(std::size_t count) noexcept;
+
 		template<typename Lock>
 		void wait(Lock& lock) {
-			auto mut{ m_mut };
-			std::unique_lock outer_lock{ *mut };
-			scoped_unlock param_unlock{ lock };
-			//We now need to ensure that the outer_lock is unlocked before the param_lock is locked
-			std::unique_lock inner_lock{ std::move(outer_lock) };
-			m_cond.wait(inner_lock);
+			waiter w{};
+			begin_wait(w, lock);
+			scoped_unlock param_unlock{ lock, w.m_requeued };
+			park(w);
+			end_wait(w);
 		}
 
 		template<typename Lock, typename Pred>
@@ -89,43 +362,67 @@ namespace dp {
 		template<typename Lock, typename Pred>
 		bool wait(Lock& lock, dp::stop_token token, Pred pred) {
 
+			stop_registration stop{ *this, token };
+
 			//Initial check for if a stop was already requested before this function was called
-			if (token.stop_requested()) {
+			if (stop.stop_requested()) {
 				return pred();
 			}
 
-			//Then we need to do a delicate balancing act to ensure we don't miss our wait.
-			//We need to ensure that either:
-			// * We are waiting when notify is called
-			// * The notify_all() call itself cannot proceed until we are waiting
-			//This we manage with a similar pattern to callbacks - we hold the lock which the call to notify
-			//will want to acquire. If we see a requested stop we know we can exit the function. If we don't,
-			//we know the lock will be held until wait() and then notify_all() will be able to grab it
-			//Either way we don't miss our wait.
-
-			//Silence unnecessary warnings. We never use the callback object but it's vital that it's there
-			[[maybe_unused]] dp::stop_callback callback{ token, [this] {notify_all(); } };
-
-			std::shared_ptr mut{ m_mut };
 			while (!pred()) {
-				std::unique_lock outer_lock{ *mut };
-				if (token.stop_requested()){
+				waiter w{};
+				stop.attach();
+				begin_wait(w, lock);
+				if (stop.stop_requested_since_snapshot()) {
+					stop.detach();
+					end_wait(w);
 					return false;
 				}
-				scoped_unlock param_unlock{ lock };
-				std::unique_lock inner_lock{ std::move(outer_lock) };
-				m_cond.wait(inner_lock);
+				scoped_unlock param_unlock{ lock, w.m_requeued };
+				park(w);
+				stop.detach();
+				end_wait(w);
 			}
 			return true;
 		}
 
+		//Wait on several stop tokens at once, such as a job's own token and a global shutdown token.
+		//Every token is registered in a single pass, and tokens sharing a stop state share a single registration.
+		template<typename Lock, std::size_t N, typename Pred>
+		stop_wait_result wait(Lock& lock, const std::array<dp::stop_token, N>& tokens, Pred pred) {
+			auto stops{ register_stops(tokens, std::make_index_sequence<N>{}) };
+
+			if (const auto stopped{ first_stopped(stops) }) {
+				return { pred(), stopped };
+			}
+
+			while (!pred()) {
+				waiter w{};
+				attach_stops(stops);
+				begin_wait(w, lock);
+				if (const auto stopped{ first_stopped(stops) }) {
+					detach_stops(stops);
+					end_wait(w);
+					return { false, stopped };
+				}
+				scoped_unlock param_unlock{ lock, w.m_requeued };
+				park(w);
+				detach_stops(stops);
+				end_wait(w);
+			}
+			return { true, std::nullopt };
+		}
+
 		template<typename Lock, typename Clock, typename Duration>
 		std::cv_status wait_until(Lock& lock, const std::chrono::time_point<Clock, Duration>& end_time){
-			std::shared_ptr mut{ m_mut };
-			std::unique_lock outer_lock{ *mut };
-			scoped_unlock param_unlock{ lock };
-			std::unique_lock inner_lock{ std::move(outer_lock) };
-			return m_cond.wait_until(inner_lock, end_time);
+			{
+				waiter w{};
+				begin_wait(w, lock);
+				scoped_unlock param_unlock{ lock, w.m_requeued };
+				park_for(w, detail::time_until(end_time));
+				end_wait(w);
+			}
+			return Clock::now() < end_time ? std::cv_status::no_timeout : std::cv_status::timeout;
 		}
 
 		template<typename Lock, typename Clock, typename Duration, typename Pred>
@@ -134,31 +431,35 @@ namespace dp {
 				if (wait_until(lock, end_time) == std::cv_status::timeout) {
 					return predicate();
 				}
-				return true;
 			}
+			return true;
 		}
 
 		template<typename Lock, typename Clock, typename Duration, typename Pred>
 		bool wait_until(Lock& lock, dp::stop_token token, const std::chrono::time_point<Clock, Duration>& end_time, Pred predicate) {
+			stop_registration stop_reg{ *this, token };
+
 			//As with wait(), we check if a stop was requested before we even got to this function
-			if (token.stop_requested()) {
+			if (stop_reg.stop_requested()) {
 				return predicate();
 			}
 
-			//Otherwise we do our dance to make sure we're either waiting or blocking the notify call until we are
-			[[maybe_unused]] dp::stop_callback callback{ token, [this] {notify_all(); } };
-			std::shared_ptr mut{ m_mut };
 			while (!predicate()) {
 				bool stop{ false };
 				{
-					std::unique_lock outer_lock{ *mut };
-					if (token.stop_requested()) {
+					waiter w{};
+					stop_reg.attach();
+					begin_wait(w, lock);
+					if (stop_reg.stop_requested_since_snapshot()) {
+						stop_reg.detach();
+						end_wait(w);
 						return false;
 					}
-					scoped_unlock param_unlock{ lock };
-					std::unique_lock inner_lock{ std::move(outer_lock) };
-					const std::cv_status status{ m_cond.wait_until(inner_lock, end_time) };
-					stop = (status == std::cv_status::timeout || token.stop_requested());
+					scoped_unlock param_unlock{ lock, w.m_requeued };
+					park_for(w, detail::time_until(end_time));
+					stop_reg.detach();
+					end_wait(w);
+					stop = (Clock::now() >= end_time || stop_reg.stop_requested());
 				}
 				if (stop) {
 					return predicate();
@@ -167,6 +468,39 @@ namespace dp {
 			return true;
 		}
 
+		template<typename Lock, std::size_t N, typename Clock, typename Duration, typename Pred>
+		stop_wait_result wait_until(Lock& lock, const std::array<dp::stop_token, N>& tokens, const std::chrono::time_point<Clock, Duration>& end_time, Pred predicate) {
+			auto stops{ register_stops(tokens, std::make_index_sequence<N>{}) };
+
+			if (const auto stopped{ first_stopped(stops) }) {
+				return { predicate(), stopped };
+			}
+
+			while (!predicate()) {
+				{
+					waiter w{};
+					attach_stops(stops);
+					begin_wait(w, lock);
+					if (const auto stopped{ first_stopped(stops) }) {
+						detach_stops(stops);
+						end_wait(w);
+						return { false, stopped };
+					}
+					scoped_unlock param_unlock{ lock, w.m_requeued };
+					park_for(w, detail::time_until(end_time));
+					detach_stops(stops);
+					end_wait(w);
+				}
+				if (const auto stopped{ first_stopped(stops) }) {
+					return { predicate(), stopped };
+				}
+				if (Clock::now() >= end_time) {
+					return { predicate(), std::nullopt };
+				}
+			}
+			return { true, std::nullopt };
+		}
+
 		template<typename Lock, typename Rep, typename Period>
 		std::cv_status wait_for(Lock& lock, const std::chrono::duration<Rep, Period>& wait_time) {
 			return wait_until(lock, std::chrono::steady_clock::now() + wait_time);
@@ -182,6 +516,11 @@ namespace dp {
 			return wait_until(lock, std::move(token), std::chrono::steady_clock::now() + wait_time, std::move(pred));
 		}
 
+		template<typename Lock, std::size_t N, typename Rep, typename Period, typename Pred>
+		stop_wait_result wait_for(Lock& lock, const std::array<dp::stop_token, N>& tokens, const std::chrono::duration<Rep, Period>& wait_time, Pred pred) {
+			return wait_until(lock, tokens, std::chrono::steady_clock::now() + wait_time, std::move(pred));
+		}
+
 
 	};
 
@@ -0,0 +1,142 @@
+#ifndef DP_ELASTIC_POOL
+#define DP_ELASTIC_POOL
+
+/*
+*	A pool of dp::jthreads which grows and shrinks with its load.
+*
+*	All workers share a single FIFO queue. Whenever the oldest queued task has waited longer than the latency threshold and no worker is idle,
+*	the pool starts another worker, up to the maximum. A worker which then finds nothing to do for the linger time is retired by requesting a stop
+*	on its own stop_source, down to the minimum. The check runs whenever a task is queued or taken, and on a monitor thread which sleeps until
+*	the oldest task would cross the threshold, so a backlog stuck behind long-running tasks still grows the pool. Growth is opportunistic: if a new thread cannot be started the queued work simply waits
+*	for an existing worker, and the failure is counted in the stats.
+*
+*	Tasks follow the same rules as those on dp::thread_pool. They may take a dp::stop_token, which is stopped when the pool is.
+*	Stopping the pool (on request_stop() or destruction) lets running tasks finish but discards any which have not started. Tasks must not throw.
+*/
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <list>
+#include <type_traits>
+#include <utility>
+
+#include "condition_variable.h"
+#include "jthread.h"
+#include "mutex.h"
+#include "stop_token.h"
+#include "thread_pool.h"
+
+namespace dp {
+
+	class elastic_pool {
+	public:
+		struct resize_event {
+			enum class kind { grew, retired };
+			kind what;
+			//The number of workers after the resize
+			std::size_t threads;
+			//How long the oldest queued task had been waiting when the pool grew. Zero for retirements.
+			std::chrono::nanoseconds queue_latency;
+		};
+
+		struct options {
+			std::size_t min_threads{ 1 };
+			std::size_t max_threads{ dp::jthread::effective_concurrency() };
+			std::chrono::microseconds latency_threshold{ 500 };
+			std::chrono::milliseconds linger{ 1000 };
+			//Called on the thread which triggered each resize, with no locks held
+			std::function<void(const resize_event&)> on_resize{};
+		};
+
+		struct stats {
+			std::size_t threads;
+			std::size_t peak_threads;
+			std::size_t queued;
+			std::uint64_t grown;
+			std::uint64_t retired;
+			std::uint64_t failed_grows;
+		};
+
+	private:
+		struct worker {
+			dp::stop_source m_stop{};
+			bool m_exited{ false };
+			dp::jthread m_thread{};
+		};
+
+		struct queued_task {
+			detail::pool_task* m_task;
+			std::chrono::steady_clock::time_point m_enqueued;
+		};
+
+		options m_options;
+		dp::stop_source m_pool_stop{};
+
+		mutable dp::mutex m_mut{};
+		dp::condition_variable_any m_cv{};
+		std::deque<queued_task> m_queue{};
+		//A list so that a worker's record never moves, and so that records can be spliced in and out under the lock without allocating
+		std::list<worker> m_workers{};
+		std::size_t m_live{ 0 };
+		std::size_t m_idle{ 0 };
+		std::size_t m_starting{ 0 };
+		std::size_t m_peak{ 0 };
+		std::uint64_t m_grown{ 0 };
+		std::uint64_t m_retired{ 0 };
+		std::uint64_t m_failed_grows{ 0 };
+
+		//Set while the monitor is timing a backlog, so that only the first task to create one needs to wake it
+		dp::condition_variable_any m_monitor_cv{};
+		bool m_monitor_armed{ false };
+
+		void enqueue(detail::pool_task* task);
+		bool backlogged() const noexcept;
+		bool should_grow(std::chrono::steady_clock::time_point now) const noexcept;
+		bool arm_monitor() noexcept;
+		bool grow(std::chrono::nanoseconds latency) noexcept;
+		void monitor(const dp::stop_token& token);
+		std::list<worker> start_worker();
+		void reap(std::list<worker>& into) noexcept;
+		void run(worker& self);
+		void notify_resize(const resize_event& event) noexcept;
+
+		//Only started if the pool is able to grow. Declared last so that it is joined before anything it uses is destroyed.
+		dp::jthread m_monitor{};
+
+	public:
+		elastic_pool();
+		explicit elastic_pool(options opts);
+		~elastic_pool();
+
+		elastic_pool(const elastic_pool&) = delete;
+		elastic_pool& operator=(const elastic_pool&) = delete;
+		elastic_pool(elastic_pool&&) = delete;
+		elastic_pool& operator=(elastic_pool&&) = delete;
+
+		template<typename Func>
+		void submit(Func&& func) {
+			static_assert(std::is_invocable_v<std::decay_t<Func>&> || std::is_invocable_v<std::decay_t<Func>&, dp::stop_token>,
+				"Function passed to elastic_pool must be invocable with no arguments or a stop_token");
+			enqueue(new detail::pool_task_impl<std::decay_t<Func>>{ std::forward<Func>(func) });
+		}
+
+		template<typename Func>
+		void submit(dp::stop_token token, Func&& func) {
+			static_assert(std::is_invocable_v<std::decay_t<Func>&> || std::is_invocable_v<std::decay_t<Func>&, dp::stop_token>,
+				"Function passed to elastic_pool must be invocable with no arguments or a stop_token");
+			enqueue(new detail::pool_task_with_token<std::decay_t<Func>>{ std::move(token), std::forward<Func>(func) });
+		}
+
+		std::size_t size() const;
+		stats get_stats() const;
+
+		bool request_stop() noexcept;
+		dp::stop_token get_stop_token() const noexcept;
+	};
+
+}
+
+#endif
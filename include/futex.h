@@ -0,0 +1,80 @@
+#ifndef DP_FUTEX
+#define DP_FUTEX
+
+/*
+*	Minimal wait-on-address primitives which the blocking tools in this library are built on.
+*
+*	On Linux these map directly to the futex syscall, on Windows to WaitOnAddress, and everywhere else to a small
+*	table of mutex/condvar pairs hashed by address. All waits may return spuriously, so callers must always re-check
+*	the value they were waiting on.
+*
+*	Callers which count their own sleeping threads can have the waker account for the threads it wakes. Where the platform
+*	reports it, each wake returns the number of threads it took off the queue, and each of those threads' waits reports that
+*	a wake ended it. Elsewhere wakes report zero and waits never report being woken, so every sleeper accounts for itself.
+*/
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <optional>
+
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#include <intrin.h>
+#endif
+
+namespace dp::detail {
+
+	//How a wait ended. Only reported as woken when the wake which ended it counted this thread in its return value.
+	enum class wait_outcome { woken, timed_out, other };
+
+	//Block the calling thread for as long as the value held in word is equal to expected.
+	//Returns true if the thread was woken by a wake which counted it.
+	bool futex_wait(const std::atomic<std::uint32_t>& word, std::uint32_t expected) noexcept;
+
+	//As above, but give up after rel_time has elapsed. Returns false if the wait timed out.
+	bool futex_wait_for(const std::atomic<std::uint32_t>& word, std::uint32_t expected, std::chrono::nanoseconds rel_time) noexcept;
+	wait_outcome futex_wait_outcome(const std::atomic<std::uint32_t>& word, std::uint32_t expected, std::chrono::nanoseconds rel_time) noexcept;
+
+	//Each returns the number of threads woken, or zero where the platform doesn't say
+	std::uint32_t futex_wake_one(const std::atomic<std::uint32_t>& word) noexcept;
+	std::uint32_t futex_wake_n(const std::atomic<std::uint32_t>& word, std::uint32_t count) noexcept;
+	std::uint32_t futex_wake_all(const std::atomic<std::uint32_t>& word) noexcept;
+
+	//Provided word still holds expected, wake up to wake_count threads waiting on it and move every other waiter onto target's wait queue
+	//without waking them. Returns the number of threads woken or moved, which are counted as woken once target wakes them.
+	//Returns nullopt if the value had changed or the platform has no such operation, in which case nothing was done.
+	std::optional<std::uint32_t> futex_requeue(const std::atomic<std::uint32_t>& word, std::uint32_t expected, const std::atomic<std::uint32_t>& target, std::uint32_t wake_count) noexcept;
+
+
+	//Hint to the processor that we are in a spin-wait loop, so it can back off and yield resources to a sibling hyperthread
+	inline void cpu_relax() noexcept {
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+		_mm_pause();
+#elif defined(__x86_64__) || defined(__i386__)
+		__builtin_ia32_pause();
+#elif defined(__aarch64__) || defined(__arm__)
+		asm volatile("yield" ::: "memory");
+#endif
+	}
+
+
+	//Timed waits in this library accept any clock, but the underlying wait is always relative.
+	//This calculates how long remains until end_time, clamped so that distant deadlines such as time_point::max()
+	//don't overflow the conversion. A clamped wait simply wakes early and the caller re-checks the clock.
+	template<typename Clock, typename Duration>
+	std::chrono::nanoseconds time_until(const std::chrono::time_point<Clock, Duration>& end_time) {
+		const auto now{ Clock::now() };
+		if (end_time <= now) {
+			return std::chrono::nanoseconds::zero();
+		}
+		const auto remaining{ end_time - now };
+		constexpr std::chrono::hours max_wait{ 24 };
+		if (remaining >= max_wait) {
+			return max_wait;
+		}
+		return std::chrono::ceil<std::chrono::nanoseconds>(remaining);
+	}
+
+}
+
+#endif
@@ -0,0 +1,408 @@
+#ifndef DP_FUTURE
+#define DP_FUTURE
+
+/*
+*	Futures whose tasks can be cancelled.
+*
+*	dp::async runs a function on a new dp::jthread (borrowed from the thread cache when that is enabled), or on an executor such as dp::thread_pool,
+*	and returns a dp::future for its result. If the function takes a dp::stop_token as its first parameter it is passed the future's token.
+*	Calling cancel() requests a stop on that token. So does destroying the future while the task is still running, after which the destructor
+*	waits for the task to finish, as a jthread's does, so that a task can never outlive the objects it refers to.
+*
+*	The task, its arguments, its result and its stop state all live in one allocation, shared between the future and whoever runs the task.
+*	Continuations added with then() run on the thread which completes their predecessor, or immediately on the calling thread if it has already
+*	completed, so chaining never needs threads of its own. Cancelling a continuation's future cancels its predecessors too.
+*	A task or continuation whose future was cancelled before it could start does not run; its future holds a std::system_error with
+*	errc::operation_canceled instead. A task dropped unrun by a stopped executor leaves a std::future_error with future_errc::broken_promise.
+*/
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <future>
+#include <memory>
+#include <optional>
+#include <system_error>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+
+#include "futex.h"
+#include "jthread.h"
+#include "stop_token.h"
+#include "this_thread.h"
+
+namespace dp {
+
+	template<typename T>
+	class future;
+
+	namespace detail {
+
+		class future_state_base {
+			enum : std::uint32_t { no_continuation, continuation_set, finished };
+
+			//Bit 0 is set once the result is ready. Waiters interrupted by a stop request add 2, which wakes them without touching bit 0.
+			std::atomic<std::uint32_t> m_word{ 0 };
+			std::atomic<std::uint32_t> m_continuation_state{ no_continuation };
+			std::shared_ptr<future_state_base> m_continuation{};
+
+			void poke() noexcept;
+
+		public:
+			//Tokens share ownership of the whole state through an aliasing shared_ptr, so the stop state costs no allocation of its own
+			detail::stop_state m_stop{};
+			std::exception_ptr m_error{};
+			//Set on a continuation before it is published, so that cancelling it can cancel its predecessor too
+			std::shared_ptr<future_state_base> m_predecessor{};
+
+			future_state_base() = default;
+			future_state_base(const future_state_base&) = delete;
+			future_state_base& operator=(const future_state_base&) = delete;
+			virtual ~future_state_base() = default;
+
+			//Called on a continuation once its predecessor has finished
+			virtual void on_predecessor_ready(future_state_base& predecessor, const std::shared_ptr<future_state_base>& self) noexcept;
+
+			bool ready() const noexcept {
+				return (m_word.load(std::memory_order_acquire) & 1) != 0;
+			}
+
+			//Publishes the result and runs any continuation
+			void finish() noexcept;
+			void set_exception(std::exception_ptr error) noexcept;
+			void set_cancelled() noexcept;
+
+			//States which fan out to tasks of their own extend this to stop those tasks too
+			virtual void request_stop() noexcept;
+			void add_continuation(std::shared_ptr<future_state_base> next) noexcept;
+
+			void wait() noexcept;
+			//These return true if the result became ready, or false on timeout or when token is stopped first
+			bool wait_for(std::chrono::nanoseconds rel_time) noexcept;
+			bool wait(const dp::stop_token& token) noexcept;
+			bool wait_for(const dp::stop_token& token, std::chrono::nanoseconds rel_time) noexcept;
+		};
+
+		inline dp::stop_token token_for(const std::shared_ptr<future_state_base>& state) noexcept {
+			return detail::make_stop_token(std::shared_ptr<detail::stop_state>{ state, &state->m_stop });
+		}
+
+		[[noreturn]] void throw_no_state();
+		[[noreturn]] void throw_wait_cancelled();
+
+		template<typename T>
+		class future_state : public future_state_base {
+			std::optional<T> m_value{};
+
+		public:
+			template<typename... Args>
+			void set_value(Args&&... args) {
+				m_value.emplace(std::forward<Args>(args)...);
+				finish();
+			}
+
+			T take() {
+				if (m_error) {
+					std::rethrow_exception(m_error);
+				}
+				return std::move(*m_value);
+			}
+		};
+
+		template<>
+		class future_state<void> : public future_state_base {
+		public:
+			void set_value() noexcept {
+				finish();
+			}
+
+			void take() {
+				if (m_error) {
+					std::rethrow_exception(m_error);
+				}
+			}
+		};
+
+		//Runs func and stores whatever it returns or throws in state
+		template<typename T, typename Func>
+		void fulfil(future_state<T>& state, Func&& func) noexcept {
+			try {
+				if constexpr (std::is_void_v<T>) {
+					std::forward<Func>(func)();
+					state.set_value();
+				}
+				else {
+					state.set_value(std::forward<Func>(func)());
+				}
+			}
+			catch (...) {
+				state.set_exception(std::current_exception());
+			}
+		}
+
+		template<typename Func, typename... Args>
+		using invoke_with_token_result_t = std::conditional_t<std::is_invocable_v<Func, dp::stop_token, Args...>,
+			std::invoke_result<Func, dp::stop_token, Args...>, std::invoke_result<Func, Args...>>;
+
+		//Results are held by value, so a function returning a reference gives a future of a copy
+		template<typename Func, typename... Args>
+		using async_result_t = std::decay_t<typename invoke_with_token_result_t<Func, Args...>::type>;
+
+		template<typename Func, typename T>
+		struct continuation_result {
+			using type = async_result_t<Func, T>;
+		};
+		template<typename Func>
+		struct continuation_result<Func, void> {
+			using type = async_result_t<Func>;
+		};
+
+		template<typename T, typename Func, typename... Args>
+		class async_state : public future_state<T> {
+			std::tuple<Func, Args...> m_call;
+
+		public:
+			template<typename F, typename... A>
+			explicit async_state(F&& func, A&&... args) : m_call{ std::forward<F>(func), std::forward<A>(args)... } {}
+
+			void run(const dp::stop_token& token) noexcept {
+				if (this->m_stop.stop_requested()) {
+					this->set_cancelled();
+					return;
+				}
+				detail::thread_stop_scope scope{ token };
+				fulfil(*this, [this, &token]() -> T {
+					return std::apply([&token](Func& func, Args&... args) -> T {
+						if constexpr (std::is_invocable_v<Func, dp::stop_token, Args...>) {
+							return std::invoke(std::move(func), token, std::move(args)...);
+						}
+						else {
+							return std::invoke(std::move(func), std::move(args)...);
+						}
+						}, m_call);
+					});
+			}
+		};
+
+		template<typename T, typename Func, typename P>
+		class continuation_state : public future_state<T> {
+			Func m_func;
+
+		public:
+			template<typename F>
+			explicit continuation_state(F&& func) : m_func{ std::forward<F>(func) } {}
+
+			void on_predecessor_ready(future_state_base& predecessor, const std::shared_ptr<future_state_base>& self) noexcept override {
+				auto& pred{ static_cast<future_state<P>&>(predecessor) };
+				if (this->m_stop.stop_requested()) {
+					this->set_cancelled();
+					return;
+				}
+				if (pred.m_error) {
+					this->set_exception(pred.m_error);
+					return;
+				}
+				const dp::stop_token token{ token_for(self) };
+				detail::thread_stop_scope scope{ token };
+				fulfil(*this, [this, &pred, &token]() -> T {
+					if constexpr (std::is_void_v<P>) {
+						if constexpr (std::is_invocable_v<Func, dp::stop_token>) {
+							return std::invoke(std::move(m_func), token);
+						}
+						else {
+							return std::invoke(std::move(m_func));
+						}
+					}
+					else {
+						if constexpr (std::is_invocable_v<Func, dp::stop_token, P>) {
+							return std::invoke(std::move(m_func), token, pred.take());
+						}
+						else {
+							return std::invoke(std::move(m_func), pred.take());
+						}
+					}
+					});
+			}
+		};
+
+		//The callable handed to a thread or executor. If it is destroyed without having been run the future is told its promise was broken,
+		//so that nobody waits forever on a task an executor dropped.
+		template<typename State>
+		class task_runner {
+			std::shared_ptr<State> m_state;
+
+		public:
+			explicit task_runner(std::shared_ptr<State> state) noexcept : m_state{ std::move(state) } {}
+			task_runner(task_runner&&) noexcept = default;
+			task_runner& operator=(task_runner&&) = delete;
+
+			~task_runner() {
+				if (m_state) {
+					m_state->set_exception(std::make_exception_ptr(std::future_error{ std::future_errc::broken_promise }));
+				}
+			}
+
+			void operator()() {
+				const std::shared_ptr<State> state{ std::move(m_state) };
+				state->run(token_for(state));
+			}
+		};
+
+		template<typename Executor, typename = void>
+		struct is_executor : std::false_type {};
+		template<typename Executor>
+		struct is_executor<Executor, std::void_t<decltype(std::declval<Executor&>().submit(std::declval<void(*)()>()))>> : std::true_type {};
+
+		struct future_access {
+			template<typename T>
+			static dp::future<T> make(std::shared_ptr<future_state<T>> state) noexcept {
+				return dp::future<T>{ std::move(state) };
+			}
+		};
+
+	}
+
+	template<typename T>
+	class future {
+		std::shared_ptr<detail::future_state<T>> m_state{};
+
+		friend struct detail::future_access;
+		explicit future(std::shared_ptr<detail::future_state<T>> state) noexcept : m_state{ std::move(state) } {}
+
+		void abandon() noexcept {
+			if (m_state) {
+				m_state->request_stop();
+				m_state->wait();
+				m_state.reset();
+			}
+		}
+
+		detail::future_state<T>& state() const {
+			if (!m_state) {
+				detail::throw_no_state();
+			}
+			return *m_state;
+		}
+
+	public:
+		future() noexcept = default;
+		future(future&&) noexcept = default;
+		future& operator=(future&& other) noexcept {
+			if (this != &other) {
+				abandon();
+				m_state = std::move(other.m_state);
+			}
+			return *this;
+		}
+		~future() {
+			abandon();
+		}
+
+		bool valid() const noexcept {
+			return static_cast<bool>(m_state);
+		}
+
+		bool is_ready() const {
+			return state().ready();
+		}
+
+		//Requests a stop on the task's token, and on those of any predecessors. The result must still be collected or the future destroyed.
+		void cancel() {
+			state().request_stop();
+		}
+
+		//Waits for the result and takes it, rethrowing anything the task threw. Leaves the future invalid.
+		T get() {
+			state().wait();
+			const std::shared_ptr<detail::future_state<T>> taken{ std::move(m_state) };
+			return taken->take();
+		}
+
+		//As above, but gives up if token is stopped first, throwing std::system_error with errc::operation_canceled and leaving the future valid
+		T get(const dp::stop_token& token) {
+			if (!state().wait(token)) {
+				detail::throw_wait_cancelled();
+			}
+			return get();
+		}
+
+		void wait() const {
+			state().wait();
+		}
+
+		template<typename Rep, typename Period>
+		std::future_status wait_for(const std::chrono::duration<Rep, Period>& rel_time) const {
+			return wait_until(std::chrono::steady_clock::now() + rel_time);
+		}
+
+		template<typename Clock, typename Duration>
+		std::future_status wait_until(const std::chrono::time_point<Clock, Duration>& end_time) const {
+			detail::future_state<T>& target{ state() };
+			while (!target.wait_for(detail::time_until(end_time))) {
+				if (Clock::now() >= end_time) {
+					return std::future_status::timeout;
+				}
+			}
+			return std::future_status::ready;
+		}
+
+		//Returns true if the result became ready, or false if token was stopped first
+		bool wait(const dp::stop_token& token) const {
+			return state().wait(token);
+		}
+
+		//Returns true if the result became ready, or false on timeout or if token was stopped first
+		template<typename Rep, typename Period>
+		bool wait_for(const dp::stop_token& token, const std::chrono::duration<Rep, Period>& rel_time) const {
+			const auto end_time{ std::chrono::steady_clock::now() + rel_time };
+			detail::future_state<T>& target{ state() };
+			while (!target.wait_for(token, detail::time_until(end_time))) {
+				if (token.stop_requested() || std::chrono::steady_clock::now() >= end_time) {
+					return false;
+				}
+			}
+			return true;
+		}
+
+		//Chains func to run on the result, passing a stop_token first if it takes one. Consumes this future.
+		template<typename Func>
+		auto then(Func&& func) && {
+			using result = typename detail::continuation_result<std::decay_t<Func>, T>::type;
+			state();
+			auto next{ std::make_shared<detail::continuation_state<result, std::decay_t<Func>, T>>(std::forward<Func>(func)) };
+			next->m_predecessor = m_state;
+			const std::shared_ptr<detail::future_state<T>> predecessor{ std::move(m_state) };
+			dp::future<result> chained{ detail::future_access::make<result>(next) };
+			predecessor->add_continuation(std::move(next));
+			return chained;
+		}
+	};
+
+	//Runs func(args...) on a new jthread, passing the future's stop_token first if func accepts one
+	template<typename Func, typename... Args, std::enable_if_t<!detail::is_executor<std::decay_t<Func>>::value, int> = 0>
+	[[nodiscard]] auto async(Func&& func, Args&&... args) {
+		using result = detail::async_result_t<std::decay_t<Func>, std::decay_t<Args>...>;
+		using state_type = detail::async_state<result, std::decay_t<Func>, std::decay_t<Args>...>;
+		auto state{ std::make_shared<state_type>(std::forward<Func>(func), std::forward<Args>(args)...) };
+		dp::future<result> fut{ detail::future_access::make<result>(state) };
+		dp::jthread{ detail::task_runner<state_type>{ std::move(state) } }.detach();
+		return fut;
+	}
+
+	//As above, but submits the task to an executor with a submit(func) member, such as dp::thread_pool or dp::elastic_pool
+	template<typename Executor, typename Func, typename... Args, std::enable_if_t<detail::is_executor<Executor>::value, int> = 0>
+	[[nodiscard]] auto async(Executor& executor, Func&& func, Args&&... args) {
+		using result = detail::async_result_t<std::decay_t<Func>, std::decay_t<Args>...>;
+		using state_type = detail::async_state<result, std::decay_t<Func>, std::decay_t<Args>...>;
+		auto state{ std::make_shared<state_type>(std::forward<Func>(func), std::forward<Args>(args)...) };
+		dp::future<result> fut{ detail::future_access::make<result>(state) };
+		executor.submit(detail::task_runner<state_type>{ std::move(state) });
+		return fut;
+	}
+
+}
+
+#endif
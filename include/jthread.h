@@ -7,9 +7,13 @@
 
 //Full documentation is found at: https://github.com/DryPerspective/Cpp17_jthread/wiki/jthread
 
+#include <functional>
 #include <thread>
 #include <type_traits>
 #include "stop_token.h"
+#include "this_thread.h"
+#include "thread_attributes.h"
+#include "thread_cache.h"
 
 namespace dp {
 
@@ -17,13 +21,39 @@ namespace dp {
 	class jthread {
 
 		std::thread m_thread;
+		//Only used by threads started with attributes or borrowed from the thread cache
+		detail::native_thread m_native;
 		dp::stop_source m_stop;
 
+		template<typename Func, typename... Args>
+		static auto entry_point() {
+			//First, ill-formed checks
+			static_assert(std::is_constructible_v<std::decay_t<Func>, Func>, "Invalid function type used to construct jthread");
+			static_assert((std::is_constructible_v<std::decay_t<Args>, Args> && ...), "Invalid argument types used to construct jthread");
+			static_assert(
+				std::is_invocable_v<std::decay_t<Func>, std::decay_t<Args>...> ||
+				std::is_invocable_v<std::decay_t<Func>, dp::stop_token, std::decay_t<Args>...>,
+				"Function passed to jthread is not invocable with provided arguments"
+				);
+
+			//And now to selectively apply the stop_token. Either way the token is installed as the thread's current token before func starts,
+			//so func gets a copy of it rather than taking it from under the scope.
+			return [](dp::stop_token token, auto&& thread_func, auto&&... thread_args) {
+				detail::thread_stop_scope scope{ token };
+				if constexpr (std::is_invocable_v<std::decay_t<Func>, dp::stop_token, std::decay_t<Args>...>) {
+					std::invoke(std::move(thread_func), token, std::move(thread_args)...);
+				}
+				else {
+					std::invoke(std::move(thread_func), std::move(thread_args)...);
+				}
+			};
+		}
+
 
 	public:
 		using id = std::thread::id;
 
-		jthread() noexcept : m_thread{}, m_stop{ dp::nostopstate } {}
+		jthread() noexcept : m_thread{}, m_native{}, m_stop{ dp::nostopstate } {}
 		
 		//Not copyable
 		jthread(const jthread&) = delete;
@@ -33,30 +63,26 @@ namespace dp {
 		jthread(jthread&&) noexcept = default;
 		jthread& operator=(jthread&&) noexcept = default;
 
-		template<typename Func, typename... Args>
-		jthread(Func&& func, Args&&... args) : m_thread{}, m_stop{} {
-			//First, ill-formed checks
-			static_assert(std::is_constructible_v<std::decay_t<Func>, Func>, "Invalid function type used to construct jthread");
-			static_assert((std::is_constructible_v<std::decay_t<Args>, Args> && ...), "Invalid argument types used to construct jthread");
-			static_assert(
-				std::is_invocable_v<std::decay_t<Func>, std::decay_t<Args>...> ||
-				std::is_invocable_v<std::decay_t<Func>, dp::stop_token, std::decay_t<Args>...>,
-				"Function passed to jthread is not invocable with provided arguments"
-				);
-
-			//And now to selectively apply the stop_token
-			if constexpr (std::is_invocable_v<std::decay_t<Func>, dp::stop_token, std::decay_t<Args>...>) {
-				m_thread = std::thread{ std::forward<Func>(func), m_stop.get_token(), std::forward<Args>(args)... };
+		template<typename Func, typename... Args, typename = std::enable_if_t<!std::is_same_v<std::decay_t<Func>, dp::thread_attributes>>>
+		jthread(Func&& func, Args&&... args) : m_thread{}, m_native{}, m_stop{} {
+			if (dp::thread_cache::enabled()) {
+				m_native = detail::native_thread{ detail::use_thread_cache, entry_point<Func, Args...>(), m_stop.get_token(), std::forward<Func>(func), std::forward<Args>(args)... };
 			}
 			else {
-				m_thread = std::thread{ std::forward<Func>(func), std::forward<Args>(args)... };
+				m_thread = std::thread{ entry_point<Func, Args...>(), m_stop.get_token(), std::forward<Func>(func), std::forward<Args>(args)... };
 			}
 		}
 
+		//Start the thread with the given stack size, name, affinity and scheduling applied before func runs
+		template<typename Func, typename... Args>
+		jthread(const dp::thread_attributes& attrs, Func&& func, Args&&... args) : m_thread{}, m_native{}, m_stop{} {
+			m_native = detail::native_thread{ attrs, entry_point<Func, Args...>(), m_stop.get_token(), std::forward<Func>(func), std::forward<Args>(args)... };
+		}
+
 		~jthread() {
 			if (joinable()) {
 				m_stop.request_stop();
-				m_thread.join();
+				join();
 			}
 		}
 
@@ -65,6 +91,12 @@ namespace dp {
 
 		static unsigned int hardware_concurrency() noexcept;
 
+		//The number of threads this process can actually run at once, which may be far fewer than hardware_concurrency() inside a container.
+		//Takes into account the CPU affinity mask and any cgroup v1 or v2 CPU quota, and is never less than 1.
+		//Calculated on first use and cached; refresh_concurrency() recalculates it after the affinity or quota has changed.
+		static unsigned int effective_concurrency() noexcept;
+		static unsigned int refresh_concurrency() noexcept;
+
 		void join();
 		void detach();
 		void swap(jthread& other) noexcept;
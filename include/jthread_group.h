@@ -0,0 +1,147 @@
+#ifndef DP_JTHREAD_GROUP
+#define DP_JTHREAD_GROUP
+
+/*
+*	A collection of dp::jthreads which are stopped and joined together.
+*
+*	Destroying a std::vector<dp::jthread> stops and joins each thread in turn, so shutdown takes the sum of every thread's
+*	time to notice its stop. A jthread_group requests a stop on every member before it joins any of them, so shutdown
+*	takes only as long as the slowest. join_until() and join_for() bound the wait and report any threads which have yet to finish.
+*
+*	Members are identified by a member_id handed out by the group rather than by their thread id, since a thread started with attributes or
+*	borrowed from the thread cache only learns its id once it is running, and asking for it would wait on the thread to start.
+*
+*	As with jthread, the group itself is not internally synchronised.
+*/
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "jthread.h"
+#include "futex.h"
+
+namespace dp {
+
+	class jthread_group {
+	public:
+		//Unique within the group, in the order the members were started
+		using member_id = std::size_t;
+
+	private:
+		struct member {
+			member_id m_id;
+			std::atomic<bool> m_finished{ false };
+			dp::jthread m_thread{};
+
+			explicit member(member_id id) noexcept : m_id{ id } {}
+		};
+
+		std::vector<std::unique_ptr<member>> m_members{};
+		member_id m_next_id{ 0 };
+		//The number of members whose function has yet to return. Used as a futex word by the timed joins.
+		std::atomic<std::uint32_t> m_running{ 0 };
+
+		//Marks a member finished when its function returns
+		class finish_guard {
+			member* m_member;
+			std::atomic<std::uint32_t>* m_running;
+		public:
+			finish_guard(member* mem, std::atomic<std::uint32_t>* running) noexcept : m_member{ mem }, m_running{ running } {}
+			finish_guard(const finish_guard&) = delete;
+			finish_guard& operator=(const finish_guard&) = delete;
+			~finish_guard() noexcept {
+				m_member->m_finished.store(true, std::memory_order_release);
+				if (m_running->fetch_sub(1, std::memory_order_acq_rel) == 1) {
+					detail::futex_wake_all(*m_running);
+				}
+			}
+		};
+
+		//Joins and removes every member which has finished, returning the ids of those which have not
+		std::vector<member_id> join_finished();
+
+	public:
+		jthread_group() = default;
+		~jthread_group();
+
+		//Members hold pointers back into the group, so it cannot be moved while they run
+		jthread_group(const jthread_group&) = delete;
+		jthread_group& operator=(const jthread_group&) = delete;
+		jthread_group(jthread_group&&) = delete;
+		jthread_group& operator=(jthread_group&&) = delete;
+
+		//Starts a new member thread and returns its id without waiting for it to start.
+		//As with jthread, func is passed the member's stop_token first if it accepts one.
+		template<typename Func, typename... Args>
+		member_id emplace(Func&& func, Args&&... args) {
+			static_assert(
+				std::is_invocable_v<std::decay_t<Func>, std::decay_t<Args>...> ||
+				std::is_invocable_v<std::decay_t<Func>, dp::stop_token, std::decay_t<Args>...>,
+				"Function passed to jthread_group is not invocable with provided arguments"
+				);
+
+			m_members.push_back(std::make_unique<member>(m_next_id));
+			member* const mem{ m_members.back().get() };
+			m_running.fetch_add(1, std::memory_order_relaxed);
+			try {
+				mem->m_thread = dp::jthread{ [mem, running = &m_running](dp::stop_token token, auto&& thread_func, auto&&... thread_args) {
+					finish_guard guard{ mem, running };
+					if constexpr (std::is_invocable_v<std::decay_t<Func>, dp::stop_token, std::decay_t<Args>...>) {
+						std::invoke(std::move(thread_func), std::move(token), std::move(thread_args)...);
+					}
+					else {
+						std::invoke(std::move(thread_func), std::move(thread_args)...);
+					}
+				}, std::forward<Func>(func), std::forward<Args>(args)... };
+			}
+			catch (...) {
+				m_running.fetch_sub(1, std::memory_order_relaxed);
+				m_members.pop_back();
+				throw;
+			}
+			return m_next_id++;
+		}
+
+		std::size_t size() const noexcept;
+		bool empty() const noexcept;
+
+		//Requests a stop on every member. Returns true if any member had a stop to request.
+		bool request_stop() noexcept;
+
+		//Waits for and joins every member, without requesting a stop
+		void join();
+
+		//Requests a stop on every member and then joins them all
+		void stop_and_join();
+
+		//Waits until every member has finished or end_time is reached, whichever comes first. Members which finished are joined and
+		//removed from the group, and the ids of any stragglers are returned. Stragglers stay in the group, to be joined later or on destruction.
+		template<typename Clock, typename Duration>
+		std::vector<member_id> join_until(const std::chrono::time_point<Clock, Duration>& end_time) {
+			for (std::uint32_t running = m_running.load(std::memory_order_acquire); running != 0; running = m_running.load(std::memory_order_acquire)) {
+				const std::chrono::nanoseconds remaining{ detail::time_until(end_time) };
+				if (remaining == std::chrono::nanoseconds::zero()) {
+					break;
+				}
+				detail::futex_wait_for(m_running, running, remaining);
+			}
+			return join_finished();
+		}
+
+		template<typename Rep, typename Period>
+		std::vector<member_id> join_for(const std::chrono::duration<Rep, Period>& rel_time) {
+			return join_until(std::chrono::steady_clock::now() + rel_time);
+		}
+
+	};
+
+}
+
+#endif
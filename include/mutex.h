@@ -0,0 +1,77 @@
+#ifndef DP_MUTEX
+#define DP_MUTEX
+
+/*
+*	A lightweight mutex built directly on a futex word.
+*
+*	Interchangeable with std::mutex, but because its state is a plain futex word which this library understands,
+*	condition_variable_any can requeue threads waiting on it straight onto the mutex rather than waking them all at once.
+*/
+
+#include <atomic>
+#include <cstdint>
+
+#include "futex.h"
+
+namespace dp {
+
+	class condition_variable_any;
+
+	namespace detail {
+		template<typename Lock>
+		struct requeue_traits;
+	}
+
+	class mutex {
+
+		//0 - unlocked, 1 - locked with no waiters, 2 - locked and there may be threads asleep on the word
+		static constexpr std::uint32_t unlocked{ 0 };
+		static constexpr std::uint32_t locked{ 1 };
+		static constexpr std::uint32_t contended{ 2 };
+
+		std::atomic<std::uint32_t> m_state{ unlocked };
+
+		friend class condition_variable_any;
+		template<typename Lock>
+		friend struct detail::requeue_traits;
+
+		void lock_slow() noexcept;
+
+		//Acquire the lock, always marking it as contended. Used by threads which may have been requeued onto our word from a
+		//condition variable, so that whoever holds the lock after them knows to wake the rest.
+		void lock_contended() noexcept;
+
+		const std::atomic<std::uint32_t>& word() const noexcept {
+			return m_state;
+		}
+
+	public:
+		constexpr mutex() noexcept = default;
+
+		mutex(const mutex&) = delete;
+		mutex& operator=(const mutex&) = delete;
+		mutex(mutex&&) = delete;
+		mutex& operator=(mutex&&) = delete;
+
+		void lock() noexcept {
+			std::uint32_t expected{ unlocked };
+			if (!m_state.compare_exchange_strong(expected, locked, std::memory_order_acquire, std::memory_order_relaxed)) {
+				lock_slow();
+			}
+		}
+
+		[[nodiscard]] bool try_lock() noexcept {
+			std::uint32_t expected{ unlocked };
+			return m_state.compare_exchange_strong(expected, locked, std::memory_order_acquire, std::memory_order_relaxed);
+		}
+
+		void unlock() noexcept {
+			if (m_state.exchange(unlocked, std::memory_order_release) == contended) {
+				detail::futex_wake_one(m_state);
+			}
+		}
+	};
+
+}
+
+#endif
@@ -0,0 +1,423 @@
+#ifndef DP_PARALLEL
+#define DP_PARALLEL
+
+/*
+*	Cancellable parallel versions of for_each, transform, reduce, find_if and any_of over random access ranges.
+*
+*	The range is cut into chunks which are handed out in order to a set of workers, with the calling thread working alongside them.
+*	The workers are tasks on the executor given, such as a dp::thread_pool, or without one on a dp::thread_pool shared by every call,
+*	so a call starts no threads of its own. The stop token is checked only between chunks, so each worker starts with a chunk of one
+*	element and doubles or halves it to keep chunks near chunk_time, capped so that every worker sees several.
+*	A stop on the token passed in, or an exception from any element, stops every worker at its next chunk boundary; the exception is rethrown,
+*	and a stop which left the range unfinished is reported as std::errc::operation_canceled. find_if and any_of stop handing out chunks
+*	beyond the first match, so the search ends early on every worker.
+*
+*	As with the standard parallel algorithms, the functions given may be called concurrently and reduce's operation must be associative and
+*	commutative. Every worker is waited for before returning. While it waits, the calling thread runs queued work on any executor which offers
+*	help_until(), as dp::thread_pool does, so these may be called from that executor's own tasks and nested inside one another.
+*	On an executor without it, doing so can deadlock if every one of its threads does the same.
+*/
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <exception>
+#include <functional>
+#include <iterator>
+#include <optional>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "future.h"
+#include "jthread.h"
+#include "stop_token.h"
+#include "task_group.h"
+#include "this_thread.h"
+#include "thread_pool.h"
+
+namespace dp {
+
+	namespace detail {
+
+		[[noreturn]] void throw_parallel_cancelled();
+
+		//Used by the overloads which are not given an executor. Started on first use, with one thread fewer than there are usable CPUs,
+		//as the calling thread makes up the difference.
+		dp::thread_pool& parallel_pool();
+
+		//The overloads which are not given a token use one without a stop state, which costs no allocation and can never be stopped
+		inline dp::stop_token no_stop_token() noexcept {
+			return make_stop_token(nullptr);
+		}
+
+		class parallel_cursor {
+			std::atomic<std::size_t> m_next{ 0 };
+			//Lowered by a match; chunks starting at or beyond it are never handed out
+			std::atomic<std::size_t> m_limit;
+			std::atomic<bool> m_abandoned{ false };
+			std::size_t m_count;
+			std::size_t m_max_chunk;
+			std::size_t m_workers;
+
+		public:
+			static constexpr std::chrono::microseconds chunk_time{ 50 };
+			static constexpr std::size_t chunks_per_worker{ 8 };
+
+			explicit parallel_cursor(std::size_t count) noexcept : m_limit{ count }, m_count{ count } {
+				const std::size_t threads{ std::max<std::size_t>(dp::jthread::effective_concurrency(), 1) };
+				m_max_chunk = std::max<std::size_t>(count / (threads * chunks_per_worker), 1);
+				m_workers = std::clamp<std::size_t>(count, 1, threads);
+			}
+
+			std::size_t count() const noexcept {
+				return m_count;
+			}
+
+			std::size_t workers() const noexcept {
+				return m_workers;
+			}
+
+			bool claim(const stop_flag& stop, std::size_t chunk, std::size_t& begin, std::size_t& end) noexcept {
+				begin = m_next.fetch_add(chunk, std::memory_order_relaxed);
+				const std::size_t limit{ m_limit.load(std::memory_order_acquire) };
+				if (begin >= limit) {
+					return false;
+				}
+				if (stop.stop_requested()) {
+					m_abandoned.store(true, std::memory_order_relaxed);
+					return false;
+				}
+				end = std::min(begin + chunk, limit);
+				return true;
+			}
+
+			std::size_t next_chunk(std::size_t chunk, std::chrono::steady_clock::duration took) const noexcept {
+				if (took < chunk_time / 2) {
+					return std::min(chunk * 2, m_max_chunk);
+				}
+				if (took > chunk_time * 2) {
+					return std::max<std::size_t>(chunk / 2, 1);
+				}
+				return chunk;
+			}
+
+			void lower_limit(std::size_t limit) noexcept {
+				std::size_t current{ m_limit.load(std::memory_order_relaxed) };
+				while (limit < current && !m_limit.compare_exchange_weak(current, limit, std::memory_order_acq_rel, std::memory_order_relaxed)) {}
+			}
+
+			std::size_t limit() const noexcept {
+				return m_limit.load(std::memory_order_acquire);
+			}
+
+			//Only meaningful once every worker has finished
+			bool abandoned() const noexcept {
+				return m_abandoned.load(std::memory_order_relaxed);
+			}
+		};
+
+		template<typename Executor, typename Done, typename = void>
+		struct can_help : std::false_type {};
+		template<typename Executor, typename Done>
+		struct can_help<Executor, Done, std::void_t<decltype(std::declval<Executor&>().help_until(std::declval<Done>()))>> : std::true_type {};
+
+		template<typename Executor>
+		struct executor_launch {
+			Executor* m_executor;
+			template<typename Func>
+			void operator()(dp::task_group& group, Func&& func) const {
+				group.spawn(*m_executor, std::forward<Func>(func));
+			}
+
+			template<typename Done>
+			void help_until(Done done) const {
+				if constexpr (can_help<Executor, Done>::value) {
+					m_executor->help_until(done);
+				}
+			}
+		};
+
+		//Looks the pool up only when a worker is launched, so that it is never started on a machine with a single usable CPU
+		struct shared_pool_launch {
+			template<typename Func>
+			void operator()(dp::task_group& group, Func&& func) const {
+				group.spawn(parallel_pool(), std::forward<Func>(func));
+			}
+
+			template<typename Done>
+			void help_until(Done done) const {
+				parallel_pool().help_until(done);
+			}
+		};
+
+		//Counts a worker as finished however it leaves
+		struct worker_exit {
+			std::atomic<std::size_t>& m_finished;
+			~worker_exit() {
+				m_finished.fetch_add(1, std::memory_order_release);
+			}
+		};
+
+		template<typename Body>
+		void parallel_worker(parallel_cursor& cursor, const stop_flag& stop, Body& body, std::size_t worker) {
+			std::size_t chunk{ 1 };
+			std::size_t begin{};
+			std::size_t end{};
+			while (cursor.claim(stop, chunk, begin, end)) {
+				const auto start{ std::chrono::steady_clock::now() };
+				body(worker, begin, end);
+				chunk = cursor.next_chunk(chunk, std::chrono::steady_clock::now() - start);
+			}
+		}
+
+		//body(worker, begin, end) is called for each chunk, where worker is a dense index below cursor.workers()
+		//An exception from the calling thread's share is rethrown in preference to one from a worker
+		template<typename Launch, typename Body>
+		void run_parallel(Launch launch, const dp::stop_token& token, parallel_cursor& cursor, Body body) {
+			dp::task_group group{ token };
+			const dp::stop_token group_token{ group.get_stop_token() };
+			const stop_flag stop{ group_token };
+			std::atomic<std::size_t> finished{ 0 };
+			const std::size_t helpers{ cursor.workers() - 1 };
+			for (std::size_t worker = 1; worker <= helpers; ++worker) {
+				launch(group, [&cursor, &body, &finished, stop, worker] {
+					const worker_exit exit{ finished };
+					parallel_worker(cursor, stop, body, worker);
+					});
+			}
+			std::exception_ptr caller_error{};
+			{
+				thread_stop_scope scope{ group_token };
+				try {
+					parallel_worker(cursor, stop, body, 0);
+				}
+				catch (...) {
+					caller_error = std::current_exception();
+					group.request_stop();
+				}
+			}
+			//Workers still queued on an executor whose threads are all waiting in here would never run, so we run them ourselves
+			if (helpers > 0) {
+				launch.help_until([&finished, helpers] { return finished.load(std::memory_order_acquire) == helpers; });
+			}
+			if (caller_error) {
+				try {
+					group.wait();
+				}
+				catch (...) {}
+				std::rethrow_exception(caller_error);
+			}
+			group.wait();
+			if (cursor.abandoned()) {
+				throw_parallel_cancelled();
+			}
+		}
+
+		template<typename It>
+		It advance_by(It it, std::size_t n) {
+			return it + static_cast<typename std::iterator_traits<It>::difference_type>(n);
+		}
+
+		template<typename It>
+		constexpr void check_random_access() {
+			static_assert(std::is_base_of_v<std::random_access_iterator_tag, typename std::iterator_traits<It>::iterator_category>,
+				"Parallel algorithms require random access iterators");
+		}
+
+		template<typename Launch, typename It, typename Func>
+		void parallel_for_each(Launch launch, const dp::stop_token& token, It first, It last, Func& func) {
+			check_random_access<It>();
+			parallel_cursor cursor{ static_cast<std::size_t>(last - first) };
+			run_parallel(launch, token, cursor, [first, &func](std::size_t, std::size_t begin, std::size_t end) {
+				for (It it = advance_by(first, begin), stop = advance_by(first, end); it != stop; ++it) {
+					std::invoke(func, *it);
+				}
+				});
+		}
+
+		template<typename Launch, typename InIt, typename OutIt, typename Func>
+		OutIt parallel_transform(Launch launch, const dp::stop_token& token, InIt first, InIt last, OutIt d_first, Func& func) {
+			check_random_access<InIt>();
+			check_random_access<OutIt>();
+			parallel_cursor cursor{ static_cast<std::size_t>(last - first) };
+			run_parallel(launch, token, cursor, [first, d_first, &func](std::size_t, std::size_t begin, std::size_t end) {
+				OutIt out{ advance_by(d_first, begin) };
+				for (InIt it = advance_by(first, begin), stop = advance_by(first, end); it != stop; ++it, ++out) {
+					*out = std::invoke(func, *it);
+				}
+				});
+			return advance_by(d_first, cursor.count());
+		}
+
+		//Each worker folds its chunks into a partial of its own, and the partials are folded into init once every worker is done
+		template<typename Launch, typename It, typename T, typename Op>
+		T parallel_reduce(Launch launch, const dp::stop_token& token, It first, It last, T init, Op& op) {
+			check_random_access<It>();
+			parallel_cursor cursor{ static_cast<std::size_t>(last - first) };
+			std::vector<std::optional<T>> partials(cursor.workers());
+			run_parallel(launch, token, cursor, [first, &op, &partials](std::size_t worker, std::size_t begin, std::size_t end) {
+				It it{ advance_by(first, begin) };
+				const It stop{ advance_by(first, end) };
+				T acc(*it);
+				for (++it; it != stop; ++it) {
+					acc = std::invoke(op, std::move(acc), *it);
+				}
+				std::optional<T>& partial{ partials[worker] };
+				if (partial) {
+					*partial = std::invoke(op, std::move(*partial), std::move(acc));
+				}
+				else {
+					partial.emplace(std::move(acc));
+				}
+				});
+			for (std::optional<T>& partial : partials) {
+				if (partial) {
+					init = std::invoke(op, std::move(init), std::move(*partial));
+				}
+			}
+			return init;
+		}
+
+		//Chunks are handed out in order, so once a match lowers the limit only chunks before it are still searched
+		template<typename Launch, typename It, typename Pred>
+		It parallel_find_if(Launch launch, const dp::stop_token& token, It first, It last, Pred& pred) {
+			check_random_access<It>();
+			parallel_cursor cursor{ static_cast<std::size_t>(last - first) };
+			run_parallel(launch, token, cursor, [first, &pred, &cursor](std::size_t, std::size_t begin, std::size_t end) {
+				It it{ advance_by(first, begin) };
+				for (std::size_t i = begin; i < end; ++i, ++it) {
+					if (std::invoke(pred, *it)) {
+						cursor.lower_limit(i);
+						return;
+					}
+				}
+				});
+			return cursor.limit() < cursor.count() ? advance_by(first, cursor.limit()) : last;
+		}
+
+		template<typename Launch, typename It, typename Pred>
+		bool parallel_any_of(Launch launch, const dp::stop_token& token, It first, It last, Pred& pred) {
+			check_random_access<It>();
+			parallel_cursor cursor{ static_cast<std::size_t>(last - first) };
+			run_parallel(launch, token, cursor, [first, &pred, &cursor](std::size_t, std::size_t begin, std::size_t end) {
+				for (It it = advance_by(first, begin), stop = advance_by(first, end); it != stop; ++it) {
+					if (std::invoke(pred, *it)) {
+						cursor.lower_limit(0);
+						return;
+					}
+				}
+				});
+			return cursor.limit() < cursor.count();
+		}
+
+	}
+
+	namespace parallel {
+
+		template<typename It, typename Func>
+		void for_each(It first, It last, Func func) {
+			detail::parallel_for_each(detail::shared_pool_launch{}, detail::no_stop_token(), first, last, func);
+		}
+
+		template<typename It, typename Func>
+		void for_each(const dp::stop_token& token, It first, It last, Func func) {
+			detail::parallel_for_each(detail::shared_pool_launch{}, token, first, last, func);
+		}
+
+		template<typename Executor, typename It, typename Func, std::enable_if_t<detail::is_executor<Executor>::value, int> = 0>
+		void for_each(Executor& executor, It first, It last, Func func) {
+			detail::parallel_for_each(detail::executor_launch<Executor>{ &executor }, detail::no_stop_token(), first, last, func);
+		}
+
+		template<typename Executor, typename It, typename Func, std::enable_if_t<detail::is_executor<Executor>::value, int> = 0>
+		void for_each(Executor& executor, const dp::stop_token& token, It first, It last, Func func) {
+			detail::parallel_for_each(detail::executor_launch<Executor>{ &executor }, token, first, last, func);
+		}
+
+		template<typename InIt, typename OutIt, typename Func>
+		OutIt transform(InIt first, InIt last, OutIt d_first, Func func) {
+			return detail::parallel_transform(detail::shared_pool_launch{}, detail::no_stop_token(), first, last, d_first, func);
+		}
+
+		template<typename InIt, typename OutIt, typename Func>
+		OutIt transform(const dp::stop_token& token, InIt first, InIt last, OutIt d_first, Func func) {
+			return detail::parallel_transform(detail::shared_pool_launch{}, token, first, last, d_first, func);
+		}
+
+		template<typename Executor, typename InIt, typename OutIt, typename Func, std::enable_if_t<detail::is_executor<Executor>::value, int> = 0>
+		OutIt transform(Executor& executor, InIt first, InIt last, OutIt d_first, Func func) {
+			return detail::parallel_transform(detail::executor_launch<Executor>{ &executor }, detail::no_stop_token(), first, last, d_first, func);
+		}
+
+		template<typename Executor, typename InIt, typename OutIt, typename Func, std::enable_if_t<detail::is_executor<Executor>::value, int> = 0>
+		OutIt transform(Executor& executor, const dp::stop_token& token, InIt first, InIt last, OutIt d_first, Func func) {
+			return detail::parallel_transform(detail::executor_launch<Executor>{ &executor }, token, first, last, d_first, func);
+		}
+
+		template<typename It, typename T, typename Op = std::plus<>>
+		T reduce(It first, It last, T init, Op op = {}) {
+			return detail::parallel_reduce(detail::shared_pool_launch{}, detail::no_stop_token(), first, last, std::move(init), op);
+		}
+
+		template<typename It, typename T, typename Op = std::plus<>>
+		T reduce(const dp::stop_token& token, It first, It last, T init, Op op = {}) {
+			return detail::parallel_reduce(detail::shared_pool_launch{}, token, first, last, std::move(init), op);
+		}
+
+		template<typename Executor, typename It, typename T, typename Op = std::plus<>, std::enable_if_t<detail::is_executor<Executor>::value, int> = 0>
+		T reduce(Executor& executor, It first, It last, T init, Op op = {}) {
+			return detail::parallel_reduce(detail::executor_launch<Executor>{ &executor }, detail::no_stop_token(), first, last, std::move(init), op);
+		}
+
+		template<typename Executor, typename It, typename T, typename Op = std::plus<>, std::enable_if_t<detail::is_executor<Executor>::value, int> = 0>
+		T reduce(Executor& executor, const dp::stop_token& token, It first, It last, T init, Op op = {}) {
+			return detail::parallel_reduce(detail::executor_launch<Executor>{ &executor }, token, first, last, std::move(init), op);
+		}
+
+		template<typename It, typename Pred>
+		It find_if(It first, It last, Pred pred) {
+			return detail::parallel_find_if(detail::shared_pool_launch{}, detail::no_stop_token(), first, last, pred);
+		}
+
+		template<typename It, typename Pred>
+		It find_if(const dp::stop_token& token, It first, It last, Pred pred) {
+			return detail::parallel_find_if(detail::shared_pool_launch{}, token, first, last, pred);
+		}
+
+		template<typename Executor, typename It, typename Pred, std::enable_if_t<detail::is_executor<Executor>::value, int> = 0>
+		It find_if(Executor& executor, It first, It last, Pred pred) {
+			return detail::parallel_find_if(detail::executor_launch<Executor>{ &executor }, detail::no_stop_token(), first, last, pred);
+		}
+
+		template<typename Executor, typename It, typename Pred, std::enable_if_t<detail::is_executor<Executor>::value, int> = 0>
+		It find_if(Executor& executor, const dp::stop_token& token, It first, It last, Pred pred) {
+			return detail::parallel_find_if(detail::executor_launch<Executor>{ &executor }, token, first, last, pred);
+		}
+
+		template<typename It, typename Pred>
+		bool any_of(It first, It last, Pred pred) {
+			return detail::parallel_any_of(detail::shared_pool_launch{}, detail::no_stop_token(), first, last, pred);
+		}
+
+		template<typename It, typename Pred>
+		bool any_of(const dp::stop_token& token, It first, It last, Pred pred) {
+			return detail::parallel_any_of(detail::shared_pool_launch{}, token, first, last, pred);
+		}
+
+		template<typename Executor, typename It, typename Pred, std::enable_if_t<detail::is_executor<Executor>::value, int> = 0>
+		bool any_of(Executor& executor, It first, It last, Pred pred) {
+			return detail::parallel_any_of(detail::executor_launch<Executor>{ &executor }, detail::no_stop_token(), first, last, pred);
+		}
+
+		template<typename Executor, typename It, typename Pred, std::enable_if_t<detail::is_executor<Executor>::value, int> = 0>
+		bool any_of(Executor& executor, const dp::stop_token& token, It first, It last, Pred pred) {
+			return detail::parallel_any_of(detail::executor_launch<Executor>{ &executor }, token, first, last, pred);
+		}
+
+	}
+
+}
+
+#endif
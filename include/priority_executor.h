@@ -0,0 +1,106 @@
+#ifndef DP_PRIORITY_EXECUTOR
+#define DP_PRIORITY_EXECUTOR
+
+/*
+*	A pool of dp::jthreads serving several priority lanes, so that latency-sensitive work can overtake bulk work queued ahead of it.
+*
+*	Lane 0 is the highest priority. Under the strict policy a worker always takes from the highest priority lane with anything in it.
+*	Under the weighted policy lanes are served in proportion to their weights (smooth weighted round robin), so that low priority
+*	lanes still make progress under sustained high priority load.
+*
+*	A task submitted with a stop_token whose stop has been requested by the time it is dequeued is discarded without running.
+*	The check is a single load of the stop flag, which the task keeps alive. Discarded tasks are counted by discarded().
+*	Otherwise tasks follow the same rules as those on dp::thread_pool: they may take a dp::stop_token, stopping the executor discards
+*	any which have not started, and they must not throw.
+*/
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "condition_variable.h"
+#include "jthread.h"
+#include "mutex.h"
+#include "stop_token.h"
+#include "thread_pool.h"
+
+namespace dp {
+
+	class priority_executor {
+	public:
+		enum class lane_policy {
+			strict,		//Always serve the highest priority non-empty lane
+			weighted	//Serve non-empty lanes in proportion to their weights
+		};
+
+		struct options {
+			lane_policy policy{ lane_policy::strict };
+			//One entry per lane, highest priority first. Under the strict policy only the number of entries matters.
+			std::vector<unsigned int> weights{ 1, 1 };
+			std::size_t threads{ dp::jthread::effective_concurrency() };
+		};
+
+	private:
+		struct lane {
+			std::deque<detail::pool_task*> m_tasks{};
+			long long m_weight{ 1 };
+			long long m_current{ 0 };
+		};
+
+		lane_policy m_policy;
+		dp::stop_source m_stop{};
+
+		mutable dp::mutex m_mut{};
+		dp::condition_variable_any m_cv{};
+		std::vector<lane> m_lanes{};
+		std::size_t m_queued{ 0 };
+		std::atomic<std::uint64_t> m_discarded{ 0 };
+
+		//Declared last so that the threads are joined before anything they use is destroyed
+		std::vector<dp::jthread> m_threads{};
+
+		void enqueue(std::size_t lane_index, detail::pool_task* task);
+		detail::pool_task* pop_next() noexcept;
+		void run();
+
+	public:
+		priority_executor();
+		explicit priority_executor(options opts);
+		~priority_executor();
+
+		priority_executor(const priority_executor&) = delete;
+		priority_executor& operator=(const priority_executor&) = delete;
+		priority_executor(priority_executor&&) = delete;
+		priority_executor& operator=(priority_executor&&) = delete;
+
+		//Throws std::system_error if lane is out of range
+		template<typename Func>
+		void submit(std::size_t lane, Func&& func) {
+			static_assert(std::is_invocable_v<std::decay_t<Func>&> || std::is_invocable_v<std::decay_t<Func>&, dp::stop_token>,
+				"Function passed to priority_executor must be invocable with no arguments or a stop_token");
+			enqueue(lane, new detail::pool_task_impl<std::decay_t<Func>>{ std::forward<Func>(func) });
+		}
+
+		template<typename Func>
+		void submit(std::size_t lane, dp::stop_token token, Func&& func) {
+			static_assert(std::is_invocable_v<std::decay_t<Func>&> || std::is_invocable_v<std::decay_t<Func>&, dp::stop_token>,
+				"Function passed to priority_executor must be invocable with no arguments or a stop_token");
+			enqueue(lane, new detail::pool_task_with_token<std::decay_t<Func>>{ std::move(token), std::forward<Func>(func) });
+		}
+
+		std::size_t lanes() const noexcept;
+		std::size_t size() const noexcept;
+		std::size_t queued() const;
+		std::uint64_t discarded() const noexcept;
+
+		bool request_stop() noexcept;
+		dp::stop_token get_stop_token() const noexcept;
+	};
+
+}
+
+#endif
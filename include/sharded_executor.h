@@ -0,0 +1,122 @@
+#ifndef DP_SHARDED_EXECUTOR
+#define DP_SHARDED_EXECUTOR
+
+/*
+*	A thread-per-core executor for share-nothing designs: one dp::jthread pinned to each of a set of CPUs, each with an inbox of its own.
+*
+*	Work only runs on the shard it was submitted to, so there is no stealing and no queue shared between shards. State owned by a shard
+*	can be touched by its tasks without any synchronisation, so long as nothing outside the shard touches it too.
+*	Each inbox is an intrusive multi-producer single-consumer queue, so a submission costs one allocation and one atomic exchange,
+*	and only wakes the shard's thread if it had gone to sleep.
+*
+*	Tasks follow the same rules as those on dp::thread_pool. They may take a dp::stop_token, and are given the executor's token or the one they
+*	were submitted with. Stopping the executor stops every shard at once, discarding any tasks which have not started. Tasks must not throw.
+*/
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "stop_token.h"
+#include "jthread.h"
+#include "thread_pool.h"
+#include "topology.h"
+
+namespace dp {
+
+	namespace detail {
+
+		struct shard_task : pool_task {
+			std::atomic<shard_task*> m_next{ nullptr };
+		};
+
+		//Vyukov's intrusive MPSC queue. Pushing is wait-free; popping may return nullptr while a push is half-done, in which case the pusher
+		//is about to wake the consumer anyway.
+		class mpsc_inbox {
+			struct stub_task : shard_task {
+				void run(const dp::stop_token&) override {}
+			};
+
+			alignas(64) std::atomic<shard_task*> m_tail;
+			alignas(64) shard_task* m_head;
+			stub_task m_stub{};
+
+		public:
+			mpsc_inbox() noexcept;
+			~mpsc_inbox();
+
+			mpsc_inbox(const mpsc_inbox&) = delete;
+			mpsc_inbox& operator=(const mpsc_inbox&) = delete;
+
+			//Any thread
+			void push(shard_task* task) noexcept;
+
+			//Consumer only
+			shard_task* pop() noexcept;
+		};
+
+	}
+
+	class sharded_executor {
+		struct alignas(64) shard {
+			detail::mpsc_inbox m_inbox{};
+			//Set while the shard's thread is asleep, or about to be
+			alignas(64) std::atomic<std::uint32_t> m_sleeping{ 0 };
+			unsigned int m_cpu{ 0 };
+		};
+
+		dp::stop_source m_stop{};
+		std::vector<std::unique_ptr<shard>> m_shards{};
+
+		//Declared last so that the threads are joined before anything they use is destroyed
+		std::vector<dp::jthread> m_threads{};
+
+		void enqueue(std::size_t index, detail::shard_task* task);
+		void wake(shard& target) noexcept;
+		void run(std::size_t index);
+
+	public:
+		//One shard pinned to each CPU in the list. The default is one CPU from each physical core the process may use.
+		explicit sharded_executor(std::vector<unsigned int> cpus = dp::topology::system().one_per_core());
+		~sharded_executor();
+
+		sharded_executor(const sharded_executor&) = delete;
+		sharded_executor& operator=(const sharded_executor&) = delete;
+		sharded_executor(sharded_executor&&) = delete;
+		sharded_executor& operator=(sharded_executor&&) = delete;
+
+		//Throws std::system_error if shard is out of range
+		template<typename Func>
+		void submit_to(std::size_t shard, Func&& func) {
+			static_assert(std::is_invocable_v<std::decay_t<Func>&> || std::is_invocable_v<std::decay_t<Func>&, dp::stop_token>,
+				"Function passed to sharded_executor must be invocable with no arguments or a stop_token");
+			enqueue(shard, new detail::pool_task_impl<std::decay_t<Func>, detail::shard_task>{ std::forward<Func>(func) });
+		}
+
+		template<typename Func>
+		void submit_to(std::size_t shard, dp::stop_token token, Func&& func) {
+			static_assert(std::is_invocable_v<std::decay_t<Func>&> || std::is_invocable_v<std::decay_t<Func>&, dp::stop_token>,
+				"Function passed to sharded_executor must be invocable with no arguments or a stop_token");
+			enqueue(shard, new detail::pool_task_with_token<std::decay_t<Func>, detail::shard_task>{ std::move(token), std::forward<Func>(func) });
+		}
+
+		std::size_t size() const noexcept;
+
+		//The CPU the given shard's thread is pinned to
+		unsigned int cpu_of(std::size_t shard) const;
+
+		//The index of the shard the calling thread runs, if it is one of this executor's threads
+		std::optional<std::size_t> current_shard() const noexcept;
+
+		bool request_stop() noexcept;
+		dp::stop_token get_stop_token() const noexcept;
+	};
+
+}
+
+#endif
@@ -0,0 +1,93 @@
+#ifndef DP_STACK_PROVIDER
+#define DP_STACK_PROVIDER
+
+/*
+*	Sources of memory for thread stacks, for use with dp::thread_attributes::set_stack_provider().
+*
+*	By default every thread gets a fresh 8MiB (on most Linux systems) stack from the C library. With thousands of threads that
+*	wastes resident memory and TLB entries. A stack provider lets those stacks be smaller, backed by huge pages, placed on a given
+*	NUMA node, or drawn from a pool of stacks which are reused rather than mapped afresh for each thread.
+*
+*	A stack is only handed back to its provider once the thread which ran on it has been joined. Custom stacks are only used where
+*	threads are created with pthreads (Linux and macOS); elsewhere the provider is ignored.
+*/
+
+#include <cstddef>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <vector>
+
+namespace dp {
+
+	//The usable part of a stack, not including any guard pages. base is the lowest address.
+	struct thread_stack {
+		void* base{ nullptr };
+		std::size_t size{ 0 };
+	};
+
+	class stack_provider {
+	public:
+		virtual ~stack_provider() = default;
+
+		//Throws std::system_error or std::bad_alloc if no stack can be provided
+		virtual thread_stack allocate() = 0;
+		virtual void deallocate(thread_stack stack) noexcept = 0;
+	};
+
+	enum class stack_pages {
+		normal,
+		transparent_huge,	//Ask the kernel to back the stack with transparent huge pages (madvise(MADV_HUGEPAGE))
+		huge				//Map the stack from the explicit huge page pool (MAP_HUGETLB), falling back to transparent huge pages if the pool is empty
+	};
+
+	struct stack_options {
+		//Rounded up to a whole number of pages, or huge pages if they are in use
+		std::size_t size{ 256 * 1024 };
+		//An inaccessible region below the stack which turns an overflow into a crash rather than silent corruption. Rounded up to a whole number of pages.
+		std::size_t guard_size{ 4096 };
+		stack_pages pages{ stack_pages::normal };
+		//If set, the stack's memory is preferentially allocated on this NUMA node. Linux only.
+		std::optional<unsigned int> numa_node{};
+	};
+
+	//Maps each stack directly with mmap
+	class mmap_stack_provider : public stack_provider {
+		stack_options m_options;
+		std::size_t m_page_size;
+
+	public:
+		explicit mmap_stack_provider(stack_options options = {});
+
+		thread_stack allocate() override;
+		void deallocate(thread_stack stack) noexcept override;
+
+		const stack_options& options() const noexcept;
+	};
+
+	//Keeps stacks which are handed back for reuse instead of returning them to the upstream provider.
+	//Stacks may be preallocated up front, so that starting a thread never has to map memory.
+	class stack_pool : public stack_provider {
+		std::shared_ptr<stack_provider> m_upstream;
+		std::mutex m_mut{};
+		std::vector<thread_stack> m_free{};
+		std::size_t m_max_free;
+
+	public:
+		explicit stack_pool(std::shared_ptr<stack_provider> upstream, std::size_t preallocate = 0, std::size_t max_free = std::numeric_limits<std::size_t>::max());
+		~stack_pool() override;
+
+		stack_pool(const stack_pool&) = delete;
+		stack_pool& operator=(const stack_pool&) = delete;
+
+		thread_stack allocate() override;
+		void deallocate(thread_stack stack) noexcept override;
+
+		//The number of stacks currently waiting to be reused
+		std::size_t available();
+	};
+
+}
+
+#endif
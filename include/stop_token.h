@@ -2,11 +2,11 @@
 #define DP_STOP_SOURCE
 
 #include <atomic>
+#include <cstdint>
 #include <memory>
 #include <mutex>
-#include <list>
+#include <thread>
 #include <functional>
-#include <optional>
 
 #include "lock_free_shared_ptr.h"
 
@@ -21,10 +21,44 @@
 
 namespace dp{
 
-     template<typename Callback>
-     class stop_callback;
+    class stop_token;
 
     namespace detail {
+
+        class stop_state;
+        class thread_stop_scope;
+        class stop_flag;
+
+        //For owners which embed a stop_state in a larger allocation and hand out tokens through an aliasing shared_ptr
+        stop_token make_stop_token(std::shared_ptr<stop_state> state) noexcept;
+
+        //Anything which wants to run when a stop is requested derives from this node and is linked intrusively into the stop state.
+        //The node is owned by whoever registers it (usually living on their stack), so registering a callback never allocates.
+        class stop_callback_node {
+            friend class stop_state;
+
+            using invoke_fn = void(*)(stop_callback_node*) noexcept;
+
+            invoke_fn m_invoke;
+            stop_callback_node* m_prev{ nullptr };
+            stop_callback_node* m_next{ nullptr };
+
+            //Set by the thread executing this callback once it has returned, so that a deregistration on another thread knows when it may leave.
+            std::atomic<std::uint32_t> m_done{ 0 };
+            //Points into the executing thread's stack while the callback runs, so a callback which destroys its own node can say so.
+            bool* m_destroyed{ nullptr };
+
+        protected:
+            explicit stop_callback_node(invoke_fn invoke) noexcept : m_invoke{ invoke } {}
+            ~stop_callback_node() = default;
+
+        public:
+            stop_callback_node(const stop_callback_node&) = delete;
+            stop_callback_node& operator=(const stop_callback_node&) = delete;
+            stop_callback_node(stop_callback_node&&) = delete;
+            stop_callback_node& operator=(stop_callback_node&&) = delete;
+        };
+
         //NB: All operations on this class must either be
         //protected or atomic. Concurrent access per-instance may occur
         class stop_state {
@@ -35,48 +69,15 @@ namespace dp{
 
             //Callbacks would be lock-free in an ideal world, however contention here should be lower than querying stop state
             //For now at least, we use a traditional lock to prevent a whole family of possible races and errors from occurring.
-            class callback_state {
-                std::size_t m_id;
-                std::function<void()> m_callable;
-
-            public:
-                //In principle, the only users of this class should already have asserted that Func is callable with the right signature
-                //So constraining it here is extra work for minimal gain
-                template<typename Func>
-                callback_state(std::size_t id, Func&& func) : m_id{ id }, m_callable{ std::forward<Func>(func) } {}
-
-                inline void operator()() const {
-                    std::invoke(m_callable);
-                }
-
-                inline std::size_t id() const {
-                    return m_id;
-                }
-            };
-
-
-            //Callback state variables
-            std::size_t m_current_callback_id{ 0 };
+            //The lock is never held while a callback runs, so callbacks are free to register or deregister other callbacks.
             std::mutex m_mut{};
-            std::list<callback_state> m_callbacks{};
-
-            template<typename Callback>
-            friend class dp::stop_callback;
-
-            //A note to users - these functions are private for a reason and unprotected for a reason.
-            //The way that we prevent races when registering and deregistering a callback is via double-checked locking.
-            //As such, the callback functions which are using these functions must already hold the lock to protect the list.
-            //So we can't also acquire the lock here otherwise it's deadlock
-            template<typename Func>
-            std::size_t register_callback(Func&& func) {
-                auto this_id{ m_current_callback_id++ };
-                m_callbacks.emplace_back(this_id, std::forward<Func>(func));
-                return this_id;
-            }
+            stop_callback_node* m_head{ nullptr };
+            stop_callback_node* m_executing{ nullptr };
+            std::thread::id m_executing_thread{};
 
-            void deregister_callback(std::size_t id);
+            void unlink(stop_callback_node* node) noexcept;
 
-            void execute_callbacks();           
+            void execute_callbacks(std::unique_lock<std::mutex>& lck) noexcept;
 
 
         public:
@@ -84,12 +85,22 @@ namespace dp{
                 return m_stop_requested.load(std::memory_order_acquire);
             }
             inline void request_stop() noexcept {
-                m_stop_requested.store(true, std::memory_order_release);
+                //Sequentially consistent so that waiters which fence before checking the flag can't miss both it and our callbacks
+                if (m_stop_requested.exchange(true, std::memory_order_seq_cst)) {
+                    return;
+                }
 
-                auto lck{ std::lock_guard{m_mut} };
-                execute_callbacks();
+                auto lck{ std::unique_lock{m_mut} };
+                execute_callbacks(lck);
             }
 
+            //Links node into the list of callbacks to run. If a stop has already been requested the node is not linked
+            //and false is returned, in which case the caller is responsible for invoking its callback.
+            bool register_callback(stop_callback_node* node) noexcept;
+
+            //Unlinks a node previously registered. If its callback is currently running on another thread, blocks until it has returned.
+            void deregister_callback(stop_callback_node* node) noexcept;
+
         };
 
     }
@@ -101,8 +112,13 @@ namespace dp{
         friend class stop_source;
         template<typename Callback>
         friend class stop_callback;
+        friend class condition_variable_any;
+        friend class detail::thread_stop_scope;
+        friend class detail::stop_flag;
+        friend stop_token detail::make_stop_token(std::shared_ptr<detail::stop_state> state) noexcept;
         
         explicit stop_token(std::nullptr_t) noexcept : m_state{nullptr} {}
+        explicit stop_token(std::shared_ptr<detail::stop_state> state) noexcept : m_state{std::move(state)} {}
 
         public:
         stop_token() : m_state{std::make_shared<detail::stop_state>()} {}
@@ -175,42 +191,35 @@ namespace dp{
 
     };
 
+    //As with std::stop_callback, a callback given a token with no stop state is never invoked, as no stop can ever be requested on it.
+    //Note that earlier versions of this library invoked such a callback immediately on construction.
     template<typename Callback>
-    class stop_callback {
+    class stop_callback : private detail::stop_callback_node {
 
         static_assert(std::is_invocable_v<Callback>, "Callback given to stop_callback is not invocable with no parameters");
         static_assert(std::is_destructible_v<Callback>, "Callback given to stop_callback is not destructible");
 
-        dp::stop_token m_token;
-        std::optional<std::size_t> m_callback_id;
-        
+        std::shared_ptr<detail::stop_state> m_state;
+        Callback m_callback;
+        bool m_registered;
+
+        static void invoke(detail::stop_callback_node* node) noexcept {
+            std::invoke(static_cast<stop_callback*>(node)->m_callback);
+        }
 
         //DRY from our near-duplicate constructors
-        template<typename C>
-        std::optional<std::size_t> register_or_invoke(C&& function) {
-            static_assert(std::is_constructible_v<Callback, C>, "Callback is not constructible from provided argument types");
-            //We check if the token holds a null ptr. Note that if it doesn't here it can't be changed to do so later so we don't need to manage that manually here
-            if (!m_token.stop_possible()) {
-                std::invoke(std::forward<C>(function));
-                return std::nullopt;
-            }
-            //We do double-checked locking to ensure we don't race with another thread potentially executing all registered callbacks
-            auto ptr{ m_token.m_state.load(std::memory_order_acquire) };
-            if (!ptr->stop_requested()) {
-                auto lck{ std::lock_guard{ptr->m_mut} };
-                if (!ptr->stop_requested()) {
-                    std::size_t this_id{ ptr->register_callback(std::forward<C>(function)) };
-                    return this_id;
-                }
-                else {
-                    std::invoke(std::forward<C>(function));
-                    return std::nullopt;
-                }
+        bool register_or_invoke() {
+            //If the token holds a null ptr there will never be a stop, so the callback is neither registered nor invoked.
+            //Note that if it doesn't here it can't be changed to do so later
+            //As the stop flag is never cleared, we can also skip the lock entirely if it's already set
+            if (!m_state) {
+                return false;
             }
-            else {
-                std::invoke(std::forward<C>(function));
-                return std::nullopt;
+            if (!m_state->stop_requested() && m_state->register_callback(this)) {
+                return true;
             }
+            std::invoke(m_callback);
+            return false;
         }
 
     public:
@@ -219,11 +228,17 @@ namespace dp{
 
         template<typename C>
         explicit stop_callback(const dp::stop_token& tok, C&& func) noexcept(std::is_nothrow_constructible_v<Callback, C>)
-            : m_token{ tok }, m_callback_id{ register_or_invoke(std::forward<C>(func)) } {}
+            : detail::stop_callback_node{ &stop_callback::invoke }, m_state{ tok.m_state.load(std::memory_order_acquire) },
+            m_callback{ std::forward<C>(func) }, m_registered{ register_or_invoke() } {
+            static_assert(std::is_constructible_v<Callback, C>, "Callback is not constructible from provided argument types");
+        }
 
         template<typename C>
         explicit stop_callback(dp::stop_token&& tok, C&& func) noexcept(std::is_nothrow_constructible_v<Callback, C>)
-            : m_token{ std::move(tok) }, m_callback_id{ register_or_invoke(std::forward<C>(func)) } {}
+            : detail::stop_callback_node{ &stop_callback::invoke }, m_state{ tok.m_state.exchange(nullptr, std::memory_order_acq_rel) },
+            m_callback{ std::forward<C>(func) }, m_registered{ register_or_invoke() } {
+            static_assert(std::is_constructible_v<Callback, C>, "Callback is not constructible from provided argument types");
+        }
 
         stop_callback(const stop_callback&) = delete;
         stop_callback& operator=(const stop_callback&) = delete;
@@ -231,19 +246,8 @@ namespace dp{
         stop_callback& operator=(stop_callback&&) = delete;
 
         ~stop_callback() noexcept {
-            //If the callback is registered
-            if (m_callback_id.has_value()) {
-                //We know there's no way for ptr to be null, as were that the case m_callback_id would have no value
-                //So we don't need to check that.
-                auto ptr{ m_token.m_state.load(std::memory_order_acquire) };
-                //We also do the same double-checked locking to ensure it is safely deregistered
-                //or invoked by the calling thread
-                if (!ptr->stop_requested()) {
-                    auto lck{ std::lock_guard{ptr->m_mut} };
-                    if (!ptr->stop_requested()) {
-                        ptr->deregister_callback(*m_callback_id);
-                    }
-                }
+            if (m_registered) {
+                m_state->deregister_callback(this);
             }
         }
     };
@@ -251,6 +255,33 @@ namespace dp{
     template<typename Callback>
     stop_callback(stop_token, Callback) -> stop_callback<Callback>;
 
+    namespace detail {
+
+        inline stop_token make_stop_token(std::shared_ptr<stop_state> state) noexcept {
+            return stop_token{ std::move(state) };
+        }
+
+        //Keeps hold of a token's stop state directly, so that checking it is a single load of the flag rather than an atomic load of the shared_ptr.
+        //For hot paths which check the same token over and over, such as an executor testing each task as it is dequeued.
+        class stop_flag {
+            std::shared_ptr<stop_state> m_state{};
+
+        public:
+            stop_flag() noexcept = default;
+            explicit stop_flag(const dp::stop_token& token) noexcept : m_state{ token.m_state.load(std::memory_order_acquire) } {}
+
+            //Null if the token had no stop state, in which case a stop can never be requested
+            const stop_state* get() const noexcept {
+                return m_state.get();
+            }
+
+            bool stop_requested() const noexcept {
+                return m_state && m_state->stop_requested();
+            }
+        };
+
+    }
+
 
 
     
@@ -0,0 +1,147 @@
+#ifndef DP_TASK_GROUP
+#define DP_TASK_GROUP
+
+/*
+*	A scope for structured concurrency: every task spawned into a group has finished by the time the group is destroyed.
+*
+*	Tasks run on jthreads of their own, or on an executor such as dp::thread_pool, and share the group's stop_token, which they are passed
+*	if they take one as their first parameter. The first task to throw has its exception kept and a stop requested on the group,
+*	so that its siblings can give up on work which is now doomed. wait() blocks until every task has finished and then rethrows that exception.
+*	The destructor waits too, and rethrows if wait() has not already done so - unless the group is being destroyed by another exception,
+*	in which case it requests a stop before waiting and the task's exception is dropped.
+*
+*	A group constructed with a parent token is stopped whenever the parent is. Tasks may spawn further tasks into their own group.
+*/
+
+#include <atomic>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <optional>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "future.h"
+#include "jthread.h"
+#include "mutex.h"
+#include "stop_token.h"
+#include "this_thread.h"
+
+namespace dp {
+
+	class task_group {
+		struct forward_stop {
+			dp::stop_source* m_target;
+			void operator()() const noexcept {
+				m_target->request_stop();
+			}
+		};
+
+		template<typename Func, typename... Args>
+		class runner {
+			task_group* m_group;
+			std::tuple<Func, Args...> m_call;
+
+		public:
+			template<typename F, typename... A>
+			explicit runner(task_group& group, F&& func, A&&... args) : m_group{ &group }, m_call{ std::forward<F>(func), std::forward<A>(args)... } {}
+			runner(runner&& other) noexcept(std::is_nothrow_move_constructible_v<std::tuple<Func, Args...>>)
+				: m_group{ std::exchange(other.m_group, nullptr) }, m_call{ std::move(other.m_call) } {}
+			runner& operator=(runner&&) = delete;
+
+			//A task destroyed without having run, for instance by an executor which was stopped, counts as failing
+			~runner() {
+				if (m_group) {
+					m_group->record_error(std::make_exception_ptr(std::future_error{ std::future_errc::broken_promise }));
+					m_group->finish_one();
+				}
+			}
+
+			void operator()() {
+				task_group* const group{ std::exchange(m_group, nullptr) };
+				const dp::stop_token token{ group->m_stop.get_token() };
+				{
+					detail::thread_stop_scope scope{ token };
+					try {
+						std::apply([&token](Func& func, Args&... args) {
+							if constexpr (std::is_invocable_v<Func, dp::stop_token, Args...>) {
+								std::invoke(std::move(func), token, std::move(args)...);
+							}
+							else {
+								std::invoke(std::move(func), std::move(args)...);
+							}
+							}, m_call);
+					}
+					catch (...) {
+						group->record_error(std::current_exception());
+					}
+				}
+				group->finish_one();
+			}
+		};
+
+		dp::stop_source m_stop{};
+		std::optional<dp::stop_callback<forward_stop>> m_parent_link{};
+
+		//Doubles as a futex word for wait(). The last task to finish sets closing_bit while it wakes the waiters, since it may not touch the group once the count reads zero.
+		static constexpr std::uint32_t closing_bit{ 0x8000'0000u };
+		std::atomic<std::uint32_t> m_pending{ 0 };
+		std::atomic<bool> m_failed{ false };
+		std::exception_ptr m_error{};
+		int m_uncaught_on_entry;
+
+		dp::mutex m_threads_mut{};
+		std::vector<dp::jthread> m_threads{};
+
+		void record_error(std::exception_ptr error) noexcept;
+		void finish_one() noexcept;
+		void wait_for_tasks() noexcept;
+
+		template<typename Func, typename... Args>
+		void check_invocable() {
+			static_assert(std::is_invocable_v<std::decay_t<Func>, std::decay_t<Args>...> || std::is_invocable_v<std::decay_t<Func>, dp::stop_token, std::decay_t<Args>...>,
+				"Function passed to task_group must be invocable with the given arguments, optionally preceded by a stop_token");
+		}
+
+	public:
+		task_group();
+		explicit task_group(const dp::stop_token& parent);
+		~task_group() noexcept(false);
+
+		task_group(const task_group&) = delete;
+		task_group& operator=(const task_group&) = delete;
+		task_group(task_group&&) = delete;
+		task_group& operator=(task_group&&) = delete;
+
+		//Runs func(args...) on a new jthread
+		template<typename Func, typename... Args, std::enable_if_t<!detail::is_executor<std::decay_t<Func>>::value, int> = 0>
+		void spawn(Func&& func, Args&&... args) {
+			check_invocable<Func, Args...>();
+			m_pending.fetch_add(1, std::memory_order_relaxed);
+			runner<std::decay_t<Func>, std::decay_t<Args>...> task{ *this, std::forward<Func>(func), std::forward<Args>(args)... };
+			std::lock_guard lck{ m_threads_mut };
+			m_threads.emplace_back(std::move(task));
+		}
+
+		//Submits func to an executor with a submit(func) member
+		template<typename Executor, typename Func, std::enable_if_t<detail::is_executor<Executor>::value, int> = 0>
+		void spawn(Executor& executor, Func&& func) {
+			check_invocable<Func>();
+			m_pending.fetch_add(1, std::memory_order_relaxed);
+			executor.submit(runner<std::decay_t<Func>>{ *this, std::forward<Func>(func) });
+		}
+
+		//Waits for every task spawned so far, then rethrows the first exception any of them threw
+		void wait();
+
+		bool request_stop() noexcept;
+		bool stop_requested() const noexcept;
+		dp::stop_token get_stop_token() const noexcept;
+	};
+
+}
+
+#endif
@@ -0,0 +1,130 @@
+#ifndef DP_THIS_THREAD
+#define DP_THIS_THREAD
+
+/*
+*	Stop-aware counterparts to the functions in std::this_thread.
+*
+*	A thread sleeping in a loop like while(!token.stop_requested()) can otherwise hold up the destruction of its jthread
+*	for as long as the sleep lasts. These sleeps return as soon as a stop is requested instead.
+*
+*	A dp::jthread also makes its stop token available to everything running on its thread through get_stop_token() and stop_requested(),
+*	so it needn't be passed down through every layer of calls. On threads not started by a jthread there is no token, and no stop is ever requested.
+*/
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <thread>
+
+#include "stop_token.h"
+#include "futex.h"
+
+namespace dp {
+
+	namespace detail {
+		//The stop state of the jthread running on this thread, if any. Kept as a raw pointer so that querying it is a single
+		//thread-local load, with none of the reference counting which copying a stop_token entails.
+		inline thread_local detail::stop_state* current_stop_state{ nullptr };
+		inline thread_local const dp::stop_token* current_stop_token{ nullptr };
+
+		//Installs token as the current thread's token for its lifetime. The scope keeps the stop state alive, so the raw pointer never dangles.
+		class thread_stop_scope {
+			std::shared_ptr<detail::stop_state> m_state;
+			detail::stop_state* m_prev_state;
+			const dp::stop_token* m_prev_token;
+
+		public:
+			explicit thread_stop_scope(const dp::stop_token& token) noexcept
+				: m_state{ token.m_state.load(std::memory_order_acquire) }, m_prev_state{ current_stop_state }, m_prev_token{ current_stop_token } {
+				current_stop_state = m_state.get();
+				current_stop_token = &token;
+			}
+
+			thread_stop_scope(const thread_stop_scope&) = delete;
+			thread_stop_scope& operator=(const thread_stop_scope&) = delete;
+
+			~thread_stop_scope() noexcept {
+				current_stop_state = m_prev_state;
+				current_stop_token = m_prev_token;
+			}
+		};
+
+		//Registered for the duration of an interruptible sleep. Lives on the sleeping thread's stack, so sleeping never allocates.
+		class stop_sleeper {
+			struct waker {
+				std::atomic<std::uint32_t>* m_word;
+				void operator()() const noexcept {
+					m_word->store(1, std::memory_order_release);
+					detail::futex_wake_all(*m_word);
+				}
+			};
+
+			std::atomic<std::uint32_t> m_word{ 0 };
+			dp::stop_callback<waker> m_callback;
+
+		public:
+			explicit stop_sleeper(const dp::stop_token& token) : m_callback{ token, waker{ &m_word } } {}
+
+			bool stopped() const noexcept {
+				return m_word.load(std::memory_order_acquire) != 0;
+			}
+
+			void sleep_for(std::chrono::nanoseconds rel_time) noexcept {
+				detail::futex_wait_for(m_word, 0, rel_time);
+			}
+		};
+	}
+
+	namespace this_thread {
+
+		using std::this_thread::get_id;
+		using std::this_thread::yield;
+		using std::this_thread::sleep_for;
+		using std::this_thread::sleep_until;
+
+		//A copy of the token belonging to the jthread running on this thread. On any other thread, a token on which a stop is never possible.
+		inline dp::stop_token get_stop_token() {
+			if (const dp::stop_token* token{ detail::current_stop_token }) {
+				return *token;
+			}
+			return dp::stop_source{ dp::nostopstate }.get_token();
+		}
+
+		inline bool stop_requested() noexcept {
+			const detail::stop_state* state{ detail::current_stop_state };
+			return state && state->stop_requested();
+		}
+
+		inline bool stop_possible() noexcept {
+			return detail::current_stop_state != nullptr;
+		}
+
+		//Sleep until end_time, or until a stop is requested on token. Returns true if the sleep was cut short by a stop.
+		template<typename Clock, typename Duration>
+		bool sleep_until(const dp::stop_token& token, const std::chrono::time_point<Clock, Duration>& end_time) {
+			if (!token.stop_possible()) {
+				std::this_thread::sleep_until(end_time);
+				return false;
+			}
+			detail::stop_sleeper sleeper{ token };
+			while (!sleeper.stopped()) {
+				const std::chrono::nanoseconds remaining{ detail::time_until(end_time) };
+				if (remaining == std::chrono::nanoseconds::zero()) {
+					return false;
+				}
+				sleeper.sleep_for(remaining);
+			}
+			return true;
+		}
+
+		template<typename Rep, typename Period>
+		bool sleep_for(const dp::stop_token& token, const std::chrono::duration<Rep, Period>& sleep_time) {
+			return dp::this_thread::sleep_until(token, std::chrono::steady_clock::now() + sleep_time);
+		}
+
+	}
+
+}
+
+#endif
@@ -0,0 +1,179 @@
+#ifndef DP_THREAD_ATTRIBUTES
+#define DP_THREAD_ATTRIBUTES
+
+/*
+*	Properties to apply to a thread as it is started: stack size or custom stack, name, CPU affinity and scheduling policy.
+*
+*	Pass a thread_attributes to the corresponding dp::jthread constructor. Everything is applied before the thread's function starts to run.
+*	Threads started without attributes are plain std::threads and pay nothing for this.
+*
+*	On Linux and macOS threads are created directly with pthreads. Elsewhere the thread is a std::thread which applies what it can to itself
+*	once it starts; on Windows that means the name, affinity and priority, but not the stack size.
+*	Affinity is only supported on Linux and Windows. Starting a thread with a policy the process has no permission to use throws std::system_error.
+*/
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <string>
+#include <thread>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "stack_provider.h"
+
+#if defined(__linux__) || defined(__APPLE__)
+#include <pthread.h>
+#define DP_PTHREAD_THREADS
+#endif
+
+namespace dp {
+
+	enum class scheduling_policy {
+		inherit,		//Use whatever the creating thread uses
+		normal,			//The default time-sharing policy (SCHED_OTHER)
+		fifo,			//Real-time, run until blocked or preempted by a higher priority (SCHED_FIFO)
+		round_robin		//Real-time, time-sliced between threads of equal priority (SCHED_RR)
+	};
+
+	class thread_attributes {
+		std::optional<std::size_t> m_stack_size{};
+		std::shared_ptr<dp::stack_provider> m_stack_provider{};
+		std::string m_name{};
+		std::vector<unsigned int> m_affinity{};
+		scheduling_policy m_policy{ scheduling_policy::inherit };
+		int m_priority{ 0 };
+
+	public:
+		thread_attributes() = default;
+
+		//Rounded up to whatever minimum and granularity the platform imposes
+		thread_attributes& set_stack_size(std::size_t bytes) {
+			m_stack_size = bytes;
+			return *this;
+		}
+
+		//Run the thread on a stack from provider, which takes precedence over any stack size. The stack is handed back once the thread
+		//is joined; a detached thread's stack is reclaimed the next time a thread is started with a provider on Linux, and leaked elsewhere.
+		thread_attributes& set_stack_provider(std::shared_ptr<dp::stack_provider> provider) {
+			m_stack_provider = std::move(provider);
+			return *this;
+		}
+
+		//Linux truncates thread names to 15 characters
+		thread_attributes& set_name(std::string name) {
+			m_name = std::move(name);
+			return *this;
+		}
+
+		//The indices of the CPUs the thread may run on. An empty list leaves the thread free to run anywhere.
+		thread_attributes& set_affinity(std::vector<unsigned int> cpus) {
+			m_affinity = std::move(cpus);
+			return *this;
+		}
+
+		//The meaning of priority depends on the policy and platform. On Windows it is passed to SetThreadPriority and the policy is ignored.
+		thread_attributes& set_scheduling(scheduling_policy policy, int priority = 0) {
+			m_policy = policy;
+			m_priority = priority;
+			return *this;
+		}
+
+		const std::optional<std::size_t>& stack_size() const noexcept { return m_stack_size; }
+		const std::shared_ptr<dp::stack_provider>& stack_provider() const noexcept { return m_stack_provider; }
+		const std::string& name() const noexcept { return m_name; }
+		const std::vector<unsigned int>& affinity() const noexcept { return m_affinity; }
+		scheduling_policy policy() const noexcept { return m_policy; }
+		int priority() const noexcept { return m_priority; }
+	};
+
+	namespace detail {
+
+		struct use_thread_cache_t {};
+		constexpr inline use_thread_cache_t use_thread_cache{};
+
+		//A thread started with a set of attributes, or borrowed from the thread cache. Has the same ownership semantics as std::thread.
+		class native_thread {
+		public:
+			struct entry_base {
+				virtual ~entry_base() = default;
+				virtual void run() = 0;
+			};
+
+			//Filled in by the new thread once it is running. get_id() and detach() wait on it, so starting a thread never does.
+			//Threads borrowed from the thread cache outlive the function they run, so for them joining means waiting on m_finished instead.
+			struct control_block {
+				std::atomic<std::uint32_t> m_started{ 0 };
+				std::thread::id m_id{};
+				bool m_cached{ false };
+				//For cached threads: 0 while running, 1 once finished, 2 if detached first, in which case the thread frees the block
+				std::atomic<std::uint32_t> m_finished{ 0 };
+				//For threads running on a custom stack, where to return it once the thread has been joined
+				std::shared_ptr<dp::stack_provider> m_stack_provider{};
+				dp::thread_stack m_stack{};
+			};
+
+		private:
+			template<typename Func, typename... Args>
+			struct entry : entry_base {
+				std::decay_t<Func> m_func;
+				std::tuple<std::decay_t<Args>...> m_args;
+
+				entry(Func&& func, Args&&... args) : m_func{ std::forward<Func>(func) }, m_args{ std::forward<Args>(args)... } {}
+
+				void run() override {
+					std::apply([this](auto&... args) { std::invoke(std::move(m_func), std::move(args)...); }, m_args);
+				}
+			};
+
+#ifdef DP_PTHREAD_THREADS
+			pthread_t m_handle{};
+#else
+			std::thread m_handle{};
+#endif
+			//Null when there is no thread of execution
+			std::unique_ptr<control_block> m_start{};
+
+			void start(const thread_attributes& attrs, std::unique_ptr<entry_base> func);
+			void start_cached(std::unique_ptr<entry_base> func);
+			void wait_started() const noexcept;
+
+		public:
+			native_thread() noexcept = default;
+
+			template<typename Func, typename... Args>
+			native_thread(const thread_attributes& attrs, Func&& func, Args&&... args) {
+				start(attrs, std::make_unique<entry<Func, Args...>>(std::forward<Func>(func), std::forward<Args>(args)...));
+			}
+
+			//Run func on a parked thread from the thread cache, or a new one if none are parked
+			template<typename Func, typename... Args>
+			native_thread(use_thread_cache_t, Func&& func, Args&&... args) {
+				start_cached(std::make_unique<entry<Func, Args...>>(std::forward<Func>(func), std::forward<Args>(args)...));
+			}
+
+			native_thread(const native_thread&) = delete;
+			native_thread& operator=(const native_thread&) = delete;
+
+			native_thread(native_thread&& other) noexcept;
+			native_thread& operator=(native_thread&& other) noexcept;
+
+			~native_thread();
+
+			bool joinable() const noexcept;
+			std::thread::id get_id() const noexcept;
+			void join();
+			void detach();
+			void swap(native_thread& other) noexcept;
+		};
+
+	}
+
+}
+
+#endif
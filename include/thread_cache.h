@@ -0,0 +1,52 @@
+#ifndef DP_THREAD_CACHE
+#define DP_THREAD_CACHE
+
+/*
+*	An opt-in cache of parked threads behind dp::jthread.
+*
+*	Once enabled, a jthread constructed without attributes borrows a parked thread rather than creating a new one, so starting it costs
+*	a queue pop and a futex wake instead of a clone() and a fresh stack. When the function returns the thread parks again for up to
+*	idle_timeout, waiting for the next jthread. join(), detach() and stop requests behave exactly as they do for any other jthread;
+*	joining waits for the function to return rather than for the thread to exit.
+*
+*	Because cached threads are reused, thread_local variables are not destroyed between one jthread and the next, and the same
+*	thread id may be seen by several jthreads in turn. Threads started with thread_attributes never use the cache.
+*/
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <memory>
+#include <thread>
+
+#include "thread_attributes.h"
+
+namespace dp {
+
+	namespace detail {
+		inline std::atomic<bool> thread_cache_enabled{ false };
+
+		//Hands func to a parked thread, or a new one, which signals block when func returns. Returns the id of the thread which will run it.
+		std::thread::id thread_cache_launch(std::unique_ptr<native_thread::entry_base> func, native_thread::control_block* block);
+	}
+
+	class thread_cache {
+	public:
+		//Start caching threads. At most max_parked threads are kept waiting at once, each for up to idle_timeout before it exits.
+		//May be called again to change the limits, which apply to threads as they next park.
+		static void enable(std::size_t max_parked = std::thread::hardware_concurrency(), std::chrono::milliseconds idle_timeout = std::chrono::seconds{ 10 });
+
+		//Stop caching threads, and wake every parked thread so that it exits. Threads running a jthread's function are unaffected.
+		static void disable() noexcept;
+
+		static bool enabled() noexcept {
+			return detail::thread_cache_enabled.load(std::memory_order_relaxed);
+		}
+
+		//The number of threads currently parked, waiting for work
+		static std::size_t parked() noexcept;
+	};
+
+}
+
+#endif
@@ -0,0 +1,212 @@
+#ifndef DP_THREAD_POOL
+#define DP_THREAD_POOL
+
+/*
+*	A work-stealing pool of dp::jthreads.
+*
+*	Each worker owns a Chase-Lev deque. Tasks submitted from a worker go onto its own deque, where the owner pushes and pops at one end
+*	without contention. Tasks submitted from outside the pool go through a shared injection queue. An idle worker first drains its own
+*	deque, then the injection queue, and then steals from the other end of a randomly chosen victim's deque. Workers with nothing to do
+*	sleep on a futex rather than spinning.
+*
+*	Tasks may take a dp::stop_token as their only parameter. They are given the pool's token, or the token they were submitted with.
+*	A task submitted with its own token is discarded without running if a stop has been requested on that token by the time it is dequeued.
+*	Stopping the pool (on request_stop() or destruction) lets running tasks finish but discards any which have not started.
+*	Tasks must not throw.
+*/
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "stop_token.h"
+#include "jthread.h"
+#include "futex.h"
+
+namespace dp {
+
+	namespace detail {
+
+		struct pool_task {
+			//Set by tasks submitted with a token of their own, which keep the state alive. Lets executors drop cancelled tasks with a single load.
+			const stop_state* m_cancel{ nullptr };
+
+			virtual ~pool_task() = default;
+			virtual void run(const dp::stop_token& pool_token) = 0;
+
+			bool cancelled() const noexcept {
+				return m_cancel && m_cancel->stop_requested();
+			}
+		};
+
+		//Base lets other executors reuse these with a task type of their own, provided it derives from pool_task
+		template<typename Func, typename Base = pool_task>
+		class pool_task_impl : public Base {
+			Func m_func;
+
+		public:
+			template<typename F>
+			explicit pool_task_impl(F&& func) : m_func{ std::forward<F>(func) } {}
+
+			void run(const dp::stop_token& pool_token) override {
+				if constexpr (std::is_invocable_v<Func&, dp::stop_token>) {
+					m_func(pool_token);
+				}
+				else {
+					m_func();
+				}
+			}
+		};
+
+		template<typename Func, typename Base = pool_task>
+		class pool_task_with_token : public Base {
+			dp::stop_token m_token;
+			detail::stop_flag m_flag;
+			Func m_func;
+
+		public:
+			template<typename F>
+			pool_task_with_token(dp::stop_token token, F&& func) : m_token{ std::move(token) }, m_flag{ m_token }, m_func{ std::forward<F>(func) } {
+				this->m_cancel = m_flag.get();
+			}
+
+			void run(const dp::stop_token&) override {
+				if (this->cancelled()) {
+					return;
+				}
+				if constexpr (std::is_invocable_v<Func&, dp::stop_token>) {
+					m_func(m_token);
+				}
+				else {
+					m_func();
+				}
+			}
+		};
+
+		//The Chase-Lev work-stealing deque, following the C11 formulation of Le, Pop, Cohen and Zappa Nardelli.
+		//The owning worker pushes and takes at the bottom; any other thread may steal from the top.
+		class work_stealing_deque {
+			struct ring {
+				std::int64_t m_capacity;
+				std::unique_ptr<std::atomic<pool_task*>[]> m_slots;
+
+				explicit ring(std::int64_t capacity) : m_capacity{ capacity }, m_slots{ new std::atomic<pool_task*>[static_cast<std::size_t>(capacity)] } {}
+
+				pool_task* get(std::int64_t index) const noexcept {
+					return m_slots[static_cast<std::size_t>(index & (m_capacity - 1))].load(std::memory_order_relaxed);
+				}
+				void put(std::int64_t index, pool_task* task) noexcept {
+					m_slots[static_cast<std::size_t>(index & (m_capacity - 1))].store(task, std::memory_order_relaxed);
+				}
+			};
+
+			alignas(64) std::atomic<std::int64_t> m_top{ 0 };
+			alignas(64) std::atomic<std::int64_t> m_bottom{ 0 };
+			std::atomic<ring*> m_ring;
+			//Thieves may still be reading an outgrown ring, so old rings are kept until the deque is destroyed
+			std::vector<std::unique_ptr<ring>> m_rings{};
+
+			ring* grow(ring* old, std::int64_t top, std::int64_t bottom);
+
+		public:
+			explicit work_stealing_deque(std::int64_t capacity = 256);
+
+			work_stealing_deque(const work_stealing_deque&) = delete;
+			work_stealing_deque& operator=(const work_stealing_deque&) = delete;
+
+			//Owner only
+			void push(pool_task* task);
+			pool_task* take() noexcept;
+
+			//Any thread. May return nullptr spuriously if it loses a race with another thief or the owner.
+			pool_task* steal() noexcept;
+
+			bool empty() const noexcept;
+		};
+
+	}
+
+	class thread_pool {
+		struct alignas(64) worker {
+			detail::work_stealing_deque m_deque{};
+			std::uint64_t m_rng;
+		};
+
+		dp::stop_source m_stop{};
+		std::vector<std::unique_ptr<worker>> m_workers{};
+
+		std::mutex m_injection_mut{};
+		std::deque<detail::pool_task*> m_injection{};
+		std::atomic<std::size_t> m_injected{ 0 };
+
+		//An event count: sleepers record the epoch, re-check for work, and then sleep until the epoch moves on
+		std::atomic<std::uint32_t> m_epoch{ 0 };
+		std::atomic<std::uint32_t> m_sleepers{ 0 };
+
+		//Declared last so that the threads are joined before anything they use is destroyed
+		std::vector<dp::jthread> m_threads{};
+
+		void enqueue(detail::pool_task* task);
+		void wake_one() noexcept;
+		detail::pool_task* pop_injected() noexcept;
+		detail::pool_task* find_work(worker* self) noexcept;
+		bool run_one(worker* self);
+		void run(std::size_t index);
+		worker* current_worker() const noexcept;
+
+	public:
+		//Defaults to one worker per CPU the process can actually use
+		explicit thread_pool(std::size_t threads = dp::jthread::effective_concurrency());
+		~thread_pool();
+
+		thread_pool(const thread_pool&) = delete;
+		thread_pool& operator=(const thread_pool&) = delete;
+		thread_pool(thread_pool&&) = delete;
+		thread_pool& operator=(thread_pool&&) = delete;
+
+		template<typename Func>
+		void submit(Func&& func) {
+			static_assert(std::is_invocable_v<std::decay_t<Func>&> || std::is_invocable_v<std::decay_t<Func>&, dp::stop_token>,
+				"Function passed to thread_pool must be invocable with no arguments or a stop_token");
+			enqueue(new detail::pool_task_impl<std::decay_t<Func>>{ std::forward<Func>(func) });
+		}
+
+		template<typename Func>
+		void submit(dp::stop_token token, Func&& func) {
+			static_assert(std::is_invocable_v<std::decay_t<Func>&> || std::is_invocable_v<std::decay_t<Func>&, dp::stop_token>,
+				"Function passed to thread_pool must be invocable with no arguments or a stop_token");
+			enqueue(new detail::pool_task_with_token<std::decay_t<Func>>{ std::move(token), std::forward<Func>(func) });
+		}
+
+		//Runs queued tasks on the calling thread until done() returns true, so that a task waiting on tasks it has submitted
+		//keeps its worker busy rather than blocking it. Threads outside the pool may call this too.
+		//Returns false if the pool was stopped first, as the tasks being waited on may then never run.
+		template<typename Predicate>
+		bool help_until(Predicate done) {
+			worker* const self{ current_worker() };
+			while (!done()) {
+				if (m_stop.stop_requested()) {
+					return false;
+				}
+				if (!run_one(self)) {
+					std::this_thread::yield();
+				}
+			}
+			return true;
+		}
+
+		std::size_t size() const noexcept;
+
+		bool request_stop() noexcept;
+		dp::stop_token get_stop_token() const noexcept;
+	};
+
+}
+
+#endif
@@ -0,0 +1,129 @@
+#ifndef DP_TIMER_SERVICE
+#define DP_TIMER_SERVICE
+
+/*
+*	A single dp::jthread which runs delayed and periodic tasks, so that thousands of timers cost one thread rather than one each.
+*
+*	Timers are kept in a hierarchical timing wheel: four levels of 256 slots, each level covering 256 times the span of the one below.
+*	Scheduling and cancelling a timer are O(1), and the service thread sleeps until the next slot with anything in it rather than
+*	waking every tick. Tasks run on the service thread, so long-running tasks delay every other timer and should be handed off elsewhere.
+*	Tasks must not throw.
+*/
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <unordered_map>
+#include <vector>
+
+#include "stop_token.h"
+#include "condition_variable.h"
+#include "jthread.h"
+
+namespace dp {
+
+	class timer_service {
+	public:
+		using clock = std::chrono::steady_clock;
+		using timer_id = std::uint64_t;
+
+	private:
+		struct timer {
+			timer_id id;
+			std::function<void()> task;
+			//Timers given a token are dropped without running once a stop has been requested on it
+			std::optional<dp::stop_token> token;
+			clock::time_point deadline;
+			//Zero for one-shot timers. Periodic timers advance their deadline by this much each time they fire, so they never drift.
+			clock::duration period;
+
+			std::uint64_t expiry_tick{ 0 };
+			timer* prev{ nullptr };
+			timer* next{ nullptr };
+			std::uint8_t level{ 0 };
+			std::uint8_t slot{ 0 };
+			bool linked{ false };
+			bool running{ false };
+			bool cancelled{ false };
+		};
+
+		static constexpr std::size_t wheel_bits{ 8 };
+		static constexpr std::size_t wheel_slots{ std::size_t{ 1 } << wheel_bits };
+		static constexpr std::size_t wheel_levels{ 4 };
+
+		struct wheel_level {
+			std::array<timer*, wheel_slots> slots{};
+			//One bit per slot, so that finding the next occupied slot doesn't mean walking all of them
+			std::array<std::uint64_t, wheel_slots / 64> occupied{};
+		};
+
+		clock::duration m_resolution;
+		clock::time_point m_epoch;
+		//The next tick to be processed
+		std::uint64_t m_now_tick{ 0 };
+		//The tick the service thread is asleep until, so schedulers know whether they need to wake it
+		std::uint64_t m_wake_tick{ 0 };
+		bool m_changed{ false };
+		timer_id m_next_id{ 1 };
+
+		std::array<wheel_level, wheel_levels> m_wheel{};
+		std::unordered_map<timer_id, std::unique_ptr<timer>> m_timers{};
+		std::vector<timer*> m_expired{};
+
+		std::mutex m_mut{};
+		dp::condition_variable_any m_cond{};
+
+		//Declared last so that it is stopped and joined before anything it uses is destroyed
+		dp::jthread m_thread;
+
+
+		std::uint64_t tick_of(clock::time_point time) const noexcept;
+
+		void link(timer* t) noexcept;
+		void unlink(timer* t) noexcept;
+		void cascade(std::size_t level, std::size_t slot) noexcept;
+		std::optional<std::uint64_t> next_event_tick() const noexcept;
+		void process_tick() noexcept;
+
+		timer_id add(clock::time_point deadline, clock::duration period, std::function<void()> task, std::optional<dp::stop_token> token);
+		clock::duration checked_period(clock::duration period) const;
+
+		void run(dp::stop_token token);
+
+	public:
+		explicit timer_service(clock::duration resolution = std::chrono::milliseconds{ 1 });
+		~timer_service();
+
+		timer_service(const timer_service&) = delete;
+		timer_service& operator=(const timer_service&) = delete;
+		timer_service(timer_service&&) = delete;
+		timer_service& operator=(timer_service&&) = delete;
+
+		timer_id schedule_after(clock::duration delay, std::function<void()> task);
+		timer_id schedule_after(clock::duration delay, std::function<void()> task, dp::stop_token token);
+
+		timer_id schedule_at(clock::time_point when, std::function<void()> task);
+		timer_id schedule_at(clock::time_point when, std::function<void()> task, dp::stop_token token);
+
+		//Runs task every period, starting one period from now. Deadlines are measured from the previous deadline
+		//rather than from when the task last finished, so the schedule doesn't drift.
+		//A period which is not positive throws std::system_error with errc::invalid_argument, and one shorter than the resolution is rounded up to it.
+		timer_id schedule_every(clock::duration period, std::function<void()> task);
+		timer_id schedule_every(clock::duration period, std::function<void()> task, dp::stop_token token);
+
+		//Returns false if the timer had already fired (for a one-shot timer) or been cancelled.
+		//A task which is running when it is cancelled runs to completion, but a periodic task will not run again.
+		bool cancel(timer_id id);
+
+		//Stops the service thread. Pending timers are discarded without running.
+		bool request_stop() noexcept;
+		dp::stop_token get_stop_token() const noexcept;
+	};
+
+}
+
+#endif
@@ -0,0 +1,83 @@
+#ifndef DP_TOPOLOGY
+#define DP_TOPOLOGY
+
+/*
+*	The layout of the machine's CPUs - which are SMT siblings on the same core, which share an L2 or last-level cache,
+*	and which NUMA node each belongs to - along with helpers for choosing where to place a set of threads.
+*
+*	On Linux this is read from /sys/devices/system/cpu and /sys/devices/system/node. Elsewhere every CPU is reported as its own core
+*	in a single cache domain and node. The placement helpers only ever return CPUs the process is allowed to run on,
+*	so their results can be passed straight to thread_attributes::set_affinity().
+*/
+
+#include <cstddef>
+#include <vector>
+
+namespace dp {
+
+	class topology {
+	public:
+		struct cpu {
+			unsigned int id;
+			//Dense indices, numbered from 0, of the groups this CPU belongs to
+			unsigned int core;
+			unsigned int package;
+			unsigned int numa_node;
+			unsigned int l2;
+			unsigned int llc;
+			//This CPU's position among its core's SMT siblings, so 0 for the first hardware thread of each core
+			unsigned int smt_index;
+			//Whether the process's affinity mask allows it to run here
+			bool allowed;
+		};
+
+	private:
+		std::vector<cpu> m_cpus{};
+		std::size_t m_cores{ 0 };
+		std::size_t m_packages{ 0 };
+		std::size_t m_numa_nodes{ 0 };
+		std::size_t m_l2s{ 0 };
+		std::size_t m_llcs{ 0 };
+
+		std::vector<const cpu*> allowed_cpus() const;
+		void number_smt_siblings();
+
+	public:
+		//The topology as read the first time this is called
+		static const topology& system();
+
+		//Read the topology afresh, for instance after CPUs have been brought online or the affinity mask has changed
+		static topology detect();
+		//Builds a topology from a description of each CPU, whose group indices must be dense. smt_index is worked out afresh.
+		static topology from_cpus(std::vector<cpu> cpus);
+
+		//Sorted by id, and only including online CPUs
+		const std::vector<cpu>& cpus() const noexcept;
+		const cpu* find(unsigned int id) const noexcept;
+
+		std::size_t core_count() const noexcept;
+		std::size_t package_count() const noexcept;
+		std::size_t numa_node_count() const noexcept;
+		std::size_t l2_count() const noexcept;
+		std::size_t llc_count() const noexcept;
+
+		//The ids of the CPUs sharing a core, last-level cache or NUMA node with the given CPU, including itself
+		std::vector<unsigned int> smt_siblings(unsigned int id) const;
+		std::vector<unsigned int> llc_siblings(unsigned int id) const;
+		std::vector<unsigned int> node_cpus(unsigned int node) const;
+
+		//Placement helpers. Each returns the CPU for each of count threads in turn, wrapping round if there are more threads than CPUs.
+
+		//As far apart as possible: alternating between NUMA nodes and caches, and only doubling up on any core's SMT siblings once every core is in use
+		std::vector<unsigned int> spread(std::size_t count) const;
+		//As close together as possible: filling each core's siblings, then each cache, then each node before moving on
+		std::vector<unsigned int> compact(std::size_t count) const;
+
+		//One CPU on each core, or on each last-level cache, in compact order
+		std::vector<unsigned int> one_per_core() const;
+		std::vector<unsigned int> one_per_llc() const;
+	};
+
+}
+
+#endif
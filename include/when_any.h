@@ -0,0 +1,255 @@
+#ifndef DP_WHEN_ANY
+#define DP_WHEN_ANY
+
+/*
+*	Racing several tasks against each other and keeping whichever answers first.
+*
+*	dp::when_any starts each task on a jthread of its own, or on an executor such as dp::thread_pool, and returns a dp::future for the first
+*	result to arrive along with the index of the task which produced it. Each task is given a child stop_token of its own if it takes one.
+*	As soon as a task succeeds every other task's token is stopped; the losers are left to notice and finish on their own, so they must not
+*	refer to anything which might not outlive them. A task which throws does not win. If every task throws, the future holds the first exception.
+*	Cancelling the future stops every task.
+*
+*	dp::hedge runs a single function, and runs it a second time as a backup only if the first has not answered within the given delay.
+*	The delay is kept by a timer_service shared by every hedge, so no thread is started for the backup unless the delay runs out first.
+*	The timer has a resolution of one millisecond, and the delay is rounded up to it.
+*/
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <exception>
+#include <future>
+#include <memory>
+#include <optional>
+#include <type_traits>
+#include <utility>
+
+#include "future.h"
+#include "jthread.h"
+#include "stop_token.h"
+#include "this_thread.h"
+#include "timer_service.h"
+
+namespace dp {
+
+	template<typename T>
+	struct when_any_result {
+		std::size_t index;
+		T value;
+	};
+
+	template<>
+	struct when_any_result<void> {
+		std::size_t index;
+	};
+
+	namespace detail {
+
+		template<typename T, std::size_t N>
+		class when_any_state : public future_state<when_any_result<T>> {
+			std::atomic<bool> m_claimed{ false };
+			std::atomic<bool> m_failed{ false };
+			std::atomic<std::size_t> m_remaining{ N };
+			//Written only by the first task to fail, and read only by the last task to finish
+			std::exception_ptr m_first_error{};
+
+		public:
+			std::array<dp::stop_source, N> m_children{};
+
+			void request_stop() noexcept override {
+				future_state_base::request_stop();
+				stop_children();
+			}
+
+			void stop_children() noexcept {
+				for (dp::stop_source& child : m_children) {
+					child.request_stop();
+				}
+			}
+
+			bool claimed() const noexcept {
+				return m_claimed.load(std::memory_order_acquire);
+			}
+
+			//The result is published before the losers are stopped, so that the caller hears as early as possible
+			void succeed(when_any_result<T>&& result) noexcept {
+				if (m_claimed.exchange(true, std::memory_order_acq_rel)) {
+					return;
+				}
+				try {
+					this->set_value(std::move(result));
+				}
+				catch (...) {
+					this->set_exception(std::current_exception());
+				}
+				stop_children();
+			}
+
+			void fail(std::exception_ptr error) noexcept {
+				if (!m_failed.exchange(true, std::memory_order_acq_rel)) {
+					m_first_error = std::move(error);
+				}
+			}
+
+			void task_done() noexcept {
+				if (m_remaining.fetch_sub(1, std::memory_order_acq_rel) == 1 && !m_claimed.exchange(true, std::memory_order_acq_rel)) {
+					this->set_exception(m_first_error);
+				}
+			}
+		};
+
+		//As with task_runner, a runner destroyed without having run counts as a task which failed with a broken promise
+		template<typename T, std::size_t N, typename Func>
+		class when_any_runner {
+			std::shared_ptr<when_any_state<T, N>> m_state;
+			std::size_t m_index;
+			Func m_func;
+
+		public:
+			template<typename F>
+			when_any_runner(std::shared_ptr<when_any_state<T, N>> state, std::size_t index, F&& func)
+				: m_state{ std::move(state) }, m_index{ index }, m_func{ std::forward<F>(func) } {}
+			when_any_runner(when_any_runner&&) = default;
+			when_any_runner& operator=(when_any_runner&&) = delete;
+
+			~when_any_runner() {
+				if (m_state) {
+					m_state->fail(std::make_exception_ptr(std::future_error{ std::future_errc::broken_promise }));
+					m_state->task_done();
+				}
+			}
+
+			void operator()() {
+				const std::shared_ptr<when_any_state<T, N>> state{ std::move(m_state) };
+				if (!state->claimed()) {
+					const dp::stop_token token{ state->m_children[m_index].get_token() };
+					detail::thread_stop_scope scope{ token };
+					try {
+						if constexpr (std::is_void_v<T>) {
+							invoke(token);
+							state->succeed(when_any_result<void>{ m_index });
+						}
+						else {
+							state->succeed(when_any_result<T>{ m_index, static_cast<T>(invoke(token)) });
+						}
+					}
+					catch (...) {
+						state->fail(std::current_exception());
+					}
+				}
+				state->task_done();
+			}
+
+		private:
+			decltype(auto) invoke(const dp::stop_token& token) {
+				if constexpr (std::is_invocable_v<Func, dp::stop_token>) {
+					return std::invoke(std::move(m_func), token);
+				}
+				else {
+					return std::invoke(std::move(m_func));
+				}
+			}
+		};
+
+		template<typename... Tasks>
+		using when_any_value_t = std::common_type_t<async_result_t<std::decay_t<Tasks>>...>;
+
+		template<typename... Tasks>
+		struct first_is_executor : std::false_type {};
+		template<typename First, typename... Rest>
+		struct first_is_executor<First, Rest...> : is_executor<std::decay_t<First>> {};
+
+		template<typename T, std::size_t N, typename Launch, typename Task>
+		void launch_when_any(Launch& launch, const std::shared_ptr<when_any_state<T, N>>& state, std::size_t index, Task&& task) {
+			std::optional<when_any_runner<T, N, std::decay_t<Task>>> runner{};
+			try {
+				runner.emplace(state, index, std::forward<Task>(task));
+			}
+			catch (...) {
+				state->fail(std::current_exception());
+				state->task_done();
+				throw;
+			}
+			launch(std::move(*runner));
+		}
+
+		template<typename Launch, typename... Tasks>
+		auto start_when_any(Launch launch, Tasks&&... tasks) {
+			using value = when_any_value_t<Tasks...>;
+			constexpr std::size_t count{ sizeof...(Tasks) };
+			auto state{ std::make_shared<when_any_state<value, count>>() };
+			dp::future<when_any_result<value>> fut{ future_access::make<when_any_result<value>>(state) };
+
+			//Tasks which never got started have to be counted off by hand, or the future would never become ready
+			std::size_t next{ 0 };
+			try {
+				(launch_when_any(launch, state, next++, std::forward<Tasks>(tasks)), ...);
+			}
+			catch (...) {
+				state->request_stop();
+				for (; next < count; ++next) {
+					state->task_done();
+				}
+				throw;
+			}
+			return fut;
+		}
+
+	}
+
+	template<typename... Tasks, std::enable_if_t<(sizeof...(Tasks) > 0) && !detail::first_is_executor<Tasks...>::value, int> = 0>
+	[[nodiscard]] auto when_any(Tasks&&... tasks) {
+		return detail::start_when_any([](auto&& runner) { dp::jthread{ std::move(runner) }.detach(); }, std::forward<Tasks>(tasks)...);
+	}
+
+	template<typename Executor, typename... Tasks, std::enable_if_t<(sizeof...(Tasks) > 0) && detail::is_executor<Executor>::value, int> = 0>
+	[[nodiscard]] auto when_any(Executor& executor, Tasks&&... tasks) {
+		return detail::start_when_any([&executor](auto&& runner) { executor.submit(std::move(runner)); }, std::forward<Tasks>(tasks)...);
+	}
+
+	namespace detail {
+		//Started on first use by dp::hedge
+		dp::timer_service& hedge_timers();
+	}
+
+	//func is copied for the backup, so must be copyable
+	template<typename Func, typename Rep, typename Period>
+	[[nodiscard]] auto hedge(Func&& func, const std::chrono::duration<Rep, Period>& delay) {
+		using value = detail::async_result_t<std::decay_t<Func>>;
+		using runner = detail::when_any_runner<value, 2, std::decay_t<Func>>;
+		auto state{ std::make_shared<detail::when_any_state<value, 2>>() };
+		//std::function needs a copyable task, so the backup is shared with the timer rather than moved into it
+		auto backup{ std::make_shared<runner>(state, 1, func) };
+		dp::future<when_any_result<value>> fut{ detail::future_access::make<when_any_result<value>>(state) };
+
+		try {
+			auto launch{ [](auto&& primary) { dp::jthread{ std::move(primary) }.detach(); } };
+			detail::launch_when_any(launch, state, 0, std::forward<Func>(func));
+			//The backup's token is stopped as soon as the primary succeeds, after which the timer drops the backup unrun
+			detail::hedge_timers().schedule_after(std::chrono::ceil<dp::timer_service::clock::duration>(delay), [backup] {
+				try {
+					dp::jthread{ std::move(*backup) }.detach();
+				}
+				catch (...) {
+					//Whichever copy of the backup is left over counts itself as failed when it is destroyed
+				}
+				}, state->m_children[1].get_token());
+		}
+		catch (...) {
+			state->request_stop();
+			backup.reset();
+			throw;
+		}
+
+		return std::move(fut).then([](when_any_result<value> result) -> value {
+			if constexpr (!std::is_void_v<value>) {
+				return std::move(result.value);
+			}
+			});
+	}
+
+}
+
+#endif
@@ -1,17 +1,320 @@
 #include "condition_variable.h"
 
+#include <algorithm>
+#include <limits>
+
 
 namespace dp {
 
 
+	namespace {
+		//Marks a condition variable whose waiters have used more than one lock, and so can never be requeued
+		const std::atomic<std::uint32_t> mixed_requeue_targets{ 0 };
+	}
+
+	//A waiter registers itself before releasing the user's lock, so any notify which follows a change to the shared state
+	//is guaranteed to see it. If nobody is registered there is nobody who could miss this notify, and it can be a single load.
+	//Stop callbacks don't hold the user's lock, but the stop flag and the waiter count are both sequentially consistent
+	//so either we see the waiter or the waiter sees the stop.
+	//Waiters requeued onto the mutex are only released as it is unlocked, and our destroyer may be holding it.
+	//Waking the mutex's sleepers lets them finish with us and then go back to waiting on the mutex itself, which copes with spurious wakes.
+	//The mutex must still exist, as every thread still counted as waiting on us used it.
+	condition_variable_any::~condition_variable_any() {
+		while (m_waiters.load(std::memory_order_acquire) != 0) {
+			if (m_policy.requeue) {
+				const std::atomic<std::uint32_t>* target{ m_requeue_target.load(std::memory_order_acquire) };
+				if (target && target != &mixed_requeue_targets) {
+					detail::futex_wake_all(*target);
+				}
+			}
+			std::this_thread::yield();
+		}
+	}
+
+	bool condition_variable_any::has_waiters() const noexcept {
+		return m_waiters.load(std::memory_order_seq_cst) != 0;
+	}
+
+	void condition_variable_any::stop_hook::invoke(detail::stop_callback_node* node) noexcept {
+		static_cast<stop_hook*>(node)->m_cv->notify_all();
+	}
+
+	condition_variable_any::stop_registration::~stop_registration() {
+		detach();
+	}
+
+	void condition_variable_any::stop_registration::attach() {
+		//A token with no state can never be stopped, so there's nothing to be woken by
+		if (!m_state || m_hook || m_own_callback) {
+			return;
+		}
+		//A hook which is busy might be about to watch our stop state, but we can't wait for it without a lock. Two waiters racing to set up
+		//hooks for the same stop state may each take one, which costs an extra broadcast on stop but nothing more.
+		for (auto& hook : m_cv.m_hooks) {
+			std::uint64_t word{ hook.m_word.load(std::memory_order_acquire) };
+			while ((word & stop_hook::users_mask) != 0 && !(word & stop_hook::busy_bit) && hook.m_key.load(std::memory_order_relaxed) == m_state.get()) {
+				if (hook.m_word.compare_exchange_weak(word, word + 1, std::memory_order_acquire, std::memory_order_acquire)) {
+					m_hook = &hook;
+					return;
+				}
+			}
+		}
+		for (auto& hook : m_cv.m_hooks) {
+			std::uint64_t word{ hook.m_word.load(std::memory_order_relaxed) };
+			if ((word & (stop_hook::users_mask | stop_hook::busy_bit)) != 0) {
+				continue;
+			}
+			const std::uint64_t claimed{ ((word & ~(stop_hook::users_mask | stop_hook::busy_bit)) + stop_hook::generation_unit) | stop_hook::busy_bit };
+			if (!hook.m_word.compare_exchange_strong(word, claimed, std::memory_order_acquire, std::memory_order_relaxed)) {
+				continue;
+			}
+			//If the stop has already been requested the hook won't be linked, but that's fine - we check for the stop
+			//before every wait so it would never have anything to wake.
+			hook.m_state = m_state;
+			hook.m_key.store(m_state.get(), std::memory_order_relaxed);
+			hook.m_registered = m_state->register_callback(&hook);
+			hook.m_word.store((claimed & ~stop_hook::busy_bit) | 1, std::memory_order_release);
+			m_hook = &hook;
+			return;
+		}
+		m_own_callback.emplace(m_token, broadcast{ &m_cv });
+	}
+
+	void condition_variable_any::stop_registration::detach() noexcept {
+		m_own_callback.reset();
+		if (!m_hook) {
+			return;
+		}
+		stop_hook& hook{ *std::exchange(m_hook, nullptr) };
+		std::uint64_t word{ hook.m_word.load(std::memory_order_relaxed) };
+		for (;;) {
+			if ((word & stop_hook::users_mask) > 1) {
+				if (hook.m_word.compare_exchange_weak(word, word - 1, std::memory_order_release, std::memory_order_relaxed)) {
+					return;
+				}
+			}
+			else if (hook.m_word.compare_exchange_weak(word, (word - 1) | stop_hook::busy_bit, std::memory_order_acq_rel, std::memory_order_relaxed)) {
+				break;
+			}
+		}
+		//We were the last user. The hook's callback only ever notifies, so it's safe to wait for a running one to finish.
+		if (hook.m_registered) {
+			hook.m_state->deregister_callback(&hook);
+			hook.m_registered = false;
+		}
+		hook.m_key.store(nullptr, std::memory_order_relaxed);
+		hook.m_state.reset();
+		hook.m_word.store(word - 1, std::memory_order_release);
+	}
+
+	void condition_variable_any::begin_wait(waiter& w) noexcept {
+		m_waiters.fetch_add(1, std::memory_order_seq_cst);
+		if (!m_policy.fair) {
+			w.m_seq = m_seq.load(std::memory_order_seq_cst);
+			return;
+		}
+		std::lock_guard lck{ m_queue_mut };
+		w.m_prev = m_tail;
+		if (m_tail) {
+			m_tail->m_next = &w;
+		}
+		else {
+			m_head = &w;
+		}
+		m_tail = &w;
+	}
+
+	//Sequentially consistent so that a notify which reads the target after advancing the sequence can't miss a change
+	//made by a waiter before it took its snapshot of that sequence.
+	void condition_variable_any::note_requeue_target(const std::atomic<std::uint32_t>* word) noexcept {
+		const std::atomic<std::uint32_t>* current{ m_requeue_target.load(std::memory_order_relaxed) };
+		if (current == word && word) {
+			return;
+		}
+		if (!current && word && m_requeue_target.compare_exchange_strong(current, word, std::memory_order_seq_cst)) {
+			return;
+		}
+		if (current != word || !word) {
+			m_requeue_target.store(&mixed_requeue_targets, std::memory_order_seq_cst);
+		}
+	}
+
+	void condition_variable_any::end_wait(waiter& w) noexcept {
+		//A fair waiter leaving without being signalled (a timeout, or a stop) must take itself out of the queue.
+		//Signalling happens under the queue lock, so once we hold it we know whether we're still queued.
+		if (m_policy.fair && w.m_state.load(std::memory_order_acquire) != waiter::signalled) {
+			std::lock_guard lck{ m_queue_mut };
+			if (w.m_state.load(std::memory_order_relaxed) != waiter::signalled) {
+				(w.m_prev ? w.m_prev->m_next : m_head) = w.m_next;
+				(w.m_next ? w.m_next->m_prev : m_tail) = w.m_prev;
+			}
+		}
+		m_waiters.fetch_sub(1, std::memory_order_release);
+	}
+
+	//Spinning which pays off doubles the budget for next time, and spinning which doesn't halves it.
+	//The floor ensures an adaptive waiter can always notice when the notification pattern changes.
+	bool condition_variable_any::spin(const std::atomic<std::uint32_t>& word, std::uint32_t expected) noexcept {
+		//On a single CPU the notifying thread can't run while we spin, so spinning only ever delays it
+		static const bool single_cpu{ std::thread::hardware_concurrency() <= 1 };
+		if (!m_policy.spin || single_cpu) {
+			return false;
+		}
+		constexpr std::uint32_t min_adaptive_spins{ 16 };
+		const std::uint32_t budget{ m_policy.adaptive ? m_spin_budget.load(std::memory_order_relaxed) : m_policy.max_spins };
+		for (std::uint32_t i = 0; i < budget; ++i) {
+			if (word.load(std::memory_order_acquire) != expected) {
+				if (m_policy.adaptive) {
+					m_spin_budget.store(std::min(m_policy.max_spins, std::max(budget, min_adaptive_spins) * 2), std::memory_order_relaxed);
+				}
+				return true;
+			}
+			detail::cpu_relax();
+		}
+		if (m_policy.adaptive) {
+			m_spin_budget.store(std::max(std::min(min_adaptive_spins, m_policy.max_spins), budget / 2), std::memory_order_relaxed);
+		}
+		return false;
+	}
+
+	//Only a waiter which slept through a requeueing notify_all() can be on the mutex's queue. Anyone else relocks normally,
+	//so that the unlocks which follow a notify_one() don't all pay for a futex wake.
+	void condition_variable_any::note_requeued(waiter& w) noexcept {
+		if (m_policy.requeue) {
+			w.m_requeued = static_cast<std::int32_t>(m_requeue_seq.load(std::memory_order_seq_cst) - w.m_seq) > 0;
+		}
+	}
+
+	//Published before the requeue, so that anyone it moves sees it on waking. Racing notifiers must not move the value backwards,
+	//or a waiter moved by the later one would relock uncontended and strand the rest of the chain.
+	void condition_variable_any::publish_requeue(std::uint32_t seq) noexcept {
+		std::uint32_t current{ m_requeue_seq.load(std::memory_order_relaxed) };
+		while (static_cast<std::int32_t>(seq - current) > 0 && !m_requeue_seq.compare_exchange_weak(current, seq, std::memory_order_seq_cst)) {}
+	}
+
+	//Registering as a sleeper before the futex wait pairs with notify changing the word before checking for sleepers.
+	//Either the notify sees us, or the kernel sees the new value and doesn't put us to sleep.
+	//A sleeper which a counted wake took off the queue has already been uncounted by its waker. Otherwise a notifier
+	//could see it as still asleep until it next ran, and make a pointless syscall for every notify in between.
+	//A fair waiter announces that it is sleeping through its own state, which the notifier exchanges when signalling.
+	void condition_variable_any::park(waiter& w) noexcept {
+		if (!m_policy.fair) {
+			if (spin(m_seq, w.m_seq)) {
+				return;
+			}
+			m_sleepers.fetch_add(1, std::memory_order_seq_cst);
+			if (!detail::futex_wait(m_seq, w.m_seq)) {
+				m_sleepers.fetch_sub(1, std::memory_order_relaxed);
+			}
+			note_requeued(w);
+			return;
+		}
+		if (spin(w.m_state, waiter::spinning)) {
+			return;
+		}
+		std::uint32_t expected{ waiter::spinning };
+		w.m_state.compare_exchange_strong(expected, waiter::sleeping, std::memory_order_seq_cst);
+		while (w.m_state.load(std::memory_order_acquire) != waiter::signalled) {
+			detail::futex_wait(w.m_state, waiter::sleeping);
+		}
+	}
+
+	void condition_variable_any::park_for(waiter& w, std::chrono::nanoseconds rel_time) noexcept {
+		if (!m_policy.fair) {
+			if (spin(m_seq, w.m_seq)) {
+				return;
+			}
+			m_sleepers.fetch_add(1, std::memory_order_seq_cst);
+			if (detail::futex_wait_outcome(m_seq, w.m_seq, rel_time) != detail::wait_outcome::woken) {
+				m_sleepers.fetch_sub(1, std::memory_order_relaxed);
+			}
+			note_requeued(w);
+			return;
+		}
+		if (spin(w.m_state, waiter::spinning)) {
+			return;
+		}
+		//A spurious return here just looks like an early timeout, which end_wait() and our callers already cope with
+		std::uint32_t expected{ waiter::spinning };
+		if (w.m_state.compare_exchange_strong(expected, waiter::sleeping, std::memory_order_seq_cst)) {
+			detail::futex_wait_for(w.m_state, waiter::sleeping, rel_time);
+		}
+	}
+
+	//The waiter may return and destroy its node the instant it sees the signal, so we read everything we need from the node first.
+	//The futex wake itself only uses the address as a key and never touches the memory behind it.
+	void condition_variable_any::signal_queued(std::size_t count) noexcept {
+		std::lock_guard lck{ m_queue_mut };
+		while (count-- != 0 && m_head) {
+			waiter* const node{ m_head };
+			m_head = node->m_next;
+			if (m_head) {
+				m_head->m_prev = nullptr;
+			}
+			else {
+				m_tail = nullptr;
+			}
+			const std::atomic<std::uint32_t>& word{ node->m_state };
+			if (node->m_state.exchange(waiter::signalled, std::memory_order_seq_cst) == waiter::sleeping) {
+				detail::futex_wake_one(word);
+			}
+		}
+	}
+
 	void condition_variable_any::notify_one() noexcept {
-		std::lock_guard lck{ *m_mut };
-		m_cond.notify_one();
+		notify_n(1);
 	}
 
 	void condition_variable_any::notify_all() noexcept {
-		std::lock_guard lck{ *m_mut };
-		m_cond.notify_all();
+		if (!has_waiters()) {
+			return;
+		}
+		if (m_policy.fair) {
+			signal_queued(std::numeric_limits<std::size_t>::max());
+			return;
+		}
+		const std::uint32_t seq{ m_seq.fetch_add(1, std::memory_order_seq_cst) + 1 };
+		if (m_sleepers.load(std::memory_order_seq_cst) == 0) {
+			return;
+		}
+		//Wake a single thread and move the rest onto the mutex. Each such thread relocks the mutex as contended, so every unlock
+		//along the chain releases the next. If the sequence has moved on since our bump the requeue fails and we wake everyone.
+		if (m_policy.requeue) {
+			const std::atomic<std::uint32_t>* target{ m_requeue_target.load(std::memory_order_seq_cst) };
+			if (target && target != &mixed_requeue_targets) {
+				publish_requeue(seq);
+				if (const auto moved{ detail::futex_requeue(m_seq, seq, *target, 1) }) {
+					uncount_sleepers(*moved);
+					return;
+				}
+			}
+		}
+		uncount_sleepers(detail::futex_wake_all(m_seq));
+	}
+
+	void condition_variable_any::notify_n(std::size_t count) noexcept {
+		if (count == 0 || !has_waiters()) {
+			return;
+		}
+		if (m_policy.fair) {
+			signal_queued(count);
+			return;
+		}
+		m_seq.fetch_add(1, std::memory_order_seq_cst);
+		if (m_sleepers.load(std::memory_order_seq_cst) != 0) {
+			if (count == 1) {
+				uncount_sleepers(detail::futex_wake_one(m_seq));
+			}
+			else {
+				uncount_sleepers(detail::futex_wake_n(m_seq, static_cast<std::uint32_t>(std::min<std::size_t>(count, std::numeric_limits<std::uint32_t>::max()))));
+			}
+		}
+	}
+
+	void condition_variable_any::uncount_sleepers(std::uint32_t woken) noexcept {
+		if (woken != 0) {
+			m_sleepers.fetch_sub(woken, std::memory_order_relaxed);
+		}
 	}
 
 
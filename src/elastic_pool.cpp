@@ -0,0 +1,311 @@
+#include "elastic_pool.h"
+
+#include <algorithm>
+#include <mutex>
+#include <thread>
+
+namespace dp {
+
+	elastic_pool::elastic_pool() : elastic_pool(options{}) {}
+
+	elastic_pool::elastic_pool(options opts) : m_options{ std::move(opts) } {
+		m_options.min_threads = std::max<std::size_t>(m_options.min_threads, 1);
+		m_options.max_threads = std::max(m_options.max_threads, m_options.min_threads);
+
+		try {
+			for (std::size_t i = 0; i < m_options.min_threads; ++i) {
+				{
+					std::lock_guard lck{ m_mut };
+					++m_live;
+				}
+				std::list<worker> fresh{};
+				try {
+					fresh.splice(fresh.end(), start_worker());
+				}
+				catch (...) {
+					std::lock_guard lck{ m_mut };
+					--m_live;
+					throw;
+				}
+				std::lock_guard lck{ m_mut };
+				m_workers.splice(m_workers.end(), fresh);
+				m_peak = m_live;
+			}
+			if (m_options.max_threads > m_options.min_threads) {
+				m_monitor = dp::jthread{ [this] { monitor(m_pool_stop.get_token()); } };
+			}
+		}
+		catch (...) {
+			request_stop();
+			m_workers.clear();
+			throw;
+		}
+	}
+
+	elastic_pool::~elastic_pool() {
+		request_stop();
+		if (m_monitor.joinable()) {
+			m_monitor.join();
+		}
+
+		//A worker may be part-way through growing the pool, so keep going until nothing is left to join and nothing is being started
+		for (;;) {
+			std::list<worker> joining{};
+			{
+				std::lock_guard lck{ m_mut };
+				if (m_workers.empty() && m_starting == 0) {
+					break;
+				}
+				joining.splice(joining.end(), m_workers);
+			}
+			if (joining.empty()) {
+				std::this_thread::yield();
+			}
+		}
+
+		for (const queued_task& entry : m_queue) {
+			delete entry.m_task;
+		}
+	}
+
+	std::list<elastic_pool::worker> elastic_pool::start_worker() {
+		std::list<worker> fresh{};
+		worker& record{ fresh.emplace_back() };
+		record.m_thread = dp::jthread{ [this, &record] { run(record); } };
+		return fresh;
+	}
+
+	//Must hold m_mut
+	void elastic_pool::reap(std::list<worker>& into) noexcept {
+		for (auto it = m_workers.begin(); it != m_workers.end(); ) {
+			const auto next{ std::next(it) };
+			if (it->m_exited) {
+				into.splice(into.end(), m_workers, it);
+			}
+			it = next;
+		}
+	}
+
+	//Must hold m_mut. Queued work with no idle worker to take it, and room to grow.
+	bool elastic_pool::backlogged() const noexcept {
+		return !m_queue.empty() && m_idle == 0 && m_live < m_options.max_threads;
+	}
+
+	//Must hold m_mut. Returns true if the caller should wake the monitor once it has released the lock.
+	bool elastic_pool::arm_monitor() noexcept {
+		if (m_monitor_armed || !backlogged()) {
+			return false;
+		}
+		m_monitor_armed = true;
+		return true;
+	}
+
+	//Must hold m_mut
+	bool elastic_pool::should_grow(std::chrono::steady_clock::time_point now) const noexcept {
+		return m_idle == 0 && m_starting == 0 && m_live < m_options.max_threads && !m_queue.empty()
+			&& now - m_queue.front().m_enqueued >= m_options.latency_threshold && !m_pool_stop.stop_requested();
+	}
+
+	void elastic_pool::enqueue(detail::pool_task* task) {
+		const auto now{ std::chrono::steady_clock::now() };
+		bool wake{ false };
+		bool arm{ false };
+		bool grow_now{ false };
+		std::chrono::nanoseconds latency{};
+		{
+			std::lock_guard lck{ m_mut };
+			try {
+				m_queue.push_back(queued_task{ task, now });
+			}
+			catch (...) {
+				delete task;
+				throw;
+			}
+			wake = m_idle != 0;
+			arm = arm_monitor();
+			if (should_grow(now)) {
+				++m_starting;
+				++m_live;
+				grow_now = true;
+				latency = now - m_queue.front().m_enqueued;
+			}
+		}
+		if (wake) {
+			m_cv.notify_one();
+		}
+		if (arm) {
+			m_monitor_cv.notify_one();
+		}
+		if (grow_now) {
+			grow(latency);
+		}
+	}
+
+	//Called with m_starting and m_live already counting the new worker, so that only one thread grows the pool at a time
+	bool elastic_pool::grow(std::chrono::nanoseconds latency) noexcept {
+		std::list<worker> fresh{};
+		try {
+			fresh.splice(fresh.end(), start_worker());
+		}
+		catch (...) {}
+
+		std::list<worker> exited{};
+		std::size_t threads{ 0 };
+		const bool started{ !fresh.empty() && fresh.back().m_thread.joinable() };
+		{
+			std::lock_guard lck{ m_mut };
+			--m_starting;
+			if (started) {
+				//The pool may have been stopped while we were starting the thread, in which case it should leave straight away
+				if (m_pool_stop.stop_requested()) {
+					fresh.back().m_stop.request_stop();
+				}
+				m_workers.splice(m_workers.end(), fresh);
+				++m_grown;
+				m_peak = std::max(m_peak, m_live);
+			}
+			else {
+				--m_live;
+				++m_failed_grows;
+			}
+			reap(exited);
+			threads = m_live;
+		}
+		exited.clear();
+
+		if (started) {
+			notify_resize(resize_event{ resize_event::kind::grew, threads, latency });
+		}
+		return started;
+	}
+
+	//Sleeps until the oldest queued task would cross the threshold, then grows the pool if nothing else has.
+	//If the pool can't grow right then, because another thread is already starting a worker or a start has just failed,
+	//it looks again a threshold later rather than spinning.
+	void elastic_pool::monitor(const dp::stop_token& token) {
+		std::unique_lock lck{ m_mut };
+		while (!token.stop_requested()) {
+			m_monitor_armed = backlogged();
+			if (!m_monitor_armed) {
+				m_monitor_cv.wait(lck, token, [this] { return m_monitor_armed || backlogged(); });
+				continue;
+			}
+
+			const auto now{ std::chrono::steady_clock::now() };
+			auto recheck{ m_queue.front().m_enqueued + m_options.latency_threshold };
+			if (should_grow(now)) {
+				++m_starting;
+				++m_live;
+				const std::chrono::nanoseconds latency{ now - m_queue.front().m_enqueued };
+				lck.unlock();
+				const bool started{ grow(latency) };
+				lck.lock();
+				if (started) {
+					continue;
+				}
+				recheck = now;
+			}
+			if (recheck <= now) {
+				recheck = now + m_options.latency_threshold;
+			}
+			m_monitor_cv.wait_until(lck, token, recheck, [] { return false; });
+		}
+	}
+
+	void elastic_pool::run(worker& self) {
+		const dp::stop_token own{ self.m_stop.get_token() };
+		const dp::stop_token pool_token{ m_pool_stop.get_token() };
+		detail::thread_stop_scope scope{ pool_token };
+
+		bool retired{ false };
+		std::unique_lock lck{ m_mut };
+		while (!own.stop_requested()) {
+			if (m_queue.empty()) {
+				++m_idle;
+				const bool woken{ m_cv.wait_until(lck, own, std::chrono::steady_clock::now() + m_options.linger, [this] { return !m_queue.empty(); }) };
+				--m_idle;
+				if (!woken) {
+					if (!own.stop_requested() && m_live > m_options.min_threads) {
+						self.m_stop.request_stop();
+						retired = true;
+					}
+					continue;
+				}
+			}
+
+			const queued_task next{ m_queue.front() };
+			m_queue.pop_front();
+
+			const auto now{ std::chrono::steady_clock::now() };
+			const bool arm{ arm_monitor() };
+			bool grow_now{ false };
+			std::chrono::nanoseconds latency{};
+			if (should_grow(now)) {
+				++m_starting;
+				++m_live;
+				grow_now = true;
+				latency = now - m_queue.front().m_enqueued;
+			}
+			lck.unlock();
+
+			if (arm) {
+				m_monitor_cv.notify_one();
+			}
+			if (grow_now) {
+				grow(latency);
+			}
+			{
+				std::unique_ptr<detail::pool_task> owned{ next.m_task };
+				if (!pool_token.stop_requested()) {
+					owned->run(pool_token);
+				}
+			}
+			lck.lock();
+		}
+
+		--m_live;
+		if (retired) {
+			++m_retired;
+		}
+		self.m_exited = true;
+		const std::size_t threads{ m_live };
+		lck.unlock();
+
+		if (retired) {
+			notify_resize(resize_event{ resize_event::kind::retired, threads, std::chrono::nanoseconds::zero() });
+		}
+	}
+
+	void elastic_pool::notify_resize(const resize_event& event) noexcept {
+		if (m_options.on_resize) {
+			try {
+				m_options.on_resize(event);
+			}
+			catch (...) {}
+		}
+	}
+
+	std::size_t elastic_pool::size() const {
+		std::lock_guard lck{ m_mut };
+		return m_live;
+	}
+
+	elastic_pool::stats elastic_pool::get_stats() const {
+		std::lock_guard lck{ m_mut };
+		return stats{ m_live, m_peak, m_queue.size(), m_grown, m_retired, m_failed_grows };
+	}
+
+	bool elastic_pool::request_stop() noexcept {
+		const bool stopped{ m_pool_stop.request_stop() };
+		std::lock_guard lck{ m_mut };
+		for (worker& record : m_workers) {
+			record.m_stop.request_stop();
+		}
+		return stopped;
+	}
+
+	dp::stop_token elastic_pool::get_stop_token() const noexcept {
+		return m_pool_stop.get_token();
+	}
+
+}
@@ -0,0 +1,194 @@
+#include "futex.h"
+
+#include <climits>
+
+#if defined(__linux__)
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <cerrno>
+#include <ctime>
+#elif defined(_WIN32)
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>
+#pragma comment(lib, "Synchronization.lib")
+#else
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#endif
+
+namespace dp::detail {
+
+#if defined(__linux__)
+
+	//std::atomic<std::uint32_t> is guaranteed lock free and layout-compatible with the 32-bit word the kernel expects
+	static_assert(sizeof(std::atomic<std::uint32_t>) == sizeof(std::uint32_t), "Futex word must be exactly 32 bits");
+
+	namespace {
+		long futex(const std::atomic<std::uint32_t>& word, int op, std::uint32_t val, const timespec* timeout) noexcept {
+			return syscall(SYS_futex, const_cast<std::atomic<std::uint32_t>*>(&word), op, val, timeout, nullptr, 0);
+		}
+
+		std::uint32_t woken_count(long result) noexcept {
+			return result > 0 ? static_cast<std::uint32_t>(result) : 0;
+		}
+	}
+
+	//The kernel retries spurious wakeups itself, and only returns zero once a wake or requeue has taken us off the queue
+	bool futex_wait(const std::atomic<std::uint32_t>& word, std::uint32_t expected) noexcept {
+		return futex(word, FUTEX_WAIT_PRIVATE, expected, nullptr) == 0;
+	}
+
+	bool futex_wait_for(const std::atomic<std::uint32_t>& word, std::uint32_t expected, std::chrono::nanoseconds rel_time) noexcept {
+		return futex_wait_outcome(word, expected, rel_time) != wait_outcome::timed_out;
+	}
+
+	wait_outcome futex_wait_outcome(const std::atomic<std::uint32_t>& word, std::uint32_t expected, std::chrono::nanoseconds rel_time) noexcept {
+		if (rel_time <= std::chrono::nanoseconds::zero()) {
+			return wait_outcome::timed_out;
+		}
+		const auto secs{ std::chrono::duration_cast<std::chrono::seconds>(rel_time) };
+		timespec ts{};
+		ts.tv_sec = static_cast<std::time_t>(secs.count());
+		ts.tv_nsec = static_cast<long>((rel_time - secs).count());
+		if (futex(word, FUTEX_WAIT_PRIVATE, expected, &ts) == 0) {
+			return wait_outcome::woken;
+		}
+		return errno == ETIMEDOUT ? wait_outcome::timed_out : wait_outcome::other;
+	}
+
+	std::uint32_t futex_wake_one(const std::atomic<std::uint32_t>& word) noexcept {
+		return woken_count(futex(word, FUTEX_WAKE_PRIVATE, 1, nullptr));
+	}
+
+	std::uint32_t futex_wake_n(const std::atomic<std::uint32_t>& word, std::uint32_t count) noexcept {
+		return woken_count(futex(word, FUTEX_WAKE_PRIVATE, count > INT_MAX ? INT_MAX : count, nullptr));
+	}
+
+	std::uint32_t futex_wake_all(const std::atomic<std::uint32_t>& word) noexcept {
+		return woken_count(futex(word, FUTEX_WAKE_PRIVATE, INT_MAX, nullptr));
+	}
+
+	std::optional<std::uint32_t> futex_requeue(const std::atomic<std::uint32_t>& word, std::uint32_t expected, const std::atomic<std::uint32_t>& target, std::uint32_t wake_count) noexcept {
+		//The kernel takes the maximum number of threads to requeue in the timeout argument's slot
+		const long result{ syscall(SYS_futex, const_cast<std::atomic<std::uint32_t>*>(&word), FUTEX_CMP_REQUEUE_PRIVATE, wake_count,
+			reinterpret_cast<const timespec*>(static_cast<std::uintptr_t>(INT_MAX)), const_cast<std::atomic<std::uint32_t>*>(&target), expected) };
+		if (result == -1) {
+			return std::nullopt;
+		}
+		return woken_count(result);
+	}
+
+#elif defined(_WIN32)
+
+	//WaitOnAddress can't tell a wake from a spurious return, and the wakes don't report who they woke
+	bool futex_wait(const std::atomic<std::uint32_t>& word, std::uint32_t expected) noexcept {
+		WaitOnAddress(const_cast<std::atomic<std::uint32_t>*>(&word), &expected, sizeof(expected), INFINITE);
+		return false;
+	}
+
+	bool futex_wait_for(const std::atomic<std::uint32_t>& word, std::uint32_t expected, std::chrono::nanoseconds rel_time) noexcept {
+		return futex_wait_outcome(word, expected, rel_time) != wait_outcome::timed_out;
+	}
+
+	wait_outcome futex_wait_outcome(const std::atomic<std::uint32_t>& word, std::uint32_t expected, std::chrono::nanoseconds rel_time) noexcept {
+		if (rel_time <= std::chrono::nanoseconds::zero()) {
+			return wait_outcome::timed_out;
+		}
+		const auto ms{ std::chrono::ceil<std::chrono::milliseconds>(rel_time) };
+		if (WaitOnAddress(const_cast<std::atomic<std::uint32_t>*>(&word), &expected, sizeof(expected), static_cast<DWORD>(ms.count()))
+			|| GetLastError() != ERROR_TIMEOUT) {
+			return wait_outcome::other;
+		}
+		return wait_outcome::timed_out;
+	}
+
+	std::uint32_t futex_wake_one(const std::atomic<std::uint32_t>& word) noexcept {
+		WakeByAddressSingle(const_cast<std::atomic<std::uint32_t>*>(&word));
+		return 0;
+	}
+
+	std::uint32_t futex_wake_n(const std::atomic<std::uint32_t>& word, std::uint32_t count) noexcept {
+		for (std::uint32_t i = 0; i < count; ++i) {
+			WakeByAddressSingle(const_cast<std::atomic<std::uint32_t>*>(&word));
+		}
+		return 0;
+	}
+
+	std::uint32_t futex_wake_all(const std::atomic<std::uint32_t>& word) noexcept {
+		WakeByAddressAll(const_cast<std::atomic<std::uint32_t>*>(&word));
+		return 0;
+	}
+
+	std::optional<std::uint32_t> futex_requeue(const std::atomic<std::uint32_t>&, std::uint32_t, const std::atomic<std::uint32_t>&, std::uint32_t) noexcept {
+		return std::nullopt;
+	}
+
+#else
+
+	//Without a native primitive we emulate one with a fixed table of buckets. Unrelated words may share a bucket,
+	//so every wake must notify all of the bucket's waiters and let them re-check their own word.
+	namespace {
+		struct bucket {
+			std::mutex mut;
+			std::condition_variable cond;
+		};
+
+		bucket& bucket_for(const void* addr) noexcept {
+			static bucket buckets[64];
+			return buckets[std::hash<const void*>{}(addr) % 64];
+		}
+	}
+
+	//Every wake wakes the whole bucket, so no wait can say which wake it was and no wake counts anyone
+	bool futex_wait(const std::atomic<std::uint32_t>& word, std::uint32_t expected) noexcept {
+		auto& b{ bucket_for(&word) };
+		std::unique_lock lck{ b.mut };
+		//Sequentially consistent to match the kernel's barrier, which callers rely on when they track sleeping threads themselves
+		if (word.load(std::memory_order_seq_cst) == expected) {
+			b.cond.wait(lck);
+		}
+		return false;
+	}
+
+	bool futex_wait_for(const std::atomic<std::uint32_t>& word, std::uint32_t expected, std::chrono::nanoseconds rel_time) noexcept {
+		return futex_wait_outcome(word, expected, rel_time) != wait_outcome::timed_out;
+	}
+
+	wait_outcome futex_wait_outcome(const std::atomic<std::uint32_t>& word, std::uint32_t expected, std::chrono::nanoseconds rel_time) noexcept {
+		if (rel_time <= std::chrono::nanoseconds::zero()) {
+			return wait_outcome::timed_out;
+		}
+		auto& b{ bucket_for(&word) };
+		std::unique_lock lck{ b.mut };
+		if (word.load(std::memory_order_seq_cst) != expected) {
+			return wait_outcome::other;
+		}
+		return b.cond.wait_for(lck, rel_time) == std::cv_status::no_timeout ? wait_outcome::other : wait_outcome::timed_out;
+	}
+
+	std::uint32_t futex_wake_one(const std::atomic<std::uint32_t>& word) noexcept {
+		return futex_wake_all(word);
+	}
+
+	std::uint32_t futex_wake_n(const std::atomic<std::uint32_t>& word, std::uint32_t) noexcept {
+		return futex_wake_all(word);
+	}
+
+	std::uint32_t futex_wake_all(const std::atomic<std::uint32_t>& word) noexcept {
+		auto& b{ bucket_for(&word) };
+		std::lock_guard lck{ b.mut };
+		b.cond.notify_all();
+		return 0;
+	}
+
+	std::optional<std::uint32_t> futex_requeue(const std::atomic<std::uint32_t>&, std::uint32_t, const std::atomic<std::uint32_t>&, std::uint32_t) noexcept {
+		return std::nullopt;
+	}
+
+#endif
+
+}
@@ -0,0 +1,121 @@
+#include "future.h"
+
+namespace dp::detail {
+
+	void future_state_base::on_predecessor_ready(future_state_base&, const std::shared_ptr<future_state_base>&) noexcept {}
+
+	//Closes the door on continuations before anyone can see the result, so that then() on a future already seen to be ready always runs inline
+	void future_state_base::finish() noexcept {
+		const bool chained{ m_continuation_state.exchange(finished, std::memory_order_acq_rel) == continuation_set };
+		m_word.fetch_or(1, std::memory_order_acq_rel);
+		futex_wake_all(m_word);
+
+		if (chained) {
+			const std::shared_ptr<future_state_base> next{ std::move(m_continuation) };
+			next->on_predecessor_ready(*this, next);
+		}
+	}
+
+	void future_state_base::set_exception(std::exception_ptr error) noexcept {
+		m_error = std::move(error);
+		finish();
+	}
+
+	void future_state_base::set_cancelled() noexcept {
+		try {
+			m_error = std::make_exception_ptr(std::system_error{ std::make_error_code(std::errc::operation_canceled), "Task was cancelled before it started" });
+		}
+		catch (...) {
+			m_error = std::current_exception();
+		}
+		finish();
+	}
+
+	void future_state_base::request_stop() noexcept {
+		m_stop.request_stop();
+		if (m_predecessor) {
+			m_predecessor->request_stop();
+		}
+	}
+
+	//next is published by the CAS; if the predecessor has finished first, the continuation runs here and now
+	void future_state_base::add_continuation(std::shared_ptr<future_state_base> next) noexcept {
+		m_continuation = next;
+		std::uint32_t expected{ no_continuation };
+		if (!m_continuation_state.compare_exchange_strong(expected, continuation_set, std::memory_order_acq_rel, std::memory_order_acquire)) {
+			m_continuation.reset();
+			next->on_predecessor_ready(*this, next);
+		}
+	}
+
+	void future_state_base::poke() noexcept {
+		m_word.fetch_add(2, std::memory_order_release);
+		futex_wake_all(m_word);
+	}
+
+	void future_state_base::wait() noexcept {
+		for (;;) {
+			const std::uint32_t word{ m_word.load(std::memory_order_acquire) };
+			if (word & 1) {
+				return;
+			}
+			futex_wait(m_word, word);
+		}
+	}
+
+	bool future_state_base::wait_for(std::chrono::nanoseconds rel_time) noexcept {
+		const auto end_time{ std::chrono::steady_clock::now() + rel_time };
+		for (;;) {
+			const std::uint32_t word{ m_word.load(std::memory_order_acquire) };
+			if (word & 1) {
+				return true;
+			}
+			if (!futex_wait_for(m_word, word, time_until(end_time)) && std::chrono::steady_clock::now() >= end_time) {
+				return ready();
+			}
+		}
+	}
+
+	bool future_state_base::wait(const dp::stop_token& token) noexcept {
+		while (!wait_for(token, std::chrono::hours{ 24 })) {
+			if (token.stop_requested()) {
+				return false;
+			}
+		}
+		return true;
+	}
+
+	bool future_state_base::wait_for(const dp::stop_token& token, std::chrono::nanoseconds rel_time) noexcept {
+		//Registered for the duration of the wait, so that a stop request moves the word on and wakes us
+		struct stop_poker {
+			future_state_base* m_state;
+			void operator()() const noexcept {
+				m_state->poke();
+			}
+		};
+		const dp::stop_callback<stop_poker> callback{ token, stop_poker{ this } };
+
+		const auto end_time{ std::chrono::steady_clock::now() + rel_time };
+		for (;;) {
+			const std::uint32_t word{ m_word.load(std::memory_order_acquire) };
+			if (word & 1) {
+				return true;
+			}
+			if (token.stop_requested()) {
+				return false;
+			}
+			if (!futex_wait_for(m_word, word, time_until(end_time)) && std::chrono::steady_clock::now() >= end_time) {
+				return ready();
+			}
+		}
+	}
+
+	void throw_no_state() {
+		throw std::future_error{ std::future_errc::no_state };
+	}
+
+	void throw_wait_cancelled() {
+		throw std::system_error{ std::make_error_code(std::errc::operation_canceled), "Wait was interrupted by a stop request" };
+	}
+
+}
@@ -1,30 +1,245 @@
 #include "jthread.h"
 
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cmath>
+#include <fstream>
+#include <limits>
+#include <optional>
+#include <sstream>
+#include <string>
+
+#if defined(__linux__)
+#include <sched.h>
+#endif
+
 namespace dp {
 
+	namespace {
+
+#if defined(__linux__)
+		//The number of CPUs this process is allowed to run on
+		std::optional<unsigned int> affinity_count() noexcept {
+			//Sized dynamically, since cpu_set_t only covers 1024 CPUs
+			for (std::size_t cpus = 1024; cpus <= 1024 * 64; cpus *= 2) {
+				cpu_set_t* const set{ CPU_ALLOC(cpus) };
+				if (!set) {
+					return std::nullopt;
+				}
+				const std::size_t size{ CPU_ALLOC_SIZE(cpus) };
+				CPU_ZERO_S(size, set);
+				if (sched_getaffinity(0, size, set) == 0) {
+					const int count{ CPU_COUNT_S(size, set) };
+					CPU_FREE(set);
+					return count > 0 ? std::optional<unsigned int>{ static_cast<unsigned int>(count) } : std::nullopt;
+				}
+				CPU_FREE(set);
+				if (errno != EINVAL) {
+					return std::nullopt;
+				}
+			}
+			return std::nullopt;
+		}
+
+		struct cgroup_mount {
+			std::string root;
+			std::string mount_point;
+		};
+
+		bool has_option(const std::string& options, const std::string& option) {
+			std::istringstream stream{ options };
+			std::string item{};
+			while (std::getline(stream, item, ',')) {
+				if (item == option) {
+					return true;
+				}
+			}
+			return false;
+		}
+
+		//Finds where the v1 cpu controller and the v2 unified hierarchy are mounted, if they are.
+		//Each line of mountinfo reads: id parent dev root mount_point options [optional fields...] - fstype source super_options
+		void find_cgroup_mounts(std::optional<cgroup_mount>& v1_cpu, std::optional<cgroup_mount>& v2) {
+			std::ifstream mountinfo{ "/proc/self/mountinfo" };
+			std::string line{};
+			while (std::getline(mountinfo, line)) {
+				std::istringstream fields{ line };
+				std::string id{}, parent{}, dev{}, root{}, mount_point{}, field{};
+				fields >> id >> parent >> dev >> root >> mount_point;
+				while (fields >> field && field != "-") {}
+				std::string fstype{}, source{}, super_options{};
+				fields >> fstype >> source >> super_options;
+				if (fstype == "cgroup2" && !v2) {
+					v2 = cgroup_mount{ root, mount_point };
+				}
+				else if (fstype == "cgroup" && !v1_cpu && has_option(super_options, "cpu")) {
+					v1_cpu = cgroup_mount{ root, mount_point };
+				}
+			}
+		}
+
+		//Each line of /proc/self/cgroup reads: hierarchy:controllers:path, where the v2 hierarchy is always 0 with no controllers
+		void find_cgroup_paths(std::optional<std::string>& v1_cpu, std::optional<std::string>& v2) {
+			std::ifstream cgroups{ "/proc/self/cgroup" };
+			std::string line{};
+			while (std::getline(cgroups, line)) {
+				const auto first{ line.find(':') };
+				const auto second{ first == std::string::npos ? std::string::npos : line.find(':', first + 1) };
+				if (second == std::string::npos) {
+					continue;
+				}
+				const std::string hierarchy{ line.substr(0, first) };
+				const std::string controllers{ line.substr(first + 1, second - first - 1) };
+				const std::string path{ line.substr(second + 1) };
+				if (hierarchy == "0" && controllers.empty()) {
+					v2 = path;
+				}
+				else if (has_option(controllers, "cpu")) {
+					v1_cpu = path;
+				}
+			}
+		}
+
+		//A group's limit may be set on any of its ancestors, so walk from the process's own group up to the mount point taking the tightest
+		template<typename ReadLimit>
+		std::optional<double> tightest_limit(const cgroup_mount& mount, std::string path, ReadLimit read_limit) {
+			if (mount.root != "/" && path.compare(0, mount.root.size(), mount.root) == 0) {
+				path.erase(0, mount.root.size());
+			}
+			std::string dir{ mount.mount_point + (path == "/" ? std::string{} : path) };
+			std::optional<double> tightest{};
+			while (true) {
+				if (const std::optional<double> limit{ read_limit(dir) }) {
+					tightest = tightest ? std::min(*tightest, *limit) : *limit;
+				}
+				if (dir.size() <= mount.mount_point.size()) {
+					break;
+				}
+				dir.erase(dir.find_last_of('/'));
+			}
+			return tightest;
+		}
+
+		//cgroup v1 reads a quota of -1 as unlimited
+		std::optional<double> v1_limit(const std::string& dir) {
+			std::ifstream quota_file{ dir + "/cpu.cfs_quota_us" };
+			std::ifstream period_file{ dir + "/cpu.cfs_period_us" };
+			long long quota{ -1 };
+			long long period{ 0 };
+			if (!(quota_file >> quota) || !(period_file >> period) || quota <= 0 || period <= 0) {
+				return std::nullopt;
+			}
+			return static_cast<double>(quota) / static_cast<double>(period);
+		}
+
+		//cgroup v2 holds both in cpu.max, as "max period" when unlimited
+		std::optional<double> v2_limit(const std::string& dir) {
+			std::ifstream max_file{ dir + "/cpu.max" };
+			std::string quota{};
+			long long period{ 0 };
+			if (!(max_file >> quota >> period) || quota == "max" || period <= 0) {
+				return std::nullopt;
+			}
+			try {
+				const long long quota_value{ std::stoll(quota) };
+				return quota_value > 0 ? std::optional<double>{ static_cast<double>(quota_value) / static_cast<double>(period) } : std::nullopt;
+			}
+			catch (...) {
+				return std::nullopt;
+			}
+		}
+
+		//The number of CPUs' worth of time the process's cgroups allow it, if limited
+		std::optional<double> cgroup_cpu_limit() {
+			std::optional<cgroup_mount> v1_mount{}, v2_mount{};
+			std::optional<std::string> v1_path{}, v2_path{};
+			find_cgroup_mounts(v1_mount, v2_mount);
+			find_cgroup_paths(v1_path, v2_path);
+
+			std::optional<double> limit{};
+			if (v1_mount && v1_path) {
+				limit = tightest_limit(*v1_mount, *v1_path, v1_limit);
+			}
+			if (v2_mount && v2_path) {
+				if (const std::optional<double> v2{ tightest_limit(*v2_mount, *v2_path, v2_limit) }) {
+					limit = limit ? std::min(*limit, *v2) : *v2;
+				}
+			}
+			return limit;
+		}
+#endif
+
+		unsigned int calculate_concurrency() noexcept {
+			unsigned int count{ std::thread::hardware_concurrency() };
+#if defined(__linux__)
+			try {
+				if (const std::optional<unsigned int> allowed{ affinity_count() }) {
+					count = count == 0 ? *allowed : std::min(count, *allowed);
+				}
+				if (const std::optional<double> limit{ cgroup_cpu_limit() }) {
+					//A quota of 1.5 CPUs can still keep two threads busy some of the time, so round up
+					const unsigned int quota_cpus{ static_cast<unsigned int>(std::ceil(*limit)) };
+					count = count == 0 ? quota_cpus : std::min(count, quota_cpus);
+				}
+			}
+			catch (...) {}
+#endif
+			return std::max(count, 1u);
+		}
+
+		std::atomic<unsigned int> cached_concurrency{ 0 };
+
+	}
+
 	bool jthread::joinable() const noexcept {
-		return m_thread.joinable();
+		return m_thread.joinable() || m_native.joinable();
 	}
 
 	jthread::id jthread::get_id() const noexcept {
-		return m_thread.get_id();
+		return m_native.joinable() ? m_native.get_id() : m_thread.get_id();
 	}
 
 	unsigned int jthread::hardware_concurrency() noexcept {
 		return std::thread::hardware_concurrency();
 	}
 
+	unsigned int jthread::effective_concurrency() noexcept {
+		const unsigned int cached{ cached_concurrency.load(std::memory_order_relaxed) };
+		if (cached != 0) {
+			return cached;
+		}
+		return refresh_concurrency();
+	}
+
+	unsigned int jthread::refresh_concurrency() noexcept {
+		const unsigned int count{ calculate_concurrency() };
+		cached_concurrency.store(count, std::memory_order_relaxed);
+		return count;
+	}
+
 	void jthread::join() {
-		m_thread.join();
+		if (m_native.joinable()) {
+			m_native.join();
+		}
+		else {
+			m_thread.join();
+		}
 	}
 
 	void jthread::detach() {
-		m_thread.detach();
+		if (m_native.joinable()) {
+			m_native.detach();
+		}
+		else {
+			m_thread.detach();
+		}
 		m_stop = dp::stop_source{ dp::nostopstate };
 	}
 
 	void jthread::swap(dp::jthread& other) noexcept {
 		m_thread.swap(other.m_thread);
+		m_native.swap(other.m_native);
 		m_stop.swap(other.m_stop);
 	}
 
@@ -0,0 +1,58 @@
+#include "jthread_group.h"
+
+namespace dp {
+
+	//Stop everything first, so that members wind down in parallel rather than one at a time as each is joined
+	jthread_group::~jthread_group() {
+		stop_and_join();
+	}
+
+	std::vector<jthread_group::member_id> jthread_group::join_finished() {
+		std::vector<member_id> stragglers{};
+		auto it{ m_members.begin() };
+		for (auto& mem : m_members) {
+			if (mem->m_finished.load(std::memory_order_acquire)) {
+				if (mem->m_thread.joinable()) {
+					mem->m_thread.join();
+				}
+			}
+			else {
+				stragglers.push_back(mem->m_id);
+				*it++ = std::move(mem);
+			}
+		}
+		m_members.erase(it, m_members.end());
+		return stragglers;
+	}
+
+	std::size_t jthread_group::size() const noexcept {
+		return m_members.size();
+	}
+
+	bool jthread_group::empty() const noexcept {
+		return m_members.empty();
+	}
+
+	bool jthread_group::request_stop() noexcept {
+		bool any{ false };
+		for (auto& mem : m_members) {
+			any = mem->m_thread.request_stop() || any;
+		}
+		return any;
+	}
+
+	void jthread_group::join() {
+		for (auto& mem : m_members) {
+			if (mem->m_thread.joinable()) {
+				mem->m_thread.join();
+			}
+		}
+		m_members.clear();
+	}
+
+	void jthread_group::stop_and_join() {
+		request_stop();
+		join();
+	}
+
+}
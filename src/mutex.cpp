@@ -0,0 +1,22 @@
+#include "mutex.h"
+
+namespace dp {
+
+	void mutex::lock_slow() noexcept {
+		std::uint32_t state{ m_state.load(std::memory_order_relaxed) };
+		if (state != contended) {
+			state = m_state.exchange(contended, std::memory_order_acquire);
+		}
+		while (state != unlocked) {
+			detail::futex_wait(m_state, contended);
+			state = m_state.exchange(contended, std::memory_order_acquire);
+		}
+	}
+
+	void mutex::lock_contended() noexcept {
+		while (m_state.exchange(contended, std::memory_order_acquire) != unlocked) {
+			detail::futex_wait(m_state, contended);
+		}
+	}
+
+}
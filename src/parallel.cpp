@@ -0,0 +1,17 @@
+#include "parallel.h"
+
+#include <algorithm>
+#include <system_error>
+
+namespace dp::detail {
+
+	void throw_parallel_cancelled() {
+		throw std::system_error{ std::make_error_code(std::errc::operation_canceled), "Parallel algorithm was stopped before finishing the range" };
+	}
+
+	dp::thread_pool& parallel_pool() {
+		static dp::thread_pool pool{ std::max<std::size_t>(dp::jthread::effective_concurrency(), 2) - 1 };
+		return pool;
+	}
+
+}
@@ -0,0 +1,147 @@
+#include "priority_executor.h"
+
+#include <algorithm>
+#include <memory>
+#include <mutex>
+#include <system_error>
+
+namespace dp {
+
+	priority_executor::priority_executor() : priority_executor(options{}) {}
+
+	priority_executor::priority_executor(options opts) : m_policy{ opts.policy } {
+		if (opts.weights.empty()) {
+			throw std::system_error{ std::make_error_code(std::errc::invalid_argument), "priority_executor needs at least one lane" };
+		}
+		m_lanes.resize(opts.weights.size());
+		for (std::size_t i = 0; i < opts.weights.size(); ++i) {
+			m_lanes[i].m_weight = std::max(opts.weights[i], 1u);
+		}
+
+		const std::size_t threads{ std::max<std::size_t>(opts.threads, 1) };
+		m_threads.reserve(threads);
+		try {
+			for (std::size_t i = 0; i < threads; ++i) {
+				m_threads.emplace_back([this] { run(); });
+			}
+		}
+		catch (...) {
+			request_stop();
+			m_threads.clear();
+			throw;
+		}
+	}
+
+	priority_executor::~priority_executor() {
+		request_stop();
+		m_threads.clear();
+
+		for (lane& entry : m_lanes) {
+			for (detail::pool_task* task : entry.m_tasks) {
+				delete task;
+			}
+		}
+	}
+
+	void priority_executor::enqueue(std::size_t lane_index, detail::pool_task* task) {
+		{
+			std::lock_guard lck{ m_mut };
+			if (lane_index >= m_lanes.size()) {
+				delete task;
+				throw std::system_error{ std::make_error_code(std::errc::invalid_argument), "No such lane" };
+			}
+			try {
+				m_lanes[lane_index].m_tasks.push_back(task);
+			}
+			catch (...) {
+				delete task;
+				throw;
+			}
+			++m_queued;
+		}
+		m_cv.notify_one();
+	}
+
+	//Must hold m_mut, with at least one task queued
+	detail::pool_task* priority_executor::pop_next() noexcept {
+		lane* chosen{ nullptr };
+		if (m_policy == lane_policy::strict) {
+			for (lane& entry : m_lanes) {
+				if (!entry.m_tasks.empty()) {
+					chosen = &entry;
+					break;
+				}
+			}
+		}
+		else {
+			//Each non-empty lane earns its weight; the richest is served and pays back the total earned, which interleaves lanes smoothly
+			long long total{ 0 };
+			for (lane& entry : m_lanes) {
+				if (entry.m_tasks.empty()) {
+					continue;
+				}
+				entry.m_current += entry.m_weight;
+				total += entry.m_weight;
+				if (!chosen || entry.m_current > chosen->m_current) {
+					chosen = &entry;
+				}
+			}
+			chosen->m_current -= total;
+		}
+
+		detail::pool_task* const task{ chosen->m_tasks.front() };
+		chosen->m_tasks.pop_front();
+		--m_queued;
+		return task;
+	}
+
+	void priority_executor::run() {
+		const dp::stop_token token{ m_stop.get_token() };
+		detail::thread_stop_scope scope{ token };
+
+		std::unique_lock lck{ m_mut };
+		while (m_cv.wait(lck, token, [this] { return m_queued != 0; })) {
+			std::unique_ptr<detail::pool_task> task{ pop_next() };
+			lck.unlock();
+
+			if (task->cancelled()) {
+				m_discarded.fetch_add(1, std::memory_order_relaxed);
+			}
+			else if (!token.stop_requested()) {
+				task->run(token);
+			}
+			task.reset();
+
+			lck.lock();
+			if (token.stop_requested()) {
+				break;
+			}
+		}
+	}
+
+	std::size_t priority_executor::lanes() const noexcept {
+		return m_lanes.size();
+	}
+
+	std::size_t priority_executor::size() const noexcept {
+		return m_threads.size();
+	}
+
+	std::size_t priority_executor::queued() const {
+		std::lock_guard lck{ m_mut };
+		return m_queued;
+	}
+
+	std::uint64_t priority_executor::discarded() const noexcept {
+		return m_discarded.load(std::memory_order_relaxed);
+	}
+
+	bool priority_executor::request_stop() noexcept {
+		return m_stop.request_stop();
+	}
+
+	dp::stop_token priority_executor::get_stop_token() const noexcept {
+		return m_stop.get_token();
+	}
+
+}
@@ -0,0 +1,181 @@
+#include "sharded_executor.h"
+
+#include <string>
+#include <system_error>
+
+namespace dp {
+
+	namespace detail {
+
+		//---MPSC INBOX-------------------------------------------------
+
+		mpsc_inbox::mpsc_inbox() noexcept : m_tail{ &m_stub }, m_head{ &m_stub } {}
+
+		mpsc_inbox::~mpsc_inbox() {
+			while (shard_task* task{ pop() }) {
+				delete task;
+			}
+		}
+
+		void mpsc_inbox::push(shard_task* task) noexcept {
+			task->m_next.store(nullptr, std::memory_order_relaxed);
+			shard_task* const prev{ m_tail.exchange(task, std::memory_order_acq_rel) };
+			prev->m_next.store(task, std::memory_order_release);
+		}
+
+		shard_task* mpsc_inbox::pop() noexcept {
+			shard_task* head{ m_head };
+			shard_task* next{ head->m_next.load(std::memory_order_acquire) };
+			if (head == &m_stub) {
+				if (!next) {
+					return nullptr;
+				}
+				m_head = next;
+				head = next;
+				next = next->m_next.load(std::memory_order_acquire);
+			}
+			if (next) {
+				m_head = next;
+				return head;
+			}
+			//head looks like the last task, unless a push has swapped the tail but not yet linked it in
+			if (head != m_tail.load(std::memory_order_acquire)) {
+				return nullptr;
+			}
+			//Put the stub back behind head so that head can be handed out without leaving the queue empty of nodes
+			push(&m_stub);
+			next = head->m_next.load(std::memory_order_acquire);
+			if (next) {
+				m_head = next;
+				return head;
+			}
+			return nullptr;
+		}
+
+	}
+
+	namespace {
+		//The executor and shard the calling thread belongs to, if any
+		thread_local const sharded_executor* current_executor{ nullptr };
+		thread_local std::size_t current_shard_index{ 0 };
+
+		constexpr std::uint32_t spins_before_sleep{ 64 };
+	}
+
+	//---SHARDED EXECUTOR-------------------------------------------
+
+	sharded_executor::sharded_executor(std::vector<unsigned int> cpus) {
+		if (cpus.empty()) {
+			throw std::system_error{ std::make_error_code(std::errc::invalid_argument), "sharded_executor needs at least one CPU" };
+		}
+		m_shards.reserve(cpus.size());
+		for (unsigned int cpu : cpus) {
+			m_shards.push_back(std::make_unique<shard>());
+			m_shards.back()->m_cpu = cpu;
+		}
+		m_threads.reserve(cpus.size());
+		try {
+			for (std::size_t i = 0; i < cpus.size(); ++i) {
+				dp::thread_attributes attrs{};
+				attrs.set_affinity({ cpus[i] }).set_name("dp-shard-" + std::to_string(i));
+				m_threads.emplace_back(attrs, [this, i] { run(i); });
+			}
+		}
+		catch (...) {
+			request_stop();
+			m_threads.clear();
+			throw;
+		}
+	}
+
+	sharded_executor::~sharded_executor() {
+		request_stop();
+		m_threads.clear();
+	}
+
+	void sharded_executor::enqueue(std::size_t index, detail::shard_task* task) {
+		if (index >= m_shards.size()) {
+			delete task;
+			throw std::system_error{ std::make_error_code(std::errc::invalid_argument), "No such shard" };
+		}
+		shard& target{ *m_shards[index] };
+		target.m_inbox.push(task);
+		wake(target);
+	}
+
+	//Pairs with the fence after the shard's thread sets m_sleeping. Either we see it asleep, or it sees our task or stop when it re-checks.
+	void sharded_executor::wake(shard& target) noexcept {
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		if (target.m_sleeping.load(std::memory_order_relaxed) != 0 && target.m_sleeping.exchange(0, std::memory_order_relaxed) != 0) {
+			detail::futex_wake_one(target.m_sleeping);
+		}
+	}
+
+	void sharded_executor::run(std::size_t index) {
+		shard& self{ *m_shards[index] };
+		current_executor = this;
+		current_shard_index = index;
+
+		const dp::stop_token token{ m_stop.get_token() };
+		detail::thread_stop_scope scope{ token };
+
+		while (!token.stop_requested()) {
+			detail::shard_task* task{ self.m_inbox.pop() };
+			for (std::uint32_t spin = 0; !task && spin < spins_before_sleep; ++spin) {
+				detail::cpu_relax();
+				task = self.m_inbox.pop();
+			}
+
+			if (!task) {
+				self.m_sleeping.store(1, std::memory_order_relaxed);
+				std::atomic_thread_fence(std::memory_order_seq_cst);
+				task = self.m_inbox.pop();
+				if (!task && !token.stop_requested()) {
+					detail::futex_wait(self.m_sleeping, 1);
+				}
+				self.m_sleeping.store(0, std::memory_order_relaxed);
+				if (!task) {
+					continue;
+				}
+			}
+
+			std::unique_ptr<detail::shard_task> owned{ task };
+			if (!token.stop_requested()) {
+				owned->run(token);
+			}
+		}
+
+		current_executor = nullptr;
+	}
+
+	std::size_t sharded_executor::size() const noexcept {
+		return m_shards.size();
+	}
+
+	unsigned int sharded_executor::cpu_of(std::size_t shard) const {
+		if (shard >= m_shards.size()) {
+			throw std::system_error{ std::make_error_code(std::errc::invalid_argument), "No such shard" };
+		}
+		return m_shards[shard]->m_cpu;
+	}
+
+	std::optional<std::size_t> sharded_executor::current_shard() const noexcept {
+		if (current_executor != this) {
+			return std::nullopt;
+		}
+		return current_shard_index;
+	}
+
+	bool sharded_executor::request_stop() noexcept {
+		const bool stopped{ m_stop.request_stop() };
+		for (auto& target : m_shards) {
+			wake(*target);
+		}
+		return stopped;
+	}
+
+	dp::stop_token sharded_executor::get_stop_token() const noexcept {
+		return m_stop.get_token();
+	}
+
+}
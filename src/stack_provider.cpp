@@ -0,0 +1,214 @@
+#include "stack_provider.h"
+
+#include <cerrno>
+#include <cstdint>
+#include <system_error>
+
+#if defined(__linux__) || defined(__APPLE__)
+#include <sys/mman.h>
+#include <unistd.h>
+#define DP_MMAP_STACKS
+#endif
+#if defined(__linux__)
+#include <sys/syscall.h>
+#endif
+
+namespace dp {
+
+	namespace {
+		std::size_t round_up(std::size_t value, std::size_t multiple) noexcept {
+			return (value + multiple - 1) / multiple * multiple;
+		}
+
+#if defined(DP_MMAP_STACKS)
+		//Huge pages are 2MiB on every platform we're likely to meet them on, and aligning to 2MiB is harmless where they're larger
+		constexpr std::size_t huge_page_size{ 2 * 1024 * 1024 };
+
+		[[noreturn]] void throw_errno(const char* what) {
+			throw std::system_error{ errno, std::generic_category(), what };
+		}
+
+		void* map_anonymous(void* addr, std::size_t size, int prot, int extra_flags) noexcept {
+			int flags{ MAP_PRIVATE | MAP_ANONYMOUS | extra_flags };
+#if defined(MAP_STACK)
+			flags |= MAP_STACK;
+#endif
+			return mmap(addr, size, prot, flags, -1, 0);
+		}
+
+		//Prefer, rather than bind, so that a full node spills over instead of failing the thread
+		void prefer_node(void* addr, std::size_t size, unsigned int node) noexcept {
+#if defined(__linux__) && defined(SYS_mbind)
+			constexpr int mpol_preferred{ 1 };
+			constexpr std::size_t bits_per_word{ sizeof(unsigned long) * 8 };
+			unsigned long mask[16]{};
+			if (node >= sizeof(mask) * 8) {
+				return;
+			}
+			mask[node / bits_per_word] = 1ul << (node % bits_per_word);
+			syscall(SYS_mbind, addr, size, mpol_preferred, mask, sizeof(mask) * 8 + 1, 0);
+#else
+			(void)addr;
+			(void)size;
+			(void)node;
+#endif
+		}
+
+		void advise_huge(void* addr, std::size_t size) noexcept {
+#if defined(MADV_HUGEPAGE)
+			madvise(addr, size, MADV_HUGEPAGE);
+#else
+			(void)addr;
+			(void)size;
+#endif
+		}
+#endif
+	}
+
+	//---MMAP STACK PROVIDER----------------------------------------
+
+	mmap_stack_provider::mmap_stack_provider(stack_options options) : m_options{ options }, m_page_size{ 4096 } {
+#if defined(DP_MMAP_STACKS)
+		m_page_size = static_cast<std::size_t>(sysconf(_SC_PAGESIZE));
+#endif
+		const std::size_t granularity{ m_options.pages == stack_pages::normal ? m_page_size : huge_page_size };
+		m_options.size = round_up(m_options.size == 0 ? granularity : m_options.size, granularity);
+		m_options.guard_size = round_up(m_options.guard_size, m_page_size);
+	}
+
+	//Every stack is laid out as [guard][stack], and is always unmapped as a single region
+	thread_stack mmap_stack_provider::allocate() {
+#if defined(DP_MMAP_STACKS)
+		const std::size_t guard{ m_options.guard_size };
+		const std::size_t size{ m_options.size };
+
+		if (m_options.pages == stack_pages::normal || m_options.pages == stack_pages::transparent_huge) {
+			void* const region{ map_anonymous(nullptr, guard + size, PROT_READ | PROT_WRITE, 0) };
+			if (region == MAP_FAILED) {
+				throw_errno("Failed to map thread stack");
+			}
+			if (guard != 0 && mprotect(region, guard, PROT_NONE) != 0) {
+				const int error{ errno };
+				munmap(region, guard + size);
+				throw std::system_error{ error, std::generic_category(), "Failed to protect thread stack guard" };
+			}
+			void* const base{ static_cast<char*>(region) + guard };
+			if (m_options.pages == stack_pages::transparent_huge) {
+				advise_huge(base, size);
+			}
+			if (m_options.numa_node) {
+				prefer_node(base, size, *m_options.numa_node);
+			}
+			return thread_stack{ base, size };
+		}
+
+		//Explicit huge pages must be huge-page aligned, so reserve enough to align within and trim off the excess
+		const std::size_t reserved{ guard + size + huge_page_size };
+		void* const region{ map_anonymous(nullptr, reserved, PROT_NONE, MAP_NORESERVE) };
+		if (region == MAP_FAILED) {
+			throw_errno("Failed to reserve thread stack");
+		}
+		const auto region_start{ reinterpret_cast<std::uintptr_t>(region) };
+		const std::uintptr_t base_addr{ round_up(region_start + guard, huge_page_size) };
+		const std::uintptr_t start{ base_addr - guard };
+		const std::uintptr_t end{ base_addr + size };
+		if (start > region_start) {
+			munmap(region, start - region_start);
+		}
+		if (region_start + reserved > end) {
+			munmap(reinterpret_cast<void*>(end), region_start + reserved - end);
+		}
+
+		void* const base{ reinterpret_cast<void*>(base_addr) };
+		void* mapped{ MAP_FAILED };
+#if defined(MAP_HUGETLB)
+		mapped = map_anonymous(base, size, PROT_READ | PROT_WRITE, MAP_FIXED | MAP_HUGETLB);
+#endif
+		if (mapped == MAP_FAILED) {
+			mapped = map_anonymous(base, size, PROT_READ | PROT_WRITE, MAP_FIXED);
+			if (mapped == MAP_FAILED) {
+				const int error{ errno };
+				munmap(reinterpret_cast<void*>(start), guard + size);
+				throw std::system_error{ error, std::generic_category(), "Failed to map thread stack" };
+			}
+			advise_huge(base, size);
+		}
+		if (m_options.numa_node) {
+			prefer_node(base, size, *m_options.numa_node);
+		}
+		return thread_stack{ base, size };
+#else
+		throw std::system_error{ std::make_error_code(std::errc::function_not_supported), "Custom thread stacks are not supported on this platform" };
+#endif
+	}
+
+	void mmap_stack_provider::deallocate(thread_stack stack) noexcept {
+#if defined(DP_MMAP_STACKS)
+		if (stack.base) {
+			munmap(static_cast<char*>(stack.base) - m_options.guard_size, m_options.guard_size + stack.size);
+		}
+#else
+		(void)stack;
+#endif
+	}
+
+	const stack_options& mmap_stack_provider::options() const noexcept {
+		return m_options;
+	}
+
+	//---STACK POOL-------------------------------------------------
+
+	stack_pool::stack_pool(std::shared_ptr<stack_provider> upstream, std::size_t preallocate, std::size_t max_free)
+		: m_upstream{ std::move(upstream) }, m_max_free{ max_free } {
+		m_free.reserve(preallocate);
+		try {
+			for (std::size_t i = 0; i < preallocate; ++i) {
+				m_free.push_back(m_upstream->allocate());
+			}
+		}
+		catch (...) {
+			for (const thread_stack& stack : m_free) {
+				m_upstream->deallocate(stack);
+			}
+			throw;
+		}
+	}
+
+	stack_pool::~stack_pool() {
+		for (const thread_stack& stack : m_free) {
+			m_upstream->deallocate(stack);
+		}
+	}
+
+	thread_stack stack_pool::allocate() {
+		{
+			std::lock_guard lck{ m_mut };
+			if (!m_free.empty()) {
+				const thread_stack stack{ m_free.back() };
+				m_free.pop_back();
+				return stack;
+			}
+		}
+		return m_upstream->allocate();
+	}
+
+	void stack_pool::deallocate(thread_stack stack) noexcept {
+		{
+			std::lock_guard lck{ m_mut };
+			if (m_free.size() < m_max_free) {
+				try {
+					m_free.push_back(stack);
+					return;
+				}
+				catch (...) {}
+			}
+		}
+		m_upstream->deallocate(stack);
+	}
+
+	std::size_t stack_pool::available() {
+		std::lock_guard lck{ m_mut };
+		return m_free.size();
+	}
+
+}
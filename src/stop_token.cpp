@@ -1,19 +1,82 @@
 #include "stop_token.h"
+#include "futex.h"
 
 namespace dp {
 
 namespace detail {
 
 //---STOP-STATE-------------------------------------------------
-void stop_state::deregister_callback(std::size_t id) {
-    m_callbacks.remove_if([id](callback_state& state) {return state.id() == id; });
+void stop_state::unlink(stop_callback_node* node) noexcept {
+    if (node->m_prev) {
+        node->m_prev->m_next = node->m_next;
+    }
+    else {
+        m_head = node->m_next;
+    }
+    if (node->m_next) {
+        node->m_next->m_prev = node->m_prev;
+    }
+    node->m_prev = nullptr;
+    node->m_next = nullptr;
+}
+
+bool stop_state::register_callback(stop_callback_node* node) noexcept {
+    auto lck{ std::lock_guard{m_mut} };
+    //request_stop() sets the flag before it takes the lock, so if we can't see it here our node is guaranteed to be run
+    if (stop_requested()) {
+        return false;
+    }
+    //Nodes may be reused once deregistered, so clear out any state left over from a previous run
+    node->m_done.store(0, std::memory_order_relaxed);
+    node->m_destroyed = nullptr;
+    node->m_next = m_head;
+    if (m_head) {
+        m_head->m_prev = node;
+    }
+    m_head = node;
+    return true;
+}
+
+void stop_state::deregister_callback(stop_callback_node* node) noexcept {
+    auto lck{ std::unique_lock{m_mut} };
+    if (m_executing == node) {
+        //A callback which destroys itself mid-execution must not wait for itself to finish
+        if (m_executing_thread == std::this_thread::get_id()) {
+            *node->m_destroyed = true;
+            return;
+        }
+        lck.unlock();
+        while (node->m_done.load(std::memory_order_acquire) == 0) {
+            detail::futex_wait(node->m_done, 0);
+        }
+        return;
+    }
+    //Either still waiting to be run, or already run and unlinked. Only the former needs any work.
+    if (node->m_prev || m_head == node) {
+        unlink(node);
+    }
 }
 
-void stop_state::execute_callbacks() {
-    for (auto& callback : m_callbacks) {
-        std::invoke(callback);
+void stop_state::execute_callbacks(std::unique_lock<std::mutex>& lck) noexcept {
+    m_executing_thread = std::this_thread::get_id();
+    while (m_head) {
+        stop_callback_node* node{ m_head };
+        unlink(node);
+        m_executing = node;
+        bool destroyed{ false };
+        node->m_destroyed = &destroyed;
+
+        lck.unlock();
+        node->m_invoke(node);
+        lck.lock();
+
+        m_executing = nullptr;
+        if (!destroyed) {
+            node->m_destroyed = nullptr;
+            node->m_done.store(1, std::memory_order_release);
+            detail::futex_wake_all(node->m_done);
+        }
     }
-    m_callbacks.clear();
 }
 
 
@@ -0,0 +1,87 @@
+#include "task_group.h"
+
+#include <thread>
+
+#include "futex.h"
+
+namespace dp {
+
+	task_group::task_group() : m_uncaught_on_entry{ std::uncaught_exceptions() } {}
+
+	task_group::task_group(const dp::stop_token& parent) : task_group() {
+		m_parent_link.emplace(parent, forward_stop{ &m_stop });
+	}
+
+	//Throwing while another exception is in flight would terminate, so in that case the group is stopped and its own exception dropped
+	task_group::~task_group() noexcept(false) {
+		const bool unwinding{ std::uncaught_exceptions() > m_uncaught_on_entry };
+		if (unwinding) {
+			m_stop.request_stop();
+		}
+		wait_for_tasks();
+		if (!unwinding && m_error) {
+			std::rethrow_exception(std::exchange(m_error, nullptr));
+		}
+	}
+
+	void task_group::record_error(std::exception_ptr error) noexcept {
+		if (!m_failed.exchange(true, std::memory_order_acq_rel)) {
+			m_error = std::move(error);
+		}
+		m_stop.request_stop();
+	}
+
+	//A waiter may return and destroy the group as soon as it reads zero, so the last task wakes it first and only then clears closing_bit
+	void task_group::finish_one() noexcept {
+		std::uint32_t pending{ m_pending.load(std::memory_order_relaxed) };
+		while (!m_pending.compare_exchange_weak(pending, pending == 1 ? closing_bit : pending - 1, std::memory_order_acq_rel, std::memory_order_relaxed)) {}
+		if (pending != 1) {
+			return;
+		}
+		detail::futex_wake_all(m_pending);
+		m_pending.fetch_sub(closing_bit, std::memory_order_release);
+	}
+
+	//Tasks can only be spawned by the owner or by other tasks, so once the count reaches zero no more threads can be added
+	void task_group::wait_for_tasks() noexcept {
+		for (;;) {
+			const std::uint32_t pending{ m_pending.load(std::memory_order_acquire) };
+			if (pending == 0) {
+				break;
+			}
+			//The last task has already issued its wake and is a single store away from releasing us
+			if (pending & closing_bit) {
+				std::this_thread::yield();
+				continue;
+			}
+			detail::futex_wait(m_pending, pending);
+		}
+
+		std::vector<dp::jthread> finished{};
+		{
+			std::lock_guard lck{ m_threads_mut };
+			finished.swap(m_threads);
+		}
+	}
+
+	void task_group::wait() {
+		wait_for_tasks();
+		if (m_error) {
+			m_failed.store(false, std::memory_order_relaxed);
+			std::rethrow_exception(std::exchange(m_error, nullptr));
+		}
+	}
+
+	bool task_group::request_stop() noexcept {
+		return m_stop.request_stop();
+	}
+
+	bool task_group::stop_requested() const noexcept {
+		return m_stop.stop_requested();
+	}
+
+	dp::stop_token task_group::get_stop_token() const noexcept {
+		return m_stop.get_token();
+	}
+
+}
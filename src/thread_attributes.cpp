@@ -0,0 +1,340 @@
+#include "thread_attributes.h"
+#include "futex.h"
+#include "thread_cache.h"
+
+#include <cerrno>
+#include <exception>
+#include <mutex>
+#include <system_error>
+
+#if defined(DP_PTHREAD_THREADS)
+#include <sched.h>
+#elif defined(_WIN32)
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>
+#endif
+
+namespace dp::detail {
+
+	namespace {
+		//Everything the new thread needs, handed over to it and freed once it has started
+		struct launch_data {
+			std::unique_ptr<native_thread::entry_base> func;
+			native_thread::control_block* start;
+			std::string name;
+#if defined(_WIN32)
+			std::vector<unsigned int> affinity;
+			scheduling_policy policy;
+			int priority;
+#endif
+		};
+
+		//Applies whichever attributes can only be set from the thread itself
+		void apply_to_self(const launch_data& data) noexcept {
+#if defined(__linux__)
+			if (!data.name.empty()) {
+				pthread_setname_np(pthread_self(), data.name.substr(0, 15).c_str());
+			}
+#elif defined(__APPLE__)
+			if (!data.name.empty()) {
+				pthread_setname_np(data.name.c_str());
+			}
+#elif defined(_WIN32)
+			const HANDLE self{ GetCurrentThread() };
+			if (!data.name.empty()) {
+				const int length{ MultiByteToWideChar(CP_UTF8, 0, data.name.c_str(), -1, nullptr, 0) };
+				if (length > 0) {
+					std::wstring wide(static_cast<std::size_t>(length), L'\0');
+					MultiByteToWideChar(CP_UTF8, 0, data.name.c_str(), -1, wide.data(), length);
+					SetThreadDescription(self, wide.c_str());
+				}
+			}
+			if (!data.affinity.empty()) {
+				DWORD_PTR mask{ 0 };
+				for (unsigned int cpu : data.affinity) {
+					if (cpu < sizeof(DWORD_PTR) * 8) {
+						mask |= DWORD_PTR{ 1 } << cpu;
+					}
+				}
+				if (mask != 0) {
+					SetThreadAffinityMask(self, mask);
+				}
+			}
+			if (data.policy != scheduling_policy::inherit) {
+				SetThreadPriority(self, data.priority);
+			}
+#else
+			(void)data;
+#endif
+		}
+
+		void run_thread(launch_data* raw) noexcept {
+			std::unique_ptr<launch_data> data{ raw };
+			apply_to_self(*data);
+
+			//Once this is published the owner may detach and free the block at any time, so it must be the last we touch it
+			data->start->m_id = std::this_thread::get_id();
+			data->start->m_started.store(1, std::memory_order_release);
+			detail::futex_wake_all(data->start->m_started);
+
+			std::unique_ptr<native_thread::entry_base> func{ std::move(data->func) };
+			data.reset();
+			func->run();
+		}
+
+#if defined(DP_PTHREAD_THREADS)
+		extern "C" void* thread_start(void* arg) {
+			run_thread(static_cast<launch_data*>(arg));
+			return nullptr;
+		}
+
+		void check(int result, const char* what) {
+			if (result != 0) {
+				throw std::system_error{ result, std::generic_category(), what };
+			}
+		}
+
+		//Owns a pthread_attr_t for the length of thread creation
+		class attr_guard {
+			pthread_attr_t m_attr{};
+		public:
+			attr_guard() {
+				check(pthread_attr_init(&m_attr), "pthread_attr_init failed");
+			}
+			attr_guard(const attr_guard&) = delete;
+			attr_guard& operator=(const attr_guard&) = delete;
+			~attr_guard() {
+				pthread_attr_destroy(&m_attr);
+			}
+			pthread_attr_t* get() noexcept {
+				return &m_attr;
+			}
+		};
+
+		//Detached threads on custom stacks, whose stacks can't be handed back until the thread has exited
+		struct orphan {
+			pthread_t handle;
+			std::shared_ptr<stack_provider> provider;
+			thread_stack stack;
+		};
+
+		struct orphanage {
+			std::mutex m_mut{};
+			std::vector<orphan> m_orphans{};
+		};
+
+		//Deliberately leaked, as detached threads may be adopted during static destruction
+		orphanage& orphans() noexcept {
+			static orphanage* const state{ new orphanage{} };
+			return *state;
+		}
+
+		//Hand back the stacks of any orphans which have since exited
+		void reap_orphans() noexcept {
+#if defined(__linux__)
+			auto& state{ orphans() };
+			std::lock_guard lck{ state.m_mut };
+			auto it{ state.m_orphans.begin() };
+			for (auto& child : state.m_orphans) {
+				if (pthread_tryjoin_np(child.handle, nullptr) == 0) {
+					child.provider->deallocate(child.stack);
+				}
+				else {
+					*it++ = std::move(child);
+				}
+			}
+			state.m_orphans.erase(it, state.m_orphans.end());
+#endif
+		}
+
+		int native_policy(scheduling_policy policy) noexcept {
+			switch (policy) {
+			case scheduling_policy::fifo:
+				return SCHED_FIFO;
+			case scheduling_policy::round_robin:
+				return SCHED_RR;
+			default:
+				return SCHED_OTHER;
+			}
+		}
+#endif
+	}
+
+	void native_thread::start(const thread_attributes& attrs, std::unique_ptr<entry_base> func) {
+		auto block{ std::make_unique<control_block>() };
+		auto data{ std::make_unique<launch_data>() };
+		data->func = std::move(func);
+		data->start = block.get();
+		data->name = attrs.name();
+
+#if defined(DP_PTHREAD_THREADS)
+		attr_guard attr{};
+		const auto& provider{ attrs.stack_provider() };
+		if (const auto& stack_size{ attrs.stack_size() }; stack_size && !provider) {
+			const std::size_t min_size{ static_cast<std::size_t>(PTHREAD_STACK_MIN) };
+			check(pthread_attr_setstacksize(attr.get(), *stack_size < min_size ? min_size : *stack_size), "Invalid thread stack size");
+		}
+#if defined(__linux__)
+		if (!attrs.affinity().empty()) {
+			cpu_set_t cpus;
+			CPU_ZERO(&cpus);
+			for (unsigned int cpu : attrs.affinity()) {
+				if (cpu < CPU_SETSIZE) {
+					CPU_SET(cpu, &cpus);
+				}
+			}
+			check(pthread_attr_setaffinity_np(attr.get(), sizeof(cpus), &cpus), "Invalid thread affinity");
+		}
+#endif
+		if (attrs.policy() != scheduling_policy::inherit) {
+			sched_param param{};
+			param.sched_priority = attrs.priority();
+			check(pthread_attr_setinheritsched(attr.get(), PTHREAD_EXPLICIT_SCHED), "Invalid thread scheduling");
+			check(pthread_attr_setschedpolicy(attr.get(), native_policy(attrs.policy())), "Invalid thread scheduling policy");
+			check(pthread_attr_setschedparam(attr.get(), &param), "Invalid thread priority");
+		}
+
+		//The stack is taken last, as nothing hands it back to the provider if a later step throws
+		if (provider) {
+			reap_orphans();
+			block->m_stack = provider->allocate();
+			block->m_stack_provider = provider;
+			if (const int result{ pthread_attr_setstack(attr.get(), block->m_stack.base, block->m_stack.size) }; result != 0) {
+				provider->deallocate(block->m_stack);
+				throw std::system_error{ result, std::generic_category(), "Invalid thread stack" };
+			}
+		}
+
+		pthread_t handle{};
+		if (const int result{ pthread_create(&handle, attr.get(), &thread_start, data.get()) }; result != 0) {
+			if (block->m_stack_provider) {
+				block->m_stack_provider->deallocate(block->m_stack);
+			}
+			throw std::system_error{ result, std::generic_category(), "Failed to start thread" };
+		}
+		data.release();
+		m_handle = handle;
+#else
+#if defined(_WIN32)
+		data->affinity = attrs.affinity();
+		data->policy = attrs.policy();
+		data->priority = attrs.priority();
+#endif
+		m_handle = std::thread{ [raw = data.get()] { run_thread(raw); } };
+		data.release();
+#endif
+		m_start = std::move(block);
+	}
+
+	void native_thread::start_cached(std::unique_ptr<entry_base> func) {
+		auto block{ std::make_unique<control_block>() };
+		block->m_cached = true;
+		block->m_id = detail::thread_cache_launch(std::move(func), block.get());
+		block->m_started.store(1, std::memory_order_relaxed);
+		m_start = std::move(block);
+	}
+
+	void native_thread::wait_started() const noexcept {
+		while (m_start->m_started.load(std::memory_order_acquire) == 0) {
+			detail::futex_wait(m_start->m_started, 0);
+		}
+	}
+
+	native_thread::native_thread(native_thread&& other) noexcept
+		: m_handle{ std::move(other.m_handle) }, m_start{ std::move(other.m_start) } {}
+
+	//As with std::thread, overwriting or destroying a thread which is still joinable terminates
+	native_thread& native_thread::operator=(native_thread&& other) noexcept {
+		if (joinable()) {
+			std::terminate();
+		}
+		m_handle = std::move(other.m_handle);
+		m_start = std::move(other.m_start);
+		return *this;
+	}
+
+	native_thread::~native_thread() {
+		if (joinable()) {
+			std::terminate();
+		}
+	}
+
+	bool native_thread::joinable() const noexcept {
+		return m_start != nullptr;
+	}
+
+	std::thread::id native_thread::get_id() const noexcept {
+		if (!m_start) {
+			return std::thread::id{};
+		}
+		wait_started();
+		return m_start->m_id;
+	}
+
+	void native_thread::join() {
+		if (!joinable()) {
+			throw std::system_error{ std::make_error_code(std::errc::invalid_argument), "Thread is not joinable" };
+		}
+		if (get_id() == std::this_thread::get_id()) {
+			throw std::system_error{ std::make_error_code(std::errc::resource_deadlock_would_occur), "Thread cannot join itself" };
+		}
+		if (m_start->m_cached) {
+			while (m_start->m_finished.load(std::memory_order_acquire) == 0) {
+				detail::futex_wait(m_start->m_finished, 0);
+			}
+		}
+		else {
+#if defined(DP_PTHREAD_THREADS)
+			check(pthread_join(m_handle, nullptr), "Failed to join thread");
+			if (m_start->m_stack_provider) {
+				m_start->m_stack_provider->deallocate(m_start->m_stack);
+			}
+#else
+			m_handle.join();
+#endif
+		}
+		m_start.reset();
+	}
+
+	void native_thread::detach() {
+		if (!joinable()) {
+			throw std::system_error{ std::make_error_code(std::errc::invalid_argument), "Thread is not joinable" };
+		}
+		if (m_start->m_cached) {
+			//If the function is still running, the thread frees the block when it finishes
+			if (m_start->m_finished.exchange(2, std::memory_order_acq_rel) == 0) {
+				m_start.release();
+			}
+			else {
+				m_start.reset();
+			}
+			return;
+		}
+		//The thread writes to the control block as it starts up, so it can't be freed until then
+		wait_started();
+#if defined(DP_PTHREAD_THREADS)
+#if defined(__linux__)
+		//The stack can't be reclaimed until the thread exits, so rather than detach it we leave it for reap_orphans() to join
+		if (m_start->m_stack_provider) {
+			auto& state{ orphans() };
+			std::lock_guard lck{ state.m_mut };
+			state.m_orphans.push_back(orphan{ m_handle, std::move(m_start->m_stack_provider), m_start->m_stack });
+			m_start.reset();
+			return;
+		}
+#endif
+		check(pthread_detach(m_handle), "Failed to detach thread");
+#else
+		m_handle.detach();
+#endif
+		m_start.reset();
+	}
+
+	void native_thread::swap(native_thread& other) noexcept {
+		std::swap(m_handle, other.m_handle);
+		m_start.swap(other.m_start);
+	}
+
+}
@@ -0,0 +1,193 @@
+#include "thread_cache.h"
+#include "futex.h"
+
+#include <mutex>
+
+namespace dp {
+
+	namespace {
+
+		enum signal : std::uint32_t {
+			parked = 0,
+			run_job = 1,
+			exit_thread = 2
+		};
+
+		struct worker {
+			std::atomic<std::uint32_t> m_signal{ run_job };
+			std::unique_ptr<detail::native_thread::entry_base> m_func{};
+			detail::native_thread::control_block* m_block{ nullptr };
+			std::thread::id m_id{};
+
+			//Links in the list of parked workers, guarded by the cache's mutex
+			worker* m_prev{ nullptr };
+			worker* m_next{ nullptr };
+			bool m_linked{ false };
+		};
+
+		//Parked workers form an intrusive stack, so the most recently used thread (with the warmest caches) is handed out first
+		struct cache_state {
+			std::mutex m_mut{};
+			worker* m_head{ nullptr };
+			std::size_t m_parked{ 0 };
+			std::size_t m_max_parked{ 0 };
+			std::chrono::milliseconds m_idle_timeout{ 0 };
+
+			void push(worker* w) noexcept {
+				w->m_prev = nullptr;
+				w->m_next = m_head;
+				if (m_head) {
+					m_head->m_prev = w;
+				}
+				m_head = w;
+				w->m_linked = true;
+				++m_parked;
+			}
+
+			void unlink(worker* w) noexcept {
+				if (w->m_prev) {
+					w->m_prev->m_next = w->m_next;
+				}
+				else {
+					m_head = w->m_next;
+				}
+				if (w->m_next) {
+					w->m_next->m_prev = w->m_prev;
+				}
+				w->m_prev = nullptr;
+				w->m_next = nullptr;
+				w->m_linked = false;
+				--m_parked;
+			}
+
+			worker* pop() noexcept {
+				worker* w{ m_head };
+				if (w) {
+					unlink(w);
+				}
+				return w;
+			}
+		};
+
+		//Deliberately leaked, as detached workers may still be parked on it during static destruction
+		cache_state& cache() noexcept {
+			static cache_state* const state{ new cache_state{} };
+			return *state;
+		}
+
+		//Tell whoever owns the control block that the function has returned
+		void finish(detail::native_thread::control_block* block) noexcept {
+			if (block->m_finished.exchange(1, std::memory_order_acq_rel) == 2) {
+				delete block;
+				return;
+			}
+			detail::futex_wake_all(block->m_finished);
+		}
+
+		//Wait for the next job. Returns false if the worker should exit instead.
+		bool park(worker* w) noexcept {
+			auto& state{ cache() };
+			std::chrono::milliseconds timeout{};
+			{
+				std::lock_guard lck{ state.m_mut };
+				if (!detail::thread_cache_enabled.load(std::memory_order_relaxed) || state.m_parked >= state.m_max_parked) {
+					return false;
+				}
+				w->m_signal.store(parked, std::memory_order_relaxed);
+				state.push(w);
+				timeout = state.m_idle_timeout;
+			}
+
+			const auto deadline{ std::chrono::steady_clock::now() + timeout };
+			while (w->m_signal.load(std::memory_order_acquire) == parked) {
+				const std::chrono::nanoseconds remaining{ detail::time_until(deadline) };
+				if (remaining == std::chrono::nanoseconds::zero()) {
+					std::unique_lock lck{ state.m_mut };
+					if (w->m_linked) {
+						state.unlink(w);
+						return false;
+					}
+					//Somebody took us off the list just as we timed out, and is about to hand over a job
+					lck.unlock();
+					while (w->m_signal.load(std::memory_order_acquire) == parked) {
+						detail::futex_wait(w->m_signal, parked);
+					}
+					break;
+				}
+				detail::futex_wait_for(w->m_signal, parked, remaining);
+			}
+			return w->m_signal.load(std::memory_order_acquire) == run_job;
+		}
+
+		void worker_main(worker* raw) noexcept {
+			std::unique_ptr<worker> w{ raw };
+			w->m_id = std::this_thread::get_id();
+			do {
+				//Destroy the function and its arguments before signalling, as a std::thread would before its join returned
+				std::unique_ptr<detail::native_thread::entry_base> func{ std::move(w->m_func) };
+				detail::native_thread::control_block* const block{ w->m_block };
+				func->run();
+				func.reset();
+				finish(block);
+			} while (park(w.get()));
+		}
+
+	}
+
+	namespace detail {
+
+		std::thread::id thread_cache_launch(std::unique_ptr<native_thread::entry_base> func, native_thread::control_block* block) {
+			worker* w{ nullptr };
+			if (thread_cache_enabled.load(std::memory_order_relaxed)) {
+				auto& state{ cache() };
+				std::lock_guard lck{ state.m_mut };
+				w = state.pop();
+			}
+			if (w) {
+				//Once signalled the worker may run, finish and exit before we get another look at it
+				const std::thread::id id{ w->m_id };
+				w->m_func = std::move(func);
+				w->m_block = block;
+				w->m_signal.store(run_job, std::memory_order_release);
+				detail::futex_wake_one(w->m_signal);
+				return id;
+			}
+
+			//Nothing parked, so pay for a new thread which will join the cache once it's done
+			auto fresh{ std::make_unique<worker>() };
+			fresh->m_func = std::move(func);
+			fresh->m_block = block;
+			std::thread thread{ &worker_main, fresh.get() };
+			fresh.release();
+			const std::thread::id id{ thread.get_id() };
+			thread.detach();
+			return id;
+		}
+
+	}
+
+	void thread_cache::enable(std::size_t max_parked, std::chrono::milliseconds idle_timeout) {
+		auto& state{ cache() };
+		std::lock_guard lck{ state.m_mut };
+		state.m_max_parked = max_parked;
+		state.m_idle_timeout = idle_timeout;
+		detail::thread_cache_enabled.store(true, std::memory_order_relaxed);
+	}
+
+	void thread_cache::disable() noexcept {
+		auto& state{ cache() };
+		std::lock_guard lck{ state.m_mut };
+		detail::thread_cache_enabled.store(false, std::memory_order_relaxed);
+		while (worker* w{ state.pop() }) {
+			w->m_signal.store(exit_thread, std::memory_order_release);
+			detail::futex_wake_one(w->m_signal);
+		}
+	}
+
+	std::size_t thread_cache::parked() noexcept {
+		auto& state{ cache() };
+		std::lock_guard lck{ state.m_mut };
+		return state.m_parked;
+	}
+
+}
@@ -0,0 +1,284 @@
+#include "thread_pool.h"
+
+namespace dp {
+
+	namespace detail {
+
+		//---WORK STEALING DEQUE----------------------------------------
+
+		work_stealing_deque::work_stealing_deque(std::int64_t capacity) {
+			std::int64_t size{ 1 };
+			while (size < capacity) {
+				size <<= 1;
+			}
+			m_rings.push_back(std::make_unique<ring>(size));
+			m_ring.store(m_rings.back().get(), std::memory_order_relaxed);
+		}
+
+		work_stealing_deque::ring* work_stealing_deque::grow(ring* old, std::int64_t top, std::int64_t bottom) {
+			auto bigger{ std::make_unique<ring>(old->m_capacity * 2) };
+			for (std::int64_t i = top; i < bottom; ++i) {
+				bigger->put(i, old->get(i));
+			}
+			ring* const result{ bigger.get() };
+			m_rings.push_back(std::move(bigger));
+			m_ring.store(result, std::memory_order_release);
+			return result;
+		}
+
+		void work_stealing_deque::push(pool_task* task) {
+			const std::int64_t bottom{ m_bottom.load(std::memory_order_relaxed) };
+			const std::int64_t top{ m_top.load(std::memory_order_acquire) };
+			ring* current{ m_ring.load(std::memory_order_relaxed) };
+			if (bottom - top > current->m_capacity - 1) {
+				current = grow(current, top, bottom);
+			}
+			current->put(bottom, task);
+			//A release store rather than the paper's release fence, which is equivalent here and which ThreadSanitizer understands
+			m_bottom.store(bottom + 1, std::memory_order_release);
+		}
+
+		pool_task* work_stealing_deque::take() noexcept {
+			const std::int64_t bottom{ m_bottom.load(std::memory_order_relaxed) - 1 };
+			ring* const current{ m_ring.load(std::memory_order_relaxed) };
+			m_bottom.store(bottom, std::memory_order_relaxed);
+			std::atomic_thread_fence(std::memory_order_seq_cst);
+			std::int64_t top{ m_top.load(std::memory_order_relaxed) };
+
+			if (top > bottom) {
+				m_bottom.store(bottom + 1, std::memory_order_relaxed);
+				return nullptr;
+			}
+			pool_task* task{ current->get(bottom) };
+			if (top == bottom) {
+				//The last task, which a thief may be after too
+				if (!m_top.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed)) {
+					task = nullptr;
+				}
+				m_bottom.store(bottom + 1, std::memory_order_relaxed);
+			}
+			return task;
+		}
+
+		pool_task* work_stealing_deque::steal() noexcept {
+			std::int64_t top{ m_top.load(std::memory_order_acquire) };
+			std::atomic_thread_fence(std::memory_order_seq_cst);
+			const std::int64_t bottom{ m_bottom.load(std::memory_order_acquire) };
+			if (top >= bottom) {
+				return nullptr;
+			}
+			ring* const current{ m_ring.load(std::memory_order_acquire) };
+			pool_task* const task{ current->get(top) };
+			if (!m_top.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed)) {
+				return nullptr;
+			}
+			return task;
+		}
+
+		bool work_stealing_deque::empty() const noexcept {
+			return m_top.load(std::memory_order_acquire) >= m_bottom.load(std::memory_order_acquire);
+		}
+
+	}
+
+	namespace {
+		//The pool and worker the calling thread belongs to, if any
+		thread_local const thread_pool* current_pool{ nullptr };
+		thread_local void* current_pool_worker{ nullptr };
+
+		std::uint64_t next_random(std::uint64_t& state) noexcept {
+			state ^= state << 13;
+			state ^= state >> 7;
+			state ^= state << 17;
+			return state;
+		}
+
+		constexpr std::uint32_t spins_before_sleep{ 64 };
+	}
+
+	//---THREAD POOL------------------------------------------------
+
+	thread_pool::thread_pool(std::size_t threads) {
+		if (threads == 0) {
+			threads = 1;
+		}
+		m_workers.reserve(threads);
+		for (std::size_t i = 0; i < threads; ++i) {
+			m_workers.push_back(std::make_unique<worker>());
+			m_workers.back()->m_rng = 0x9E3779B97F4A7C15ull * (i + 1);
+		}
+		m_threads.reserve(threads);
+		try {
+			for (std::size_t i = 0; i < threads; ++i) {
+				m_threads.emplace_back([this, i] { run(i); });
+			}
+		}
+		catch (...) {
+			request_stop();
+			m_threads.clear();
+			throw;
+		}
+	}
+
+	thread_pool::~thread_pool() {
+		request_stop();
+		m_threads.clear();
+
+		//Nothing can be running now, so whatever is left was never started
+		for (auto& w : m_workers) {
+			while (detail::pool_task* task{ w->m_deque.take() }) {
+				delete task;
+			}
+		}
+		for (detail::pool_task* task : m_injection) {
+			delete task;
+		}
+	}
+
+	thread_pool::worker* thread_pool::current_worker() const noexcept {
+		return current_pool == this ? static_cast<worker*>(current_pool_worker) : nullptr;
+	}
+
+	void thread_pool::enqueue(detail::pool_task* task) {
+		if (worker* self{ current_worker() }) {
+			try {
+				self->m_deque.push(task);
+			}
+			catch (...) {
+				delete task;
+				throw;
+			}
+		}
+		else {
+			{
+				std::lock_guard lck{ m_injection_mut };
+				try {
+					m_injection.push_back(task);
+				}
+				catch (...) {
+					delete task;
+					throw;
+				}
+			}
+			m_injected.fetch_add(1, std::memory_order_release);
+		}
+		wake_one();
+	}
+
+	//Pairs with the seq_cst increment of m_sleepers in run(). Either we see the sleeper, or it sees our task when it re-checks.
+	void thread_pool::wake_one() noexcept {
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		if (m_sleepers.load(std::memory_order_relaxed) != 0) {
+			m_epoch.fetch_add(1, std::memory_order_release);
+			detail::futex_wake_one(m_epoch);
+		}
+	}
+
+	detail::pool_task* thread_pool::pop_injected() noexcept {
+		if (m_injected.load(std::memory_order_acquire) == 0) {
+			return nullptr;
+		}
+		std::lock_guard lck{ m_injection_mut };
+		if (m_injection.empty()) {
+			return nullptr;
+		}
+		detail::pool_task* const task{ m_injection.front() };
+		m_injection.pop_front();
+		m_injected.fetch_sub(1, std::memory_order_relaxed);
+		return task;
+	}
+
+	detail::pool_task* thread_pool::find_work(worker* self) noexcept {
+		if (self) {
+			if (detail::pool_task* task{ self->m_deque.take() }) {
+				return task;
+			}
+		}
+		if (detail::pool_task* task{ pop_injected() }) {
+			return task;
+		}
+
+		//Start from a random victim so that thieves don't all converge on the same one
+		const std::size_t count{ m_workers.size() };
+		std::uint64_t seed{ self ? next_random(self->m_rng) : reinterpret_cast<std::uintptr_t>(&seed) };
+		const std::size_t start{ static_cast<std::size_t>(seed % count) };
+		for (std::size_t i = 0; i < count; ++i) {
+			worker* const victim{ m_workers[(start + i) % count].get() };
+			if (victim == self) {
+				continue;
+			}
+			if (detail::pool_task* task{ victim->m_deque.steal() }) {
+				return task;
+			}
+		}
+		return nullptr;
+	}
+
+	bool thread_pool::run_one(worker* self) {
+		detail::pool_task* const task{ find_work(self) };
+		if (!task) {
+			return false;
+		}
+		std::unique_ptr<detail::pool_task> owned{ task };
+		if (!m_stop.stop_requested()) {
+			owned->run(m_stop.get_token());
+		}
+		return true;
+	}
+
+	void thread_pool::run(std::size_t index) {
+		worker* const self{ m_workers[index].get() };
+		current_pool = this;
+		current_pool_worker = self;
+
+		//Tasks asking this_thread whether to stop should hear about the pool stopping
+		const dp::stop_token token{ m_stop.get_token() };
+		detail::thread_stop_scope scope{ token };
+
+		while (!token.stop_requested()) {
+			detail::pool_task* task{ find_work(self) };
+			for (std::uint32_t spin = 0; !task && spin < spins_before_sleep; ++spin) {
+				detail::cpu_relax();
+				task = find_work(self);
+			}
+
+			if (!task) {
+				const std::uint32_t epoch{ m_epoch.load(std::memory_order_acquire) };
+				m_sleepers.fetch_add(1, std::memory_order_seq_cst);
+				std::atomic_thread_fence(std::memory_order_seq_cst);
+				task = find_work(self);
+				if (!task && !token.stop_requested()) {
+					detail::futex_wait(m_epoch, epoch);
+				}
+				m_sleepers.fetch_sub(1, std::memory_order_relaxed);
+				if (!task) {
+					continue;
+				}
+			}
+
+			std::unique_ptr<detail::pool_task> owned{ task };
+			if (!token.stop_requested()) {
+				owned->run(token);
+			}
+		}
+
+		current_pool = nullptr;
+		current_pool_worker = nullptr;
+	}
+
+	std::size_t thread_pool::size() const noexcept {
+		return m_workers.size();
+	}
+
+	bool thread_pool::request_stop() noexcept {
+		const bool stopped{ m_stop.request_stop() };
+		m_epoch.fetch_add(1, std::memory_order_release);
+		detail::futex_wake_all(m_epoch);
+		return stopped;
+	}
+
+	dp::stop_token thread_pool::get_stop_token() const noexcept {
+		return m_stop.get_token();
+	}
+
+}
@@ -0,0 +1,336 @@
+#include "timer_service.h"
+
+#include <algorithm>
+#include <limits>
+#include <system_error>
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+namespace dp {
+
+	namespace {
+		constexpr std::uint64_t no_tick{ std::numeric_limits<std::uint64_t>::max() };
+
+		unsigned int count_trailing_zeros(std::uint64_t value) noexcept {
+#if defined(__GNUC__) || defined(__clang__)
+			return static_cast<unsigned int>(__builtin_ctzll(value));
+#elif defined(_MSC_VER) && defined(_M_X64)
+			unsigned long index{};
+			_BitScanForward64(&index, value);
+			return static_cast<unsigned int>(index);
+#else
+			unsigned int count{ 0 };
+			while ((value & 1) == 0) {
+				value >>= 1;
+				++count;
+			}
+			return count;
+#endif
+		}
+
+		//Offset from start to the first set bit in a circular bitmap, if there is one.
+		//We check the rest of start's word, then each following word, then wrap round to the part of start's word before start.
+		template<std::size_t Words>
+		std::optional<std::size_t> next_occupied(const std::array<std::uint64_t, Words>& bits, std::size_t start) noexcept {
+			constexpr std::size_t total{ Words * 64 };
+			const std::size_t first_word{ start / 64 };
+			const std::size_t first_bit{ start % 64 };
+			for (std::size_t i = 0; i <= Words; ++i) {
+				const std::size_t word_index{ (first_word + i) % Words };
+				std::uint64_t word{ bits[word_index] };
+				if (i == 0) {
+					word &= ~std::uint64_t{ 0 } << first_bit;
+				}
+				else if (i == Words) {
+					word &= ~(~std::uint64_t{ 0 } << first_bit);
+				}
+				if (word != 0) {
+					const std::size_t index{ word_index * 64 + count_trailing_zeros(word) };
+					return (index + total - start) % total;
+				}
+			}
+			return std::nullopt;
+		}
+	}
+
+	timer_service::timer_service(clock::duration resolution)
+		: m_resolution{ resolution > clock::duration::zero() ? resolution : clock::duration{ 1 } }, m_epoch{ clock::now() },
+		m_thread{ [this](dp::stop_token token) { run(std::move(token)); } } {}
+
+	//Joining the thread first means nothing else is touching the wheel when the timers are destroyed
+	timer_service::~timer_service() {
+		m_thread.request_stop();
+		if (m_thread.joinable()) {
+			m_thread.join();
+		}
+	}
+
+	std::uint64_t timer_service::tick_of(clock::time_point time) const noexcept {
+		if (time <= m_epoch) {
+			return 0;
+		}
+		//Round up, so that a timer never fires before its deadline
+		const auto since_epoch{ time - m_epoch };
+		return static_cast<std::uint64_t>((since_epoch + m_resolution - clock::duration{ 1 }) / m_resolution);
+	}
+
+	//The classic hierarchical wheel placement. A timer goes in the lowest level whose span covers the time until it expires,
+	//in the slot for its expiry at that level's granularity. Higher slots are cascaded down as the wheel below wraps round to them.
+	void timer_service::link(timer* t) noexcept {
+		if (t->expiry_tick < m_now_tick) {
+			t->expiry_tick = m_now_tick;
+		}
+		const std::uint64_t delta{ t->expiry_tick - m_now_tick };
+
+		std::size_t level{ 0 };
+		while (level < wheel_levels - 1 && delta >= (std::uint64_t{ 1 } << (wheel_bits * (level + 1)))) {
+			++level;
+		}
+		std::size_t slot{};
+		if (level == wheel_levels - 1 && delta >= (std::uint64_t{ 1 } << (wheel_bits * wheel_levels))) {
+			//Beyond the wheel's range entirely. Park it in the top level's furthest slot and let it be placed properly when that cascades.
+			slot = ((m_now_tick >> (wheel_bits * level)) + wheel_slots - 1) % wheel_slots;
+		}
+		else {
+			slot = (t->expiry_tick >> (wheel_bits * level)) % wheel_slots;
+		}
+
+		auto& wheel{ m_wheel[level] };
+		t->level = static_cast<std::uint8_t>(level);
+		t->slot = static_cast<std::uint8_t>(slot);
+		t->prev = nullptr;
+		t->next = wheel.slots[slot];
+		if (t->next) {
+			t->next->prev = t;
+		}
+		wheel.slots[slot] = t;
+		wheel.occupied[slot / 64] |= std::uint64_t{ 1 } << (slot % 64);
+		t->linked = true;
+	}
+
+	void timer_service::unlink(timer* t) noexcept {
+		auto& wheel{ m_wheel[t->level] };
+		if (t->prev) {
+			t->prev->next = t->next;
+		}
+		else {
+			wheel.slots[t->slot] = t->next;
+		}
+		if (t->next) {
+			t->next->prev = t->prev;
+		}
+		if (!wheel.slots[t->slot]) {
+			wheel.occupied[t->slot / 64] &= ~(std::uint64_t{ 1 } << (t->slot % 64));
+		}
+		t->prev = nullptr;
+		t->next = nullptr;
+		t->linked = false;
+	}
+
+	void timer_service::cascade(std::size_t level, std::size_t slot) noexcept {
+		auto& wheel{ m_wheel[level] };
+		timer* t{ wheel.slots[slot] };
+		wheel.slots[slot] = nullptr;
+		wheel.occupied[slot / 64] &= ~(std::uint64_t{ 1 } << (slot % 64));
+		while (t) {
+			timer* const next{ t->next };
+			link(t);
+			t = next;
+		}
+	}
+
+	//The earliest tick at which there is anything to do - either a level 0 slot with timers in it, or a higher slot due to cascade.
+	//Every tick before it can be skipped outright, as any cascade it would have done only moves empty slots.
+	std::optional<std::uint64_t> timer_service::next_event_tick() const noexcept {
+		std::uint64_t best{ no_tick };
+		if (const auto offset{ next_occupied(m_wheel[0].occupied, m_now_tick % wheel_slots) }) {
+			best = m_now_tick + *offset;
+		}
+		for (std::size_t level = 1; level < wheel_levels; ++level) {
+			const std::size_t shift{ wheel_bits * level };
+			const std::uint64_t unit{ std::uint64_t{ 1 } << shift };
+			const std::uint64_t first_boundary{ (m_now_tick + unit - 1) >> shift };
+			if (const auto offset{ next_occupied(m_wheel[level].occupied, first_boundary % wheel_slots) }) {
+				best = std::min(best, (first_boundary + *offset) << shift);
+			}
+		}
+		return best == no_tick ? std::nullopt : std::optional<std::uint64_t>{ best };
+	}
+
+	void timer_service::process_tick() noexcept {
+		//Cascade from the highest level whose boundary we're on downwards, so timers can fall through several levels in one go
+		std::size_t top{ 0 };
+		while (top < wheel_levels - 1 && (m_now_tick & ((std::uint64_t{ 1 } << (wheel_bits * (top + 1))) - 1)) == 0) {
+			++top;
+		}
+		for (std::size_t level = top; level > 0; --level) {
+			cascade(level, (m_now_tick >> (wheel_bits * level)) % wheel_slots);
+		}
+
+		auto& wheel{ m_wheel[0] };
+		const std::size_t slot{ m_now_tick % wheel_slots };
+		while (timer* t{ wheel.slots[slot] }) {
+			unlink(t);
+			t->running = true;
+			m_expired.push_back(t);
+		}
+	}
+
+	timer_service::timer_id timer_service::add(clock::time_point deadline, clock::duration period, std::function<void()> task, std::optional<dp::stop_token> token) {
+		auto new_timer{ std::make_unique<timer>() };
+		new_timer->task = std::move(task);
+		new_timer->token = std::move(token);
+		new_timer->deadline = deadline;
+		new_timer->period = period;
+		new_timer->expiry_tick = tick_of(deadline);
+
+		std::lock_guard lck{ m_mut };
+		const timer_id id{ m_next_id++ };
+		new_timer->id = id;
+		timer* const t{ new_timer.get() };
+		m_timers.emplace(id, std::move(new_timer));
+		link(t);
+		if (t->expiry_tick < m_wake_tick) {
+			m_changed = true;
+			m_cond.notify_one();
+		}
+		return id;
+	}
+
+	void timer_service::run(dp::stop_token token) {
+		std::vector<timer*> running{};
+		std::vector<std::unique_ptr<timer>> finished{};
+
+		std::unique_lock lck{ m_mut };
+		while (!token.stop_requested()) {
+			const std::optional<std::uint64_t> next{ next_event_tick() };
+			//The last tick whose time has fully arrived. Unlike tick_of(), this rounds down.
+			const std::uint64_t current{ static_cast<std::uint64_t>((clock::now() - m_epoch) / m_resolution) };
+
+			if (!next) {
+				m_wake_tick = no_tick;
+				m_cond.wait(lck, token, [this] { return m_changed; });
+				m_changed = false;
+				continue;
+			}
+			if (*next > current) {
+				m_wake_tick = *next;
+				m_cond.wait_until(lck, token, m_epoch + m_resolution * static_cast<clock::rep>(*next), [this] { return m_changed; });
+				m_changed = false;
+				continue;
+			}
+
+			//Catch up on every tick which is due, jumping straight over the empty ones
+			m_wake_tick = 0;
+			while (m_now_tick <= current) {
+				const std::optional<std::uint64_t> due{ next_event_tick() };
+				if (!due || *due > current) {
+					m_now_tick = current + 1;
+					break;
+				}
+				m_now_tick = *due;
+				process_tick();
+				++m_now_tick;
+			}
+
+			running.swap(m_expired);
+			lck.unlock();
+			for (timer* t : running) {
+				if (!t->cancelled && !(t->token && t->token->stop_requested())) {
+					t->task();
+				}
+			}
+			lck.lock();
+
+			for (timer* t : running) {
+				t->running = false;
+				if (t->period != clock::duration::zero() && !t->cancelled && !(t->token && t->token->stop_requested())) {
+					t->deadline += t->period;
+					t->expiry_tick = tick_of(t->deadline);
+					link(t);
+				}
+				else {
+					auto it{ m_timers.find(t->id) };
+					finished.push_back(std::move(it->second));
+					m_timers.erase(it);
+				}
+			}
+			running.clear();
+
+			//Tasks may own arbitrary state, so don't destroy them while holding the lock
+			if (!finished.empty()) {
+				lck.unlock();
+				finished.clear();
+				lck.lock();
+			}
+		}
+	}
+
+	timer_service::timer_id timer_service::schedule_after(clock::duration delay, std::function<void()> task) {
+		return add(clock::now() + delay, clock::duration::zero(), std::move(task), std::nullopt);
+	}
+
+	timer_service::timer_id timer_service::schedule_after(clock::duration delay, std::function<void()> task, dp::stop_token token) {
+		return add(clock::now() + delay, clock::duration::zero(), std::move(task), std::move(token));
+	}
+
+	timer_service::timer_id timer_service::schedule_at(clock::time_point when, std::function<void()> task) {
+		return add(when, clock::duration::zero(), std::move(task), std::nullopt);
+	}
+
+	timer_service::timer_id timer_service::schedule_at(clock::time_point when, std::function<void()> task, dp::stop_token token) {
+		return add(when, clock::duration::zero(), std::move(task), std::move(token));
+	}
+
+	//A zero period would be taken for a one-shot timer, and a negative one would reschedule into the past forever.
+	//A period shorter than a tick would do the same in effect, as the deadline could never catch up with the clock.
+	timer_service::clock::duration timer_service::checked_period(clock::duration period) const {
+		if (period <= clock::duration::zero()) {
+			throw std::system_error{ std::make_error_code(std::errc::invalid_argument), "Timer period must be positive" };
+		}
+		return std::max(period, m_resolution);
+	}
+
+	timer_service::timer_id timer_service::schedule_every(clock::duration period, std::function<void()> task) {
+		period = checked_period(period);
+		return add(clock::now() + period, period, std::move(task), std::nullopt);
+	}
+
+	timer_service::timer_id timer_service::schedule_every(clock::duration period, std::function<void()> task, dp::stop_token token) {
+		period = checked_period(period);
+		return add(clock::now() + period, period, std::move(task), std::move(token));
+	}
+
+	bool timer_service::cancel(timer_id id) {
+		std::unique_ptr<timer> removed{};
+		{
+			std::lock_guard lck{ m_mut };
+			auto it{ m_timers.find(id) };
+			if (it == m_timers.end() || it->second->cancelled) {
+				return false;
+			}
+			//The service thread owns a running timer until it finishes, and will clean it up then
+			if (it->second->running) {
+				it->second->cancelled = true;
+				return true;
+			}
+			if (it->second->linked) {
+				unlink(it->second.get());
+			}
+			removed = std::move(it->second);
+			m_timers.erase(it);
+		}
+		return true;
+	}
+
+	bool timer_service::request_stop() noexcept {
+		return m_thread.request_stop();
+	}
+
+	dp::stop_token timer_service::get_stop_token() const noexcept {
+		return m_thread.get_stop_token();
+	}
+
+}
@@ -0,0 +1,392 @@
+#include "topology.h"
+
+#include <algorithm>
+#include <fstream>
+#include <map>
+#include <optional>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <tuple>
+#include <utility>
+
+#if defined(__linux__)
+#include <sched.h>
+#endif
+
+namespace dp {
+
+	namespace {
+
+		//Parses the kernel's list format, for instance "0-3,8,10-11"
+		std::vector<unsigned int> parse_cpu_list(const std::string& list) {
+			std::vector<unsigned int> result{};
+			std::istringstream stream{ list };
+			std::string range{};
+			while (std::getline(stream, range, ',')) {
+				if (range.empty() || range == "\n") {
+					continue;
+				}
+				try {
+					const auto dash{ range.find('-') };
+					const unsigned long first{ std::stoul(range.substr(0, dash)) };
+					const unsigned long last{ dash == std::string::npos ? first : std::stoul(range.substr(dash + 1)) };
+					for (unsigned long id = first; id <= last; ++id) {
+						result.push_back(static_cast<unsigned int>(id));
+					}
+				}
+				catch (...) {}
+			}
+			return result;
+		}
+
+		std::optional<std::string> read_line(const std::string& path) {
+			std::ifstream file{ path };
+			std::string line{};
+			if (!std::getline(file, line)) {
+				return std::nullopt;
+			}
+			return line;
+		}
+
+		std::optional<unsigned int> read_number(const std::string& path) {
+			const std::optional<std::string> line{ read_line(path) };
+			if (!line) {
+				return std::nullopt;
+			}
+			try {
+				return static_cast<unsigned int>(std::stoul(*line));
+			}
+			catch (...) {
+				return std::nullopt;
+			}
+		}
+
+		//Hands out dense indices for whatever key identifies a group, in the order keys are first seen
+		template<typename Key>
+		class group_numbering {
+			std::map<Key, unsigned int> m_indices{};
+		public:
+			unsigned int operator()(const Key& key) {
+				return m_indices.emplace(key, static_cast<unsigned int>(m_indices.size())).first->second;
+			}
+			std::size_t size() const noexcept {
+				return m_indices.size();
+			}
+		};
+
+	}
+
+	topology topology::detect() {
+		topology result{};
+		std::vector<unsigned int> ids{};
+
+#if defined(__linux__)
+		const std::string cpu_root{ "/sys/devices/system/cpu/" };
+		if (const std::optional<std::string> online{ read_line(cpu_root + "online") }) {
+			ids = parse_cpu_list(*online);
+		}
+
+		cpu_set_t* allowed_set{ nullptr };
+		std::size_t allowed_size{ 0 };
+		for (std::size_t count = 1024; count <= 1024 * 64 && !allowed_set; count *= 2) {
+			allowed_set = CPU_ALLOC(count);
+			if (!allowed_set) {
+				break;
+			}
+			allowed_size = CPU_ALLOC_SIZE(count);
+			CPU_ZERO_S(allowed_size, allowed_set);
+			if (sched_getaffinity(0, allowed_size, allowed_set) != 0) {
+				CPU_FREE(allowed_set);
+				allowed_set = nullptr;
+			}
+		}
+
+		//Map each CPU to its NUMA node up front, as the nodes list their CPUs rather than the other way round
+		std::map<unsigned int, unsigned int> node_of{};
+		if (const std::optional<std::string> nodes{ read_line("/sys/devices/system/node/online") }) {
+			for (unsigned int node : parse_cpu_list(*nodes)) {
+				if (const std::optional<std::string> node_cpus{ read_line("/sys/devices/system/node/node" + std::to_string(node) + "/cpulist") }) {
+					for (unsigned int id : parse_cpu_list(*node_cpus)) {
+						node_of.emplace(id, node);
+					}
+				}
+			}
+		}
+
+		group_numbering<std::pair<unsigned int, unsigned int>> cores{};
+		group_numbering<unsigned int> packages{};
+		group_numbering<unsigned int> nodes{};
+		group_numbering<std::string> l2s{};
+		group_numbering<std::string> llcs{};
+
+		for (unsigned int id : ids) {
+			const std::string dir{ cpu_root + "cpu" + std::to_string(id) + "/" };
+			const unsigned int package_id{ read_number(dir + "topology/physical_package_id").value_or(0) };
+			const unsigned int core_id{ read_number(dir + "topology/core_id").value_or(id) };
+			const auto node_it{ node_of.find(id) };
+
+			//Caches are identified by the list of CPUs sharing them. The last-level cache is the highest level present which holds data.
+			std::string l2_key{ "cpu" + std::to_string(id) };
+			std::string llc_key{ l2_key };
+			unsigned int llc_level{ 0 };
+			for (unsigned int index = 0; ; ++index) {
+				const std::string cache_dir{ dir + "cache/index" + std::to_string(index) + "/" };
+				const std::optional<unsigned int> level{ read_number(cache_dir + "level") };
+				if (!level) {
+					break;
+				}
+				const std::string type{ read_line(cache_dir + "type").value_or("") };
+				const std::string shared{ read_line(cache_dir + "shared_cpu_list").value_or(std::to_string(id)) };
+				if (type == "Instruction") {
+					continue;
+				}
+				if (*level == 2) {
+					l2_key = shared;
+				}
+				if (*level >= llc_level) {
+					llc_level = *level;
+					llc_key = shared;
+				}
+			}
+
+			cpu entry{};
+			entry.id = id;
+			entry.package = packages(package_id);
+			entry.core = cores({ package_id, core_id });
+			entry.numa_node = nodes(node_it == node_of.end() ? 0 : node_it->second);
+			entry.l2 = l2s(l2_key);
+			entry.llc = llcs(llc_key);
+			entry.allowed = !allowed_set || CPU_ISSET_S(id, allowed_size, allowed_set);
+			result.m_cpus.push_back(entry);
+		}
+		if (allowed_set) {
+			CPU_FREE(allowed_set);
+		}
+
+		result.m_cores = cores.size();
+		result.m_packages = packages.size();
+		result.m_numa_nodes = nodes.size();
+		result.m_l2s = l2s.size();
+		result.m_llcs = llcs.size();
+#endif
+
+		//Without sysfs to go on, treat every CPU as a core of its own in one shared domain
+		if (result.m_cpus.empty()) {
+			const unsigned int count{ std::max(std::thread::hardware_concurrency(), 1u) };
+			for (unsigned int id = 0; id < count; ++id) {
+				result.m_cpus.push_back(cpu{ id, id, 0, 0, id, 0, 0, true });
+			}
+			result.m_cores = count;
+			result.m_packages = 1;
+			result.m_numa_nodes = 1;
+			result.m_l2s = count;
+			result.m_llcs = 1;
+		}
+
+		result.number_smt_siblings();
+		return result;
+	}
+
+	topology topology::from_cpus(std::vector<cpu> cpus) {
+		topology result{};
+		result.m_cpus = std::move(cpus);
+		for (const cpu& entry : result.m_cpus) {
+			result.m_cores = std::max<std::size_t>(result.m_cores, entry.core + std::size_t{ 1 });
+			result.m_packages = std::max<std::size_t>(result.m_packages, entry.package + std::size_t{ 1 });
+			result.m_numa_nodes = std::max<std::size_t>(result.m_numa_nodes, entry.numa_node + std::size_t{ 1 });
+			result.m_l2s = std::max<std::size_t>(result.m_l2s, entry.l2 + std::size_t{ 1 });
+			result.m_llcs = std::max<std::size_t>(result.m_llcs, entry.llc + std::size_t{ 1 });
+		}
+		result.number_smt_siblings();
+		return result;
+	}
+
+	void topology::number_smt_siblings() {
+		std::sort(m_cpus.begin(), m_cpus.end(), [](const cpu& lhs, const cpu& rhs) { return lhs.id < rhs.id; });
+		std::vector<unsigned int> seen_on_core(m_cores, 0);
+		for (cpu& entry : m_cpus) {
+			entry.smt_index = seen_on_core[entry.core]++;
+		}
+	}
+
+	const topology& topology::system() {
+		static const topology instance{ detect() };
+		return instance;
+	}
+
+	const std::vector<topology::cpu>& topology::cpus() const noexcept {
+		return m_cpus;
+	}
+
+	const topology::cpu* topology::find(unsigned int id) const noexcept {
+		const auto it{ std::lower_bound(m_cpus.begin(), m_cpus.end(), id, [](const cpu& entry, unsigned int value) { return entry.id < value; }) };
+		return it != m_cpus.end() && it->id == id ? &*it : nullptr;
+	}
+
+	std::size_t topology::core_count() const noexcept {
+		return m_cores;
+	}
+
+	std::size_t topology::package_count() const noexcept {
+		return m_packages;
+	}
+
+	std::size_t topology::numa_node_count() const noexcept {
+		return m_numa_nodes;
+	}
+
+	std::size_t topology::l2_count() const noexcept {
+		return m_l2s;
+	}
+
+	std::size_t topology::llc_count() const noexcept {
+		return m_llcs;
+	}
+
+	std::vector<unsigned int> topology::smt_siblings(unsigned int id) const {
+		std::vector<unsigned int> result{};
+		if (const cpu* target{ find(id) }) {
+			for (const cpu& entry : m_cpus) {
+				if (entry.core == target->core) {
+					result.push_back(entry.id);
+				}
+			}
+		}
+		return result;
+	}
+
+	std::vector<unsigned int> topology::llc_siblings(unsigned int id) const {
+		std::vector<unsigned int> result{};
+		if (const cpu* target{ find(id) }) {
+			for (const cpu& entry : m_cpus) {
+				if (entry.llc == target->llc) {
+					result.push_back(entry.id);
+				}
+			}
+		}
+		return result;
+	}
+
+	std::vector<unsigned int> topology::node_cpus(unsigned int node) const {
+		std::vector<unsigned int> result{};
+		for (const cpu& entry : m_cpus) {
+			if (entry.numa_node == node) {
+				result.push_back(entry.id);
+			}
+		}
+		return result;
+	}
+
+	//Allowed CPUs in compact order: grouped by node, then cache, then core
+	std::vector<const topology::cpu*> topology::allowed_cpus() const {
+		std::vector<const cpu*> result{};
+		for (const cpu& entry : m_cpus) {
+			if (entry.allowed) {
+				result.push_back(&entry);
+			}
+		}
+		std::sort(result.begin(), result.end(), [](const cpu* lhs, const cpu* rhs) {
+			return std::tie(lhs->numa_node, lhs->llc, lhs->l2, lhs->core, lhs->smt_index, lhs->id)
+				< std::tie(rhs->numa_node, rhs->llc, rhs->l2, rhs->core, rhs->smt_index, rhs->id);
+			});
+		return result;
+	}
+
+	std::vector<unsigned int> topology::compact(std::size_t count) const {
+		const std::vector<const cpu*> order{ allowed_cpus() };
+		std::vector<unsigned int> result{};
+		if (order.empty()) {
+			return result;
+		}
+		result.reserve(count);
+		for (std::size_t i = 0; i < count; ++i) {
+			result.push_back(order[i % order.size()]->id);
+		}
+		return result;
+	}
+
+	//Deal the CPUs out like cards: each round takes one CPU from each cache in turn, with the caches themselves alternating between nodes.
+	//The first allowed hardware thread of every core is dealt before any core's second, and so on, so that when caches hold different
+	//numbers of cores a small cache's siblings still wait for every core in the larger ones.
+	std::vector<unsigned int> topology::spread(std::size_t count) const {
+		const std::vector<const cpu*> compact_order{ allowed_cpus() };
+		std::vector<unsigned int> result{};
+		if (compact_order.empty()) {
+			return result;
+		}
+
+		//Ranked among the allowed CPUs only, as the affinity mask may leave a core without its first hardware thread
+		std::vector<std::size_t> seen_on_core(m_cores, 0);
+		std::map<unsigned int, std::map<unsigned int, std::vector<std::vector<const cpu*>>>> by_node_and_llc{};
+		for (const cpu* entry : compact_order) {
+			const std::size_t rank{ seen_on_core[entry->core]++ };
+			auto& ranks{ by_node_and_llc[entry->numa_node][entry->llc] };
+			if (ranks.size() <= rank) {
+				ranks.resize(rank + 1);
+			}
+			ranks[rank].push_back(entry);
+		}
+
+		//Each cache's CPUs, split by their rank on their core
+		std::vector<std::vector<std::vector<const cpu*>>> llc_groups{};
+		for (bool added = true; added; ) {
+			added = false;
+			for (auto& [node, llcs] : by_node_and_llc) {
+				if (llcs.empty()) {
+					continue;
+				}
+				auto first{ llcs.begin() };
+				llc_groups.push_back(std::move(first->second));
+				llcs.erase(first);
+				added = true;
+			}
+		}
+
+		std::vector<const cpu*> order{};
+		order.reserve(compact_order.size());
+		for (std::size_t rank = 0; order.size() < compact_order.size(); ++rank) {
+			bool added{ true };
+			for (std::size_t round = 0; added; ++round) {
+				added = false;
+				for (const auto& group : llc_groups) {
+					if (rank < group.size() && round < group[rank].size()) {
+						order.push_back(group[rank][round]);
+						added = true;
+					}
+				}
+			}
+		}
+
+		result.reserve(count);
+		for (std::size_t i = 0; i < count; ++i) {
+			result.push_back(order[i % order.size()]->id);
+		}
+		return result;
+	}
+
+	std::vector<unsigned int> topology::one_per_core() const {
+		std::vector<unsigned int> result{};
+		std::vector<bool> taken(m_cores, false);
+		for (const cpu* entry : allowed_cpus()) {
+			if (!taken[entry->core]) {
+				taken[entry->core] = true;
+				result.push_back(entry->id);
+			}
+		}
+		return result;
+	}
+
+	std::vector<unsigned int> topology::one_per_llc() const {
+		std::vector<unsigned int> result{};
+		std::vector<bool> taken(m_llcs, false);
+		for (const cpu* entry : allowed_cpus()) {
+			if (!taken[entry->llc]) {
+				taken[entry->llc] = true;
+				result.push_back(entry->id);
+			}
+		}
+		return result;
+	}
+
+}
@@ -0,0 +1,10 @@
+#include "when_any.h"
+
+namespace dp::detail {
+
+	dp::timer_service& hedge_timers() {
+		static dp::timer_service timers{};
+		return timers;
+	}
+
+}
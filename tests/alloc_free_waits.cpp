@@ -0,0 +1,208 @@
+//Stop-aware waits on condition_variable_any register their stop callbacks intrusively, so they must never allocate.
+//Global operator new is replaced with a counting version, and each kind of wait is run in a loop between two readings of the count.
+//Every wait is made to park: a second thread answers each round only once it can take the lock, which the waiter releases
+//only while asleep, and then wakes it with a notification or a stop request. The rounds answered are counted to prove it.
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <mutex>
+#include <new>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "check.h"
+#include "condition_variable.h"
+#include "jthread.h"
+#include "stop_token.h"
+
+namespace {
+	std::atomic<long> allocations{ 0 };
+
+	void* counted_alloc(std::size_t size) {
+		allocations.fetch_add(1, std::memory_order_relaxed);
+		if (void* ptr{ std::malloc(size ? size : 1) }) {
+			return ptr;
+		}
+		throw std::bad_alloc{};
+	}
+
+	template<typename Func>
+	void expect_no_allocations(const char* name, Func func) {
+		const long before{ allocations.load() };
+		func();
+		const long made{ allocations.load() - before };
+		if (made != 0) {
+			std::printf("FAIL: %s made %ld allocations\n", name, made);
+			++dp::test::failures();
+		}
+		else {
+			std::printf("ok: %s\n", name);
+		}
+	}
+
+	constexpr int iterations{ 1000 };
+
+	//Shared between the waiting thread and the thread which answers it, and guarded by mut
+	struct rounds {
+		std::mutex mut{};
+		dp::condition_variable_any cv{};
+		bool ready{ false };
+		int posted{ 0 };
+		int answered{ 0 };
+		//When set, the round is answered with a stop request on this source instead of a notification
+		dp::stop_source* to_stop{ nullptr };
+
+		//Called by the waiter with the lock held, just before it waits
+		void post(dp::stop_source* stop = nullptr) {
+			ready = false;
+			to_stop = stop;
+			++posted;
+		}
+
+		void answer(dp::stop_token token) {
+			std::unique_lock lck{ mut };
+			while (!token.stop_requested()) {
+				if (posted == answered) {
+					lck.unlock();
+					std::this_thread::yield();
+					lck.lock();
+					continue;
+				}
+				answered = posted;
+				dp::stop_source* const stop{ std::exchange(to_stop, nullptr) };
+				ready = (stop == nullptr);
+				lck.unlock();
+				if (stop) {
+					stop->request_stop();
+				}
+				else {
+					//Other threads may be waiting too, so a single notification could go to the wrong one
+					cv.notify_all();
+				}
+				lck.lock();
+			}
+		}
+	};
+}
+
+void* operator new(std::size_t size) { return counted_alloc(size); }
+void* operator new[](std::size_t size) { return counted_alloc(size); }
+void operator delete(void* ptr) noexcept { std::free(ptr); }
+void operator delete[](void* ptr) noexcept { std::free(ptr); }
+void operator delete(void* ptr, std::size_t) noexcept { std::free(ptr); }
+void operator delete[](void* ptr, std::size_t) noexcept { std::free(ptr); }
+
+int main() {
+	using namespace std::chrono_literals;
+
+	rounds r{};
+	dp::stop_source source{};
+	const dp::stop_token token{ source.get_token() };
+	dp::stop_source other{};
+	const std::array<dp::stop_token, 2> tokens{ token, other.get_token() };
+	//Each stop request needs a fresh stop state, and creating one allocates, so they are all made up front
+	std::vector<dp::stop_source> to_stop(iterations);
+	std::vector<dp::stop_token> stop_tokens{};
+	for (const auto& src : to_stop) {
+		stop_tokens.push_back(src.get_token());
+	}
+	const auto far_future{ std::chrono::steady_clock::now() + 1h };
+
+	dp::jthread answerer{ [&r](dp::stop_token stop) { r.answer(stop); } };
+
+	//Runs a wait in a loop and checks that every round was answered, which the answerer can only do while the wait is parked
+	auto run_rounds{ [&r](auto wait_once) {
+		std::unique_lock lck{ r.mut };
+		const int first{ r.answered };
+		for (int i = 0; i < iterations; ++i) {
+			wait_once(lck, i);
+		}
+		return r.answered - first;
+	} };
+
+	expect_no_allocations("wait(lock, token, pred)", [&] {
+		bool all_ready{ true };
+		const int parked{ run_rounds([&](std::unique_lock<std::mutex>& lck, int) {
+			r.post();
+			all_ready &= r.cv.wait(lck, token, [&] { return r.ready; });
+		}) };
+		DP_CHECK(parked == iterations && all_ready);
+	});
+
+	expect_no_allocations("wait(lock, token, pred) woken by a stop request", [&] {
+		int stopped{ 0 };
+		const int parked{ run_rounds([&](std::unique_lock<std::mutex>& lck, int i) {
+			r.post(&to_stop[i]);
+			stopped += !r.cv.wait(lck, stop_tokens[i], [&] { return r.ready; });
+		}) };
+		DP_CHECK(parked == iterations && stopped == iterations);
+	});
+
+	expect_no_allocations("wait_until(lock, token, time, pred)", [&] {
+		bool all_ready{ true };
+		const int parked{ run_rounds([&](std::unique_lock<std::mutex>& lck, int) {
+			r.post();
+			all_ready &= r.cv.wait_until(lck, token, far_future, [&] { return r.ready; });
+		}) };
+		DP_CHECK(parked == iterations && all_ready);
+	});
+
+	expect_no_allocations("wait_until(lock, token, time, pred) timing out", [&] {
+		std::unique_lock lck{ r.mut };
+		r.ready = false;
+		int timed_out{ 0 };
+		for (int i = 0; i < iterations; ++i) {
+			timed_out += !r.cv.wait_until(lck, token, std::chrono::steady_clock::now() + 20us, [&] { return r.ready; });
+		}
+		DP_CHECK(timed_out == iterations);
+	});
+
+	expect_no_allocations("wait_for(lock, tokens, time, pred)", [&] {
+		bool all_ready{ true };
+		const int parked{ run_rounds([&](std::unique_lock<std::mutex>& lck, int) {
+			r.post();
+			all_ready &= r.cv.wait_for(lck, tokens, 1h, [&] { return r.ready; }).satisfied;
+		}) };
+		DP_CHECK(parked == iterations && all_ready);
+	});
+
+	//Occupy every shared hook with other stop states, so that our waits fall back to a private callback
+	std::vector<dp::stop_source> others(8);
+	std::vector<dp::jthread> occupiers{};
+	bool release{ false };
+	std::atomic<int> waiting{ 0 };
+	for (auto& occupier : others) {
+		occupiers.emplace_back([&, tok = occupier.get_token()] {
+			std::unique_lock lck{ r.mut };
+			++waiting;
+			r.cv.wait(lck, tok, [&] { return release; });
+		});
+	}
+	while (waiting.load() != static_cast<int>(others.size())) {
+		std::this_thread::yield();
+	}
+	std::this_thread::sleep_for(10ms);
+
+	expect_no_allocations("wait_until with every shared hook taken", [&] {
+		bool all_ready{ true };
+		const int parked{ run_rounds([&](std::unique_lock<std::mutex>& lck, int) {
+			r.post();
+			all_ready &= r.cv.wait_until(lck, token, far_future, [&] { return r.ready; });
+		}) };
+		DP_CHECK(parked == iterations && all_ready);
+	});
+
+	{
+		std::lock_guard lck{ r.mut };
+		release = true;
+	}
+	r.cv.notify_all();
+	occupiers.clear();
+	answerer.request_stop();
+
+	return dp::test::result();
+}
@@ -0,0 +1,32 @@
+#ifndef DP_TESTS_CHECK
+#define DP_TESTS_CHECK
+
+//A minimal check for the tests, which keeps going after a failure so that one run reports every problem.
+//Unlike assert it is not compiled out by NDEBUG.
+
+#include <cstdio>
+#include <cstdlib>
+
+namespace dp::test {
+
+	inline int& failures() noexcept {
+		static int count{ 0 };
+		return count;
+	}
+
+	inline void check(bool condition, const char* expression, const char* file, int line) noexcept {
+		if (!condition) {
+			std::printf("%s:%d: check failed: %s\n", file, line, expression);
+			++failures();
+		}
+	}
+
+	inline int result() noexcept {
+		return failures() == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+	}
+
+}
+
+#define DP_CHECK(...) ::dp::test::check(static_cast<bool>(__VA_ARGS__), #__VA_ARGS__, __FILE__, __LINE__)
+
+#endif
@@ -0,0 +1,415 @@
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <vector>
+
+#include "check.h"
+#include "condition_variable.h"
+#include "jthread.h"
+#include "mutex.h"
+#include "stop_token.h"
+
+using namespace std::chrono_literals;
+
+namespace {
+
+	//Two threads take turns, so every notification must reach a thread which is (or is about to be) waiting
+	void check_ping_pong(dp::wait_policy policy) {
+		std::mutex mut{};
+		dp::condition_variable_any cv{ policy };
+		bool ping{ false };
+		constexpr int rounds{ 5000 };
+		int answered{ 0 };
+		{
+			dp::jthread partner{ [&] {
+				for (int i = 0; i < rounds; ++i) {
+					std::unique_lock lck{ mut };
+					cv.wait(lck, [&] { return ping; });
+					ping = false;
+					++answered;
+					cv.notify_one();
+				}
+			} };
+			for (int i = 0; i < rounds; ++i) {
+				std::unique_lock lck{ mut };
+				ping = true;
+				cv.notify_one();
+				cv.wait(lck, [&] { return !ping; });
+			}
+		}
+		DP_CHECK(answered == rounds);
+	}
+
+	//Several consumers share a queue, and every item pushed must be popped exactly once
+	void check_queue(dp::wait_policy policy) {
+		std::mutex mut{};
+		dp::condition_variable_any cv{ policy };
+		std::deque<int> queue{};
+		dp::stop_source done{};
+		std::atomic<long> sum{ 0 };
+		constexpr int items{ 20000 };
+		{
+			std::vector<dp::jthread> consumers{};
+			for (int i = 0; i < 4; ++i) {
+				consumers.emplace_back([&] {
+					std::unique_lock lck{ mut };
+					while (cv.wait(lck, done.get_token(), [&] { return !queue.empty(); })) {
+						sum += queue.front();
+						queue.pop_front();
+					}
+				});
+			}
+			for (int i = 1; i <= items; ++i) {
+				std::lock_guard lck{ mut };
+				queue.push_back(i);
+				cv.notify_one();
+			}
+			for (bool empty = false; !empty; std::this_thread::yield()) {
+				std::lock_guard lck{ mut };
+				empty = queue.empty();
+			}
+			done.request_stop();
+		}
+		DP_CHECK(sum.load() == static_cast<long>(items) * (items + 1) / 2);
+	}
+
+	//A stop request wakes every thread waiting on the token, and the waits report that they were stopped
+	void check_stop_wakes_waiters(dp::wait_policy policy) {
+		std::mutex mut{};
+		dp::condition_variable_any cv{ policy };
+		dp::stop_source source{};
+		std::atomic<int> waiting{ 0 };
+		std::atomic<int> stopped{ 0 };
+		{
+			std::vector<dp::jthread> waiters{};
+			for (int i = 0; i < 8; ++i) {
+				waiters.emplace_back([&] {
+					std::unique_lock lck{ mut };
+					++waiting;
+					stopped += !cv.wait(lck, source.get_token(), [] { return false; });
+				});
+			}
+			while (waiting.load() != 8) {
+				std::this_thread::yield();
+			}
+			source.request_stop();
+		}
+		DP_CHECK(stopped.load() == 8);
+	}
+
+	//More distinct tokens than there are shared stop hooks, so that some waits fall back to a callback of their own.
+	//Each stop must wake exactly the threads waiting on that token.
+	void check_many_tokens(dp::wait_policy policy) {
+		std::mutex mut{};
+		dp::condition_variable_any cv{ policy };
+		constexpr int tokens{ 10 };
+		std::vector<dp::stop_source> sources(tokens);
+		std::atomic<int> waiting{ 0 };
+		std::atomic<int> released{ 0 };
+		std::vector<dp::jthread> waiters{};
+		for (int i = 0; i < tokens * 2; ++i) {
+			waiters.emplace_back([&, token = sources[i % tokens].get_token()] {
+				std::unique_lock lck{ mut };
+				++waiting;
+				cv.wait(lck, token, [] { return false; });
+				++released;
+			});
+		}
+		while (waiting.load() != tokens * 2) {
+			std::this_thread::yield();
+		}
+		for (int i = 0; i < tokens; ++i) {
+			sources[i].request_stop();
+			const auto deadline{ std::chrono::steady_clock::now() + 5s };
+			while (released.load() < (i + 1) * 2 && std::chrono::steady_clock::now() < deadline) {
+				std::this_thread::yield();
+			}
+			std::this_thread::sleep_for(1ms);
+			DP_CHECK(released.load() == (i + 1) * 2);
+		}
+		waiters.clear();
+
+		//Hooks are released and reused as tokens come and go
+		std::unique_lock lck{ mut };
+		for (int i = 0; i < 1000; ++i) {
+			dp::stop_source source{};
+			if (i % 2) {
+				source.request_stop();
+			}
+			DP_CHECK(!cv.wait_for(lck, source.get_token(), 0ms, [] { return false; }));
+		}
+	}
+
+	void check_timeouts(dp::wait_policy policy) {
+		std::mutex mut{};
+		dp::condition_variable_any cv{ policy };
+		std::unique_lock lck{ mut };
+
+		const auto start{ std::chrono::steady_clock::now() };
+		DP_CHECK(!cv.wait_for(lck, 20ms, [] { return false; }));
+		DP_CHECK(std::chrono::steady_clock::now() - start >= 20ms);
+		DP_CHECK(cv.wait_for(lck, 20ms) == std::cv_status::timeout);
+
+		dp::stop_source source{};
+		DP_CHECK(!cv.wait_for(lck, source.get_token(), 5ms, [] { return false; }));
+		source.request_stop();
+		const auto stopped_at{ std::chrono::steady_clock::now() };
+		DP_CHECK(!cv.wait_for(lck, source.get_token(), 1h, [] { return false; }));
+		DP_CHECK(std::chrono::steady_clock::now() - stopped_at < 1s);
+		//A predicate which already holds is still reported, stop or no stop
+		DP_CHECK(cv.wait(lck, source.get_token(), [] { return true; }));
+	}
+
+	//Notifying with nobody waiting does nothing, and in particular isn't remembered for whoever waits next
+	void check_notify_without_waiters(dp::wait_policy policy) {
+		std::mutex mut{};
+		dp::condition_variable_any cv{ policy };
+		for (int i = 0; i < 1000; ++i) {
+			cv.notify_one();
+			cv.notify_all();
+		}
+		std::unique_lock lck{ mut };
+		DP_CHECK(cv.wait_for(lck, 10ms) == std::cv_status::timeout);
+	}
+
+	//In fair mode waiters are woken strictly oldest first, and notify_n wakes exactly as many as asked
+	void check_fair_order(dp::wait_policy policy) {
+		std::mutex mut{};
+		dp::condition_variable_any cv{ policy };
+		constexpr int count{ 8 };
+		std::vector<int> order{};
+		int waiting{ 0 };
+		std::vector<dp::jthread> waiters{};
+		for (int i = 0; i < count; ++i) {
+			waiters.emplace_back([&, i] {
+				std::unique_lock lck{ mut };
+				++waiting;
+				cv.wait(lck);
+				order.push_back(i);
+			});
+			//The next waiter can only take the lock once this one has released it by queueing
+			for (bool queued = false; !queued; std::this_thread::yield()) {
+				std::lock_guard lck{ mut };
+				queued = (waiting == i + 1);
+			}
+		}
+
+		auto woken{ [&] {
+			std::lock_guard lck{ mut };
+			return order.size();
+		} };
+		auto wait_for_woken{ [&](std::size_t expected) {
+			const auto deadline{ std::chrono::steady_clock::now() + 5s };
+			while (woken() < expected && std::chrono::steady_clock::now() < deadline) {
+				std::this_thread::yield();
+			}
+			//Give anyone woken by mistake the chance to show up
+			std::this_thread::sleep_for(10ms);
+		} };
+
+		cv.notify_n(3);
+		wait_for_woken(3);
+		DP_CHECK(woken() == 3);
+		for (std::size_t i = 4; i <= count; ++i) {
+			cv.notify_one();
+			wait_for_woken(i);
+			DP_CHECK(woken() == i);
+		}
+		waiters.clear();
+
+		//The first three may have reached the lock in any order, but each of them before anyone after them
+		std::vector<int> first_three(order.begin(), order.begin() + 3);
+		std::sort(first_three.begin(), first_three.end());
+		DP_CHECK(first_three == std::vector<int>({ 0, 1, 2 }));
+		for (int i = 3; i < count; ++i) {
+			DP_CHECK(order[i] == i);
+		}
+	}
+
+	//Waiters on a dp::mutex are moved onto it by notify_all rather than all woken at once. Every round must still release every
+	//waiter, as each relocks the mutex as contended so that its unlock passes the baton to the next.
+	void check_requeue_broadcast(dp::wait_policy policy) {
+		dp::mutex mut{};
+		dp::condition_variable_any cv{ policy };
+		constexpr int waiter_count{ 16 };
+		constexpr int rounds{ 200 };
+		int generation{ 0 };
+		int ready{ 0 };
+		int done{ 0 };
+		{
+			std::vector<dp::jthread> waiters{};
+			for (int i = 0; i < waiter_count; ++i) {
+				waiters.emplace_back([&] {
+					for (int seen = 0; seen < rounds;) {
+						std::unique_lock lck{ mut };
+						++ready;
+						cv.wait(lck, [&] { return generation > seen; });
+						seen = generation;
+						++done;
+					}
+				});
+			}
+			auto wait_until_count{ [&](const int& counter, int expected) {
+				for (bool reached = false; !reached; std::this_thread::yield()) {
+					std::lock_guard lck{ mut };
+					reached = (counter >= expected);
+				}
+			} };
+			for (int round = 1; round <= rounds; ++round) {
+				wait_until_count(ready, round * waiter_count);
+				{
+					std::lock_guard lck{ mut };
+					++generation;
+					cv.notify_all();
+				}
+				wait_until_count(done, round * waiter_count);
+			}
+		}
+		DP_CHECK(done == rounds * waiter_count);
+
+		//Stop-aware and timed waits on a dp::mutex work too
+		dp::stop_source source{};
+		std::atomic<int> stopped{ 0 };
+		{
+			std::vector<dp::jthread> waiters{};
+			for (int i = 0; i < 8; ++i) {
+				waiters.emplace_back([&] {
+					std::unique_lock lck{ mut };
+					stopped += !cv.wait(lck, source.get_token(), [] { return false; });
+				});
+			}
+			std::this_thread::sleep_for(10ms);
+			source.request_stop();
+		}
+		DP_CHECK(stopped.load() == 8);
+		std::unique_lock lck{ mut };
+		DP_CHECK(!cv.wait_for(lck, 5ms, [] { return false; }));
+	}
+
+	//A condition variable destroyed by a thread holding the mutex which its waiters were requeued onto must still let them go
+	void check_requeue_destroy(dp::wait_policy policy) {
+		for (int i = 0; i < 100; ++i) {
+			dp::mutex mut{};
+			auto cv{ std::make_unique<dp::condition_variable_any>(policy) };
+			bool ready{ false };
+			int waiting{ 0 };
+			std::vector<dp::jthread> waiters{};
+			for (int j = 0; j < 4; ++j) {
+				waiters.emplace_back([&] {
+					std::unique_lock lck{ mut };
+					++waiting;
+					cv->wait(lck, [&] { return ready; });
+				});
+			}
+			for (bool all = false; !all; std::this_thread::yield()) {
+				std::lock_guard lck{ mut };
+				all = (waiting == 4);
+			}
+			std::lock_guard lck{ mut };
+			ready = true;
+			cv->notify_all();
+			cv.reset();
+		}
+	}
+
+	//Waiting on several tokens at once reports which one stopped the wait
+	void check_multiple_tokens(dp::wait_policy policy) {
+		std::mutex mut{};
+		dp::condition_variable_any cv{ policy };
+		dp::stop_source job{};
+		dp::stop_source shutdown{};
+		const std::array<dp::stop_token, 2> tokens{ job.get_token(), shutdown.get_token() };
+
+		dp::stop_wait_result result{ false, std::nullopt };
+		{
+			std::atomic<bool> waiting{ false };
+			dp::jthread waiter{ [&] {
+				std::unique_lock lck{ mut };
+				waiting = true;
+				result = cv.wait(lck, tokens, [] { return false; });
+			} };
+			while (!waiting.load()) {
+				std::this_thread::yield();
+			}
+			shutdown.request_stop();
+		}
+		DP_CHECK(!result && result.stopped == std::optional<std::size_t>{ 1 });
+
+		std::unique_lock lck{ mut };
+		//A satisfied predicate is reported alongside a stop which had already happened
+		result = cv.wait(lck, tokens, [] { return true; });
+		DP_CHECK(result && result.stopped == std::optional<std::size_t>{ 1 });
+
+		//A timeout reports no stop, and the same stop state may appear more than once
+		dp::stop_source first{};
+		dp::stop_source second{};
+		result = cv.wait_for(lck, std::array<dp::stop_token, 3>{ first.get_token(), first.get_token(), second.get_token() }, 5ms, [] { return false; });
+		DP_CHECK(!result && !result.stopped);
+
+		//The first stopped token in the array is the one reported
+		second.request_stop();
+		result = cv.wait_until(lck, std::array<dp::stop_token, 2>{ first.get_token(), second.get_token() }, std::chrono::steady_clock::now() + 1h, [] { return false; });
+		DP_CHECK(!result && result.stopped == std::optional<std::size_t>{ 1 });
+	}
+
+	void check_policy(dp::wait_policy policy) {
+		check_notify_without_waiters(policy);
+		check_ping_pong(policy);
+		check_queue(policy);
+		check_stop_wakes_waiters(policy);
+		check_many_tokens(policy);
+		check_multiple_tokens(policy);
+		check_timeouts(policy);
+	}
+
+}
+
+int main() {
+	check_policy(dp::wait_policy{});
+
+	dp::wait_policy spin{};
+	spin.spin = true;
+	check_policy(spin);
+	spin.adaptive = false;
+	spin.max_spins = 100;
+	check_policy(spin);
+
+	dp::wait_policy fair{};
+	fair.fair = true;
+	check_policy(fair);
+	check_fair_order(fair);
+	fair.spin = true;
+	check_policy(fair);
+	check_fair_order(fair);
+
+	//The generic scenarios use std::mutex, which can't be requeued onto, so they also check the fallback to waking everyone
+	dp::wait_policy requeue{};
+	requeue.requeue = true;
+	check_policy(requeue);
+	check_requeue_broadcast(requeue);
+	check_requeue_destroy(requeue);
+
+	//A notification which comes with the lock held wakes a waiter which has released it, and the condition
+	//variable may be destroyed as soon as the waiter has woken
+	for (int i = 0; i < 1000; ++i) {
+		std::mutex mut{};
+		auto cv{ std::make_unique<dp::condition_variable_any>() };
+		bool ready{ false };
+		dp::jthread waiter{ [&] {
+			std::unique_lock lck{ mut };
+			cv->wait(lck, [&] { return ready; });
+			cv.reset();
+		} };
+		std::lock_guard lck{ mut };
+		ready = true;
+		cv->notify_one();
+	}
+
+	return dp::test::result();
+}
@@ -0,0 +1,47 @@
+#include <thread>
+
+#include "check.h"
+#include "jthread.h"
+
+#if defined(__linux__)
+#include <sched.h>
+#endif
+
+int main() {
+	const unsigned int effective{ dp::jthread::effective_concurrency() };
+	DP_CHECK(effective >= 1);
+	if (dp::jthread::hardware_concurrency() != 0) {
+		DP_CHECK(effective <= dp::jthread::hardware_concurrency());
+	}
+	//Cached, and recalculating without any change gives the same answer
+	DP_CHECK(dp::jthread::effective_concurrency() == effective);
+	DP_CHECK(dp::jthread::refresh_concurrency() == effective);
+	DP_CHECK(dp::jthread::effective_concurrency() == effective);
+
+#if defined(__linux__)
+	cpu_set_t original{};
+	if (sched_getaffinity(0, sizeof(original), &original) == 0) {
+		DP_CHECK(effective <= static_cast<unsigned int>(CPU_COUNT(&original)));
+
+		//Narrowing the affinity to one CPU only shows up after a refresh
+		int first{ 0 };
+		while (!CPU_ISSET(first, &original)) {
+			++first;
+		}
+		cpu_set_t single{};
+		CPU_ZERO(&single);
+		CPU_SET(first, &single);
+		if (sched_setaffinity(0, sizeof(single), &single) == 0) {
+			DP_CHECK(dp::jthread::effective_concurrency() == effective);
+			DP_CHECK(dp::jthread::refresh_concurrency() == 1);
+			DP_CHECK(dp::jthread::effective_concurrency() == 1);
+
+			sched_setaffinity(0, sizeof(original), &original);
+			DP_CHECK(dp::jthread::refresh_concurrency() == effective);
+			DP_CHECK(dp::jthread::effective_concurrency() == effective);
+		}
+	}
+#endif
+
+	return dp::test::result();
+}
@@ -0,0 +1,149 @@
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+#include "check.h"
+#include "elastic_pool.h"
+#include "this_thread.h"
+
+using namespace std::chrono_literals;
+
+namespace {
+
+	template<typename Pred>
+	bool eventually(Pred pred) {
+		const auto deadline{ std::chrono::steady_clock::now() + 10s };
+		while (!pred()) {
+			if (std::chrono::steady_clock::now() > deadline) {
+				return false;
+			}
+			std::this_thread::sleep_for(1ms);
+		}
+		return true;
+	}
+
+}
+
+int main() {
+	//A backlog grows the pool to its maximum, and once idle for the linger time it shrinks back to its minimum
+	{
+		std::atomic<int> grew{ 0 };
+		std::atomic<int> retired{ 0 };
+		std::atomic<bool> latency_reported{ true };
+		dp::elastic_pool::options options{};
+		options.min_threads = 1;
+		options.max_threads = 4;
+		options.latency_threshold = 200us;
+		options.linger = 100ms;
+		options.on_resize = [&](const dp::elastic_pool::resize_event& event) {
+			if (event.what == dp::elastic_pool::resize_event::kind::grew) {
+				++grew;
+				latency_reported = latency_reported && event.queue_latency >= 200us && event.threads <= 4;
+			}
+			else {
+				++retired;
+				latency_reported = latency_reported && event.threads >= 1;
+			}
+		};
+
+		dp::elastic_pool pool{ options };
+		DP_CHECK(pool.size() == 1);
+
+		std::atomic<int> finished{ 0 };
+		for (int i = 0; i < 200; ++i) {
+			pool.submit([&] {
+				std::this_thread::sleep_for(2ms);
+				++finished;
+			});
+		}
+		DP_CHECK(eventually([&] { return finished.load() == 200; }));
+		auto stats{ pool.get_stats() };
+		DP_CHECK(stats.peak_threads == 4);
+		DP_CHECK(stats.grown == 3);
+		DP_CHECK(grew == 3);
+		DP_CHECK(stats.queued == 0);
+
+		DP_CHECK(eventually([&] { return pool.size() == 1; }));
+		stats = pool.get_stats();
+		DP_CHECK(stats.retired == 3);
+		DP_CHECK(eventually([&] { return retired.load() == 3; }));
+		DP_CHECK(latency_reported);
+
+		//And it grows again for the next burst
+		for (int i = 0; i < 100; ++i) {
+			pool.submit([&] {
+				std::this_thread::sleep_for(2ms);
+				++finished;
+			});
+		}
+		DP_CHECK(eventually([&] { return finished.load() == 300; }));
+		DP_CHECK(pool.get_stats().grown > 3);
+	}
+
+	//A task queued behind one which never finishes still runs, as the monitor grows the pool without waiting for a submit or a take
+	{
+		dp::elastic_pool::options options{};
+		options.min_threads = 1;
+		options.max_threads = 2;
+		options.latency_threshold = 1ms;
+		dp::elastic_pool pool{ options };
+
+		std::atomic<bool> blocked{ false };
+		std::atomic<bool> ran{ false };
+		pool.submit([&](dp::stop_token token) {
+			blocked = true;
+			dp::this_thread::sleep_for(token, 1h);
+		});
+		DP_CHECK(eventually([&] { return blocked.load(); }));
+		pool.submit([&] { ran = true; });
+		DP_CHECK(eventually([&] { return ran.load(); }));
+		DP_CHECK(pool.size() == 2);
+	}
+
+	//The limits are clamped so that there is always at least one worker and the maximum is no less than the minimum
+	{
+		dp::elastic_pool::options options{};
+		options.min_threads = 0;
+		options.max_threads = 0;
+		dp::elastic_pool pool{ options };
+		DP_CHECK(pool.size() == 1);
+
+		options.min_threads = 3;
+		dp::elastic_pool larger{ options };
+		DP_CHECK(larger.size() == 3);
+	}
+
+	//Tasks with a stopped token are skipped, and a stop lets running tasks finish while discarding queued ones
+	{
+		std::atomic<int> skipped_ran{ 0 };
+		std::atomic<int> queued_ran{ 0 };
+		std::atomic<bool> started{ false };
+		std::atomic<bool> stopped{ false };
+		{
+			dp::elastic_pool::options options{};
+			options.min_threads = 1;
+			options.max_threads = 1;
+			dp::elastic_pool pool{ options };
+
+			dp::stop_source cancelled{};
+			cancelled.request_stop();
+			pool.submit(cancelled.get_token(), [&] { ++skipped_ran; });
+			pool.submit([&](dp::stop_token token) {
+				started = true;
+				dp::this_thread::sleep_for(token, 1h);
+				stopped = token.stop_requested();
+			});
+			DP_CHECK(eventually([&] { return started.load(); }));
+			for (int i = 0; i < 10; ++i) {
+				pool.submit([&] { ++queued_ran; });
+			}
+			DP_CHECK(pool.get_stats().queued == 10);
+			DP_CHECK(pool.request_stop());
+		}
+		DP_CHECK(skipped_ran == 0);
+		DP_CHECK(stopped);
+		DP_CHECK(queued_ran == 0);
+	}
+
+	return dp::test::result();
+}
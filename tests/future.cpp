@@ -0,0 +1,252 @@
+#include <atomic>
+#include <chrono>
+#include <future>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <thread>
+
+#include "check.h"
+#include "elastic_pool.h"
+#include "future.h"
+#include "this_thread.h"
+#include "thread_pool.h"
+
+using namespace std::chrono_literals;
+
+namespace {
+
+	template<typename Future>
+	bool throws_cancelled(Future& fut) {
+		try {
+			fut.get();
+		}
+		catch (const std::system_error& error) {
+			return error.code() == std::errc::operation_canceled;
+		}
+		return false;
+	}
+
+	int wait_until_stopped(dp::stop_token token) {
+		dp::this_thread::sleep_for(token, 1h);
+		return token.stop_requested() ? 1 : 0;
+	}
+
+}
+
+int main() {
+	//Results, arguments and exceptions come back through get(), which consumes the future
+	{
+		auto sum{ dp::async([](int a, int b) { return a + b; }, 2, 3) };
+		DP_CHECK(sum.valid());
+		DP_CHECK(sum.get() == 5);
+		DP_CHECK(!sum.valid());
+
+		auto moved{ dp::async([](std::unique_ptr<int> value) { return value; }, std::make_unique<int>(4)) };
+		DP_CHECK(*moved.get() == 4);
+
+		auto nothing{ dp::async([] {}) };
+		nothing.get();
+		DP_CHECK(!nothing.valid());
+
+		auto failing{ dp::async([]() -> int { throw std::runtime_error{ "failed" }; }) };
+		bool threw{ false };
+		try {
+			failing.get();
+		}
+		catch (const std::runtime_error&) {
+			threw = true;
+		}
+		DP_CHECK(threw);
+	}
+
+	//The task gets the future's token, which cancel() stops, and is its thread's current token while it runs
+	{
+		auto current{ dp::async([](dp::stop_token token) { return dp::this_thread::get_stop_token() == token; }) };
+		DP_CHECK(current.get());
+
+		auto stoppable{ dp::async(wait_until_stopped) };
+		DP_CHECK(stoppable.wait_for(10ms) == std::future_status::timeout);
+		DP_CHECK(!stoppable.is_ready());
+		stoppable.cancel();
+		DP_CHECK(stoppable.wait_for(10s) == std::future_status::ready);
+		DP_CHECK(stoppable.get() == 1);
+	}
+
+	//Destroying or overwriting a running future stops its task and waits for it
+	{
+		std::atomic<int> started{ 0 };
+		std::atomic<int> stopped{ 0 };
+		const auto task{ [&](dp::stop_token token) {
+			++started;
+			stopped += wait_until_stopped(token);
+		} };
+		{
+			auto abandoned{ dp::async(task) };
+			while (started.load() != 1) {
+				std::this_thread::sleep_for(1ms);
+			}
+		}
+		DP_CHECK(stopped == 1);
+
+		auto replaced{ dp::async(task) };
+		while (started.load() != 2) {
+			std::this_thread::sleep_for(1ms);
+		}
+		replaced = dp::async([] {});
+		DP_CHECK(stopped == 2);
+
+		//Abandoned at once, each either never starts or is stopped, and either way has finished by the time its future is gone
+		for (int i = 0; i < 10; ++i) {
+			auto abandoned{ dp::async(task) };
+		}
+		DP_CHECK(stopped == started);
+	}
+
+	//Waits which take a token give up when it is stopped, leaving the future valid
+	{
+		auto slow{ dp::async(wait_until_stopped) };
+		dp::stop_source waiter{};
+		std::thread stopper{ [&] {
+			std::this_thread::sleep_for(20ms);
+			waiter.request_stop();
+		} };
+		const auto start{ std::chrono::steady_clock::now() };
+		DP_CHECK(!slow.wait_for(waiter.get_token(), 1h));
+		DP_CHECK(std::chrono::steady_clock::now() - start < 10s);
+		stopper.join();
+		DP_CHECK(slow.valid());
+
+		bool threw{ false };
+		try {
+			slow.get(waiter.get_token());
+		}
+		catch (const std::system_error& error) {
+			threw = error.code() == std::errc::operation_canceled;
+		}
+		DP_CHECK(threw);
+		DP_CHECK(slow.valid());
+
+		dp::stop_source idle{};
+		DP_CHECK(!slow.wait_for(idle.get_token(), 10ms));
+		slow.cancel();
+		DP_CHECK(slow.wait(idle.get_token()));
+		DP_CHECK(slow.get() == 1);
+	}
+
+	//Continuations chain without threads of their own, passing on results and exceptions
+	{
+		auto chained{ dp::async([] { return 20; })
+			.then([](int value) { return value + 1; })
+			.then([](dp::stop_token, int value) { return std::to_string(value * 2); }) };
+		DP_CHECK(chained.get() == "42");
+
+		//On an already finished future the continuation runs straight away on the calling thread
+		auto ready{ dp::async([] { return 1; }) };
+		ready.wait();
+		std::thread::id ran_on{};
+		auto immediate{ std::move(ready).then([&](int) { ran_on = std::this_thread::get_id(); }).then([] { return 7; }) };
+		DP_CHECK(ran_on == std::this_thread::get_id());
+		DP_CHECK(immediate.get() == 7);
+
+		auto failed{ dp::async([]() -> int { throw std::logic_error{ "failed" }; }).then([](int value) { return value; }) };
+		bool threw{ false };
+		try {
+			failed.get();
+		}
+		catch (const std::logic_error&) {
+			threw = true;
+		}
+		DP_CHECK(threw);
+	}
+
+	//Cancelling a continuation cancels its predecessor, and the continuation itself never runs
+	{
+		std::atomic<bool> ran{ false };
+		auto chain{ dp::async(wait_until_stopped).then([&](int) {
+			ran = true;
+			return 0;
+		}) };
+		chain.cancel();
+		DP_CHECK(throws_cancelled(chain));
+		DP_CHECK(!ran);
+	}
+
+	//On executors: tasks cancelled before they start never run, and tasks dropped by a stopped executor break their promise
+	{
+		dp::thread_pool pool{ 2 };
+		auto tripled{ dp::async(pool, [](int value) { return value * 3; }, 5) };
+		DP_CHECK(tripled.get() == 15);
+
+		dp::elastic_pool elastic{};
+		auto nine{ dp::async(elastic, [] { return 9; }) };
+		DP_CHECK(nine.get() == 9);
+	}
+	{
+		std::atomic<bool> ran{ false };
+		dp::future<int> cancelled{};
+		dp::future<int> dropped{};
+		{
+			dp::thread_pool pool{ 1 };
+			std::atomic<bool> busy{ false };
+			std::atomic<bool> release{ false };
+			pool.submit([&] {
+				busy = true;
+				while (!release.load()) {
+					std::this_thread::sleep_for(1ms);
+				}
+			});
+			while (!busy.load()) {
+				std::this_thread::sleep_for(1ms);
+			}
+			cancelled = dp::async(pool, [&] {
+				ran = true;
+				return 1;
+			});
+			cancelled.cancel();
+			release = true;
+			DP_CHECK(throws_cancelled(cancelled));
+			DP_CHECK(!ran);
+
+			busy = false;
+			release = false;
+			pool.submit([&] {
+				busy = true;
+				while (!release.load()) {
+					std::this_thread::sleep_for(1ms);
+				}
+			});
+			while (!busy.load()) {
+				std::this_thread::sleep_for(1ms);
+			}
+			dropped = dp::async(pool, [] { return 1; });
+			pool.request_stop();
+			release = true;
+		}
+		bool broken{ false };
+		try {
+			dropped.get();
+		}
+		catch (const std::future_error& error) {
+			broken = error.code() == std::future_errc::broken_promise;
+		}
+		DP_CHECK(broken);
+	}
+
+	//Using a future with no state is an error
+	{
+		dp::future<int> empty{};
+		DP_CHECK(!empty.valid());
+		bool threw{ false };
+		try {
+			empty.wait();
+		}
+		catch (const std::future_error& error) {
+			threw = error.code() == std::future_errc::no_state;
+		}
+		DP_CHECK(threw);
+	}
+
+	return dp::test::result();
+}
@@ -0,0 +1,78 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+#include "check.h"
+#include "jthread_group.h"
+#include "stop_token.h"
+#include "thread_cache.h"
+
+using namespace std::chrono_literals;
+
+namespace {
+	//Spins until stopped, and then takes a while to wind down
+	void slow_to_stop(dp::stop_token token) {
+		while (!token.stop_requested()) {
+			std::this_thread::sleep_for(1ms);
+		}
+		std::this_thread::sleep_for(50ms);
+	}
+
+	void run_checks() {
+		//Every member is stopped before any is joined, so shutdown takes as long as the slowest rather than the sum of them all
+		{
+			dp::jthread_group group{};
+			for (int i = 0; i < 8; ++i) {
+				group.emplace(slow_to_stop);
+			}
+			DP_CHECK(group.size() == 8);
+			const auto start{ std::chrono::steady_clock::now() };
+			group.stop_and_join();
+			DP_CHECK(std::chrono::steady_clock::now() - start < 8 * 50ms);
+			DP_CHECK(group.empty());
+		}
+
+		//Members get distinct ids in the order they were started, and functions without a token get their arguments
+		{
+			dp::jthread_group group{};
+			std::atomic<int> sum{ 0 };
+			std::vector<dp::jthread_group::member_id> ids{};
+			for (int i = 1; i <= 4; ++i) {
+				ids.push_back(group.emplace([&sum](int value) { sum += value; }, i));
+			}
+			DP_CHECK(std::is_sorted(ids.begin(), ids.end()));
+			DP_CHECK(std::adjacent_find(ids.begin(), ids.end()) == ids.end());
+			group.join();
+			DP_CHECK(sum.load() == 10);
+		}
+
+		//A bounded join returns the stragglers by the id emplace gave them, and keeps them to be joined later
+		{
+			dp::jthread_group group{};
+			dp::stop_source release{};
+			group.emplace([] {});
+			const auto straggler{ group.emplace([token = release.get_token()] {
+				while (!token.stop_requested()) {
+					std::this_thread::sleep_for(1ms);
+				}
+			}) };
+			const auto stragglers{ group.join_for(50ms) };
+			DP_CHECK(stragglers.size() == 1 && stragglers.front() == straggler);
+			DP_CHECK(group.size() == 1);
+			release.request_stop();
+			DP_CHECK(group.join_for(5s).empty());
+			DP_CHECK(group.empty());
+		}
+	}
+}
+
+int main() {
+	run_checks();
+	//Again with members borrowed from the thread cache, whose ids are only known once they are running
+	dp::thread_cache::enable();
+	run_checks();
+	dp::thread_cache::disable();
+	return dp::test::result();
+}
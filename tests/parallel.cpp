@@ -0,0 +1,175 @@
+#include <atomic>
+#include <chrono>
+#include <numeric>
+#include <stdexcept>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+#include "check.h"
+#include "parallel.h"
+#include "thread_pool.h"
+
+using namespace std::chrono_literals;
+
+namespace {
+
+	template<typename Func>
+	bool throws_cancelled(Func func) {
+		try {
+			func();
+		}
+		catch (const std::system_error& error) {
+			return error.code() == std::errc::operation_canceled;
+		}
+		return false;
+	}
+
+	//Runs every algorithm on the shared pool if executor is null, and on executor otherwise
+	template<typename Executor>
+	void check_algorithms(Executor* executor) {
+		std::vector<long> values(1'000'000);
+		std::iota(values.begin(), values.end(), 0L);
+		const long expected_sum{ std::accumulate(values.begin(), values.end(), 0L) };
+
+		const auto run{ [executor](auto&& on_shared, auto&& on_executor) {
+			return executor ? on_executor(*executor) : on_shared();
+		} };
+
+		//for_each visits every element exactly once
+		{
+			std::vector<std::atomic<int>> visits(values.size());
+			const auto visit{ [&](long value) { ++visits[static_cast<std::size_t>(value)]; } };
+			run([&] { dp::parallel::for_each(values.begin(), values.end(), visit); return 0; },
+				[&](auto& ex) { dp::parallel::for_each(ex, values.begin(), values.end(), visit); return 0; });
+			bool once{ true };
+			for (const auto& count : visits) {
+				once = once && count.load() == 1;
+			}
+			DP_CHECK(once);
+		}
+
+		//transform writes every output in place and returns the end of the output
+		{
+			std::vector<long> out(values.size());
+			const auto twice{ [](long value) { return value * 2; } };
+			const auto end{ run([&] { return dp::parallel::transform(values.cbegin(), values.cend(), out.begin(), twice); },
+				[&](auto& ex) { return dp::parallel::transform(ex, values.cbegin(), values.cend(), out.begin(), twice); }) };
+			DP_CHECK(end == out.end());
+			bool matches{ true };
+			for (std::size_t i = 0; i < out.size(); ++i) {
+				matches = matches && out[i] == values[i] * 2;
+			}
+			DP_CHECK(matches);
+		}
+
+		//reduce agrees with a serial sum, and gives back init for an empty range
+		{
+			DP_CHECK(run([&] { return dp::parallel::reduce(values.begin(), values.end(), 0L); },
+				[&](auto& ex) { return dp::parallel::reduce(ex, values.begin(), values.end(), 0L); }) == expected_sum);
+			DP_CHECK(run([&] { return dp::parallel::reduce(values.begin(), values.begin(), 7L); },
+				[&](auto& ex) { return dp::parallel::reduce(ex, values.begin(), values.begin(), 7L); }) == 7);
+		}
+
+		//find_if returns the first of several matches, or last if there are none
+		{
+			const auto multiple{ [](long value) { return value % 100'003 == 100'000; } };
+			const auto found{ run([&] { return dp::parallel::find_if(values.begin(), values.end(), multiple); },
+				[&](auto& ex) { return dp::parallel::find_if(ex, values.begin(), values.end(), multiple); }) };
+			DP_CHECK(found != values.end() && *found == 100'000);
+
+			const auto negative{ [](long value) { return value < 0; } };
+			DP_CHECK(run([&] { return dp::parallel::find_if(values.begin(), values.end(), negative); },
+				[&](auto& ex) { return dp::parallel::find_if(ex, values.begin(), values.end(), negative); }) == values.end());
+		}
+
+		//any_of stops searching soon after a match near the start of the range
+		{
+			std::atomic<long> visited{ 0 };
+			const auto early{ [&](long value) {
+				visited.fetch_add(1, std::memory_order_relaxed);
+				return value == 100;
+			} };
+			DP_CHECK(run([&] { return dp::parallel::any_of(values.begin(), values.end(), early); },
+				[&](auto& ex) { return dp::parallel::any_of(ex, values.begin(), values.end(), early); }));
+			DP_CHECK(visited.load() < static_cast<long>(values.size()) / 2);
+
+			const auto negative{ [](long value) { return value < 0; } };
+			DP_CHECK(!run([&] { return dp::parallel::any_of(values.begin(), values.end(), negative); },
+				[&](auto& ex) { return dp::parallel::any_of(ex, values.begin(), values.end(), negative); }));
+		}
+
+		//A stop part-way through abandons the rest of the range and is reported as cancellation
+		{
+			dp::stop_source source{};
+			std::atomic<long> visited{ 0 };
+			const auto stop_early{ [&](long value) {
+				visited.fetch_add(1, std::memory_order_relaxed);
+				if (value == 1000) {
+					source.request_stop();
+				}
+			} };
+			DP_CHECK(throws_cancelled([&] {
+				run([&] { dp::parallel::for_each(source.get_token(), values.begin(), values.end(), stop_early); return 0; },
+					[&](auto& ex) { dp::parallel::for_each(ex, source.get_token(), values.begin(), values.end(), stop_early); return 0; });
+			}));
+			DP_CHECK(visited.load() < static_cast<long>(values.size()) / 2);
+
+			//As is a stop made before the call, which then touches nothing
+			visited = 0;
+			DP_CHECK(throws_cancelled([&] {
+				run([&] { return dp::parallel::reduce(source.get_token(), values.begin(), values.end(), 0L); },
+					[&](auto& ex) { return dp::parallel::reduce(ex, source.get_token(), values.begin(), values.end(), 0L); });
+			}));
+			DP_CHECK(throws_cancelled([&] {
+				run([&] { dp::parallel::for_each(source.get_token(), values.begin(), values.end(), stop_early); return 0; },
+					[&](auto& ex) { dp::parallel::for_each(ex, source.get_token(), values.begin(), values.end(), stop_early); return 0; });
+			}));
+			DP_CHECK(visited == 0);
+		}
+
+		//An exception from any element stops the rest and is rethrown
+		{
+			bool threw{ false };
+			const auto failing{ [](long value) {
+				if (value == 500'000) {
+					throw std::runtime_error{ "failed" };
+				}
+			} };
+			try {
+				run([&] { dp::parallel::for_each(values.begin(), values.end(), failing); return 0; },
+					[&](auto& ex) { dp::parallel::for_each(ex, values.begin(), values.end(), failing); return 0; });
+			}
+			catch (const std::runtime_error&) {
+				threw = true;
+			}
+			DP_CHECK(threw);
+		}
+	}
+
+}
+
+int main() {
+	check_algorithms<dp::thread_pool>(nullptr);
+
+	dp::thread_pool pool{ 3 };
+	check_algorithms(&pool);
+
+	//Calls nested inside the pool's own tasks help rather than deadlock, even when every worker is doing the same
+	{
+		std::vector<long> values(10'000);
+		std::iota(values.begin(), values.end(), 0L);
+		const long expected{ std::accumulate(values.begin(), values.end(), 0L) };
+		std::vector<long> sums(16);
+		dp::parallel::for_each(pool, sums.begin(), sums.end(), [&](long& sum) {
+			sum = dp::parallel::reduce(pool, values.begin(), values.end(), 0L);
+		});
+		bool all{ true };
+		for (long sum : sums) {
+			all = all && sum == expected;
+		}
+		DP_CHECK(all);
+	}
+
+	return dp::test::result();
+}
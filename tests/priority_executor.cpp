@@ -0,0 +1,210 @@
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <mutex>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+#include "check.h"
+#include "priority_executor.h"
+#include "this_thread.h"
+
+using namespace std::chrono_literals;
+
+namespace {
+
+	//Holds an executor's only worker until released, so that a test can queue tasks and then watch the order they run in
+	class gate {
+		std::atomic<bool> m_entered{ false };
+		std::atomic<bool> m_open{ false };
+
+	public:
+		void block(dp::priority_executor& executor, std::size_t lane) {
+			executor.submit(lane, [this] {
+				m_entered = true;
+				while (!m_open.load()) {
+					std::this_thread::sleep_for(100us);
+				}
+			});
+			while (!m_entered.load()) {
+				std::this_thread::sleep_for(100us);
+			}
+		}
+
+		void open() {
+			m_open = true;
+		}
+	};
+
+	//The lanes tasks ran from, in the order they ran
+	class recorder {
+		std::mutex m_mut{};
+		std::vector<std::size_t> m_order{};
+
+	public:
+		void submit(dp::priority_executor& executor, std::size_t lane) {
+			executor.submit(lane, [this, lane] {
+				std::lock_guard lck{ m_mut };
+				m_order.push_back(lane);
+			});
+		}
+
+		std::vector<std::size_t> wait_for(std::size_t count) {
+			for (;;) {
+				{
+					std::lock_guard lck{ m_mut };
+					if (m_order.size() >= count) {
+						return m_order;
+					}
+				}
+				std::this_thread::sleep_for(1ms);
+			}
+		}
+	};
+
+}
+
+int main() {
+	//Strict: every queued task in a higher lane runs before any in a lower one, and each lane is FIFO
+	{
+		dp::priority_executor::options options{};
+		options.weights = { 1, 1, 1 };
+		options.threads = 1;
+		dp::priority_executor executor{ options };
+		DP_CHECK(executor.lanes() == 3);
+		DP_CHECK(executor.size() == 1);
+
+		gate held{};
+		held.block(executor, 0);
+		recorder order{};
+		for (int i = 0; i < 10; ++i) {
+			order.submit(executor, 2 - static_cast<std::size_t>(i % 3));
+		}
+		DP_CHECK(executor.queued() == 10);
+		held.open();
+
+		const std::vector<std::size_t> ran{ order.wait_for(10) };
+		const std::vector<std::size_t> expected{ 0, 0, 0, 1, 1, 1, 2, 2, 2, 2 };
+		DP_CHECK(ran == expected);
+	}
+
+	//Weighted: while both lanes have work they are served in the ratio of their weights, and the lighter lane is never starved
+	{
+		dp::priority_executor::options options{};
+		options.policy = dp::priority_executor::lane_policy::weighted;
+		options.weights = { 3, 1 };
+		options.threads = 1;
+		dp::priority_executor executor{ options };
+
+		gate held{};
+		held.block(executor, 0);
+		recorder order{};
+		for (int i = 0; i < 40; ++i) {
+			order.submit(executor, 0);
+			order.submit(executor, 1);
+		}
+		held.open();
+
+		const std::vector<std::size_t> ran{ order.wait_for(80) };
+		std::size_t first_lane{ 0 };
+		for (std::size_t i = 0; i < 40; ++i) {
+			first_lane += ran[i] == 0;
+		}
+		DP_CHECK(first_lane >= 29 && first_lane <= 31);
+		//Never more than three of lane 0 in a row while lane 1 is waiting
+		std::size_t run_length{ 0 };
+		bool interleaved{ true };
+		for (std::size_t i = 0; i < 40; ++i) {
+			run_length = ran[i] == 0 ? run_length + 1 : 0;
+			interleaved = interleaved && run_length <= 3;
+		}
+		DP_CHECK(interleaved);
+	}
+
+	//Tasks whose token is stopped while they are queued are discarded without running, and counted
+	{
+		dp::priority_executor::options options{};
+		options.threads = 1;
+		dp::priority_executor executor{ options };
+
+		gate held{};
+		held.block(executor, 0);
+		dp::stop_source cancel{};
+		std::atomic<int> cancelled_ran{ 0 };
+		std::atomic<int> finished{ 0 };
+		bool own_token{ false };
+		for (int i = 0; i < 5; ++i) {
+			executor.submit(1, cancel.get_token(), [&] { ++cancelled_ran; });
+		}
+		dp::stop_source live{};
+		executor.submit(0, live.get_token(), [&](dp::stop_token token) {
+			own_token = (token == live.get_token());
+			++finished;
+		});
+		//Runs after the cancelled tasks, as the single worker takes lane 1 in order
+		executor.submit(1, [&] { ++finished; });
+		cancel.request_stop();
+		held.open();
+
+		while (finished.load() != 2) {
+			std::this_thread::sleep_for(1ms);
+		}
+		DP_CHECK(own_token);
+		DP_CHECK(cancelled_ran == 0);
+		DP_CHECK(executor.discarded() == 5);
+	}
+
+	//Bad lanes and an empty set of lanes are rejected
+	{
+		dp::priority_executor::options options{};
+		options.threads = 1;
+		dp::priority_executor executor{ options };
+		bool threw{ false };
+		try {
+			executor.submit(executor.lanes(), [] {});
+		}
+		catch (const std::system_error& error) {
+			threw = error.code() == std::errc::invalid_argument;
+		}
+		DP_CHECK(threw);
+
+		options.weights.clear();
+		threw = false;
+		try {
+			dp::priority_executor empty{ options };
+		}
+		catch (const std::system_error& error) {
+			threw = error.code() == std::errc::invalid_argument;
+		}
+		DP_CHECK(threw);
+	}
+
+	//Stopping discards whatever has not started
+	{
+		std::atomic<int> queued_ran{ 0 };
+		bool stopped{ false };
+		{
+			dp::priority_executor::options options{};
+			options.threads = 1;
+			dp::priority_executor executor{ options };
+			std::atomic<bool> started{ false };
+			executor.submit(0, [&](dp::stop_token token) {
+				started = true;
+				dp::this_thread::sleep_for(token, 1h);
+				stopped = token.stop_requested();
+			});
+			while (!started.load()) {
+				std::this_thread::sleep_for(1ms);
+			}
+			for (int i = 0; i < 10; ++i) {
+				executor.submit(0, [&] { ++queued_ran; });
+			}
+			DP_CHECK(executor.request_stop());
+		}
+		DP_CHECK(stopped);
+		DP_CHECK(queued_ran == 0);
+	}
+
+	return dp::test::result();
+}
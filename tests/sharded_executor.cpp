@@ -0,0 +1,171 @@
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+#include "check.h"
+#include "sharded_executor.h"
+#include "this_thread.h"
+#include "topology.h"
+
+using namespace std::chrono_literals;
+
+namespace {
+
+	struct numbered_task : dp::detail::shard_task {
+		std::size_t m_producer{ 0 };
+		std::size_t m_sequence{ 0 };
+
+		void run(const dp::stop_token&) override {}
+	};
+
+	//Several producers push at once while one consumer pops. Each producer's tasks must come out exactly once and in the order it pushed them.
+	void check_inbox_ordering() {
+		constexpr std::size_t producers{ 4 };
+		constexpr std::size_t per_producer{ 50000 };
+		std::vector<numbered_task> tasks(producers * per_producer);
+		dp::detail::mpsc_inbox inbox{};
+
+		std::vector<std::thread> threads{};
+		for (std::size_t p = 0; p < producers; ++p) {
+			threads.emplace_back([&, p] {
+				for (std::size_t i = 0; i < per_producer; ++i) {
+					numbered_task& task{ tasks[p * per_producer + i] };
+					task.m_producer = p;
+					task.m_sequence = i;
+					inbox.push(&task);
+				}
+			});
+		}
+
+		std::vector<std::size_t> next(producers, 0);
+		bool in_order{ true };
+		for (std::size_t popped = 0; popped < tasks.size();) {
+			if (dp::detail::shard_task* task{ inbox.pop() }) {
+				const auto& numbered{ *static_cast<numbered_task*>(task) };
+				in_order = in_order && numbered.m_sequence == next[numbered.m_producer];
+				++next[numbered.m_producer];
+				++popped;
+			}
+			else {
+				std::this_thread::yield();
+			}
+		}
+		for (auto& thread : threads) {
+			thread.join();
+		}
+		DP_CHECK(in_order);
+		DP_CHECK(inbox.pop() == nullptr);
+	}
+
+	//Three shards, which may all share one CPU where the process has only the one
+	std::vector<unsigned int> three_cpus() {
+		std::vector<unsigned int> cpus{ dp::topology::system().one_per_core() };
+		cpus.resize(3, cpus.front());
+		return cpus;
+	}
+
+}
+
+int main() {
+	check_inbox_ordering();
+
+	//Tasks run on the shard they were submitted to, in the order each producer submitted them, with no shared state
+	{
+		dp::sharded_executor executor{ three_cpus() };
+		DP_CHECK(executor.size() == 3);
+		DP_CHECK(!executor.current_shard());
+
+		constexpr int producers{ 3 };
+		constexpr int per_producer{ 10000 };
+		//Only ever touched by shard s's thread
+		std::vector<std::vector<int>> next(executor.size(), std::vector<int>(producers, 0));
+		std::vector<int> out_of_order(executor.size(), 0);
+		std::vector<int> wrong_shard(executor.size(), 0);
+		std::atomic<int> finished{ 0 };
+
+		std::vector<std::thread> threads{};
+		for (int p = 0; p < producers; ++p) {
+			threads.emplace_back([&, p] {
+				for (int i = 0; i < per_producer; ++i) {
+					const std::size_t s{ static_cast<std::size_t>(i) % executor.size() };
+					executor.submit_to(s, [&, s, p, i] {
+						wrong_shard[s] += executor.current_shard() != s;
+						out_of_order[s] += next[s][static_cast<std::size_t>(p)] > i;
+						next[s][static_cast<std::size_t>(p)] = i;
+						finished.fetch_add(1, std::memory_order_release);
+					});
+				}
+			});
+		}
+		for (auto& thread : threads) {
+			thread.join();
+		}
+		while (finished.load(std::memory_order_acquire) != producers * per_producer) {
+			std::this_thread::sleep_for(1ms);
+		}
+		for (std::size_t s = 0; s < executor.size(); ++s) {
+			DP_CHECK(wrong_shard[s] == 0);
+			DP_CHECK(out_of_order[s] == 0);
+			DP_CHECK(executor.cpu_of(s) == three_cpus()[s]);
+		}
+
+		bool threw{ false };
+		try {
+			executor.submit_to(executor.size(), [] {});
+		}
+		catch (const std::system_error& error) {
+			threw = error.code() == std::errc::invalid_argument;
+		}
+		DP_CHECK(threw);
+	}
+
+	//Tokens: a task's own token or the executor's, and tasks whose token is already stopped never run
+	{
+		dp::sharded_executor executor{ three_cpus() };
+		dp::stop_source stopped{};
+		stopped.request_stop();
+		std::atomic<int> skipped_ran{ 0 };
+		std::atomic<int> finished{ 0 };
+		bool executor_token{ false };
+
+		executor.submit_to(1, stopped.get_token(), [&] { ++skipped_ran; });
+		executor.submit_to(1, [&](dp::stop_token token) {
+			executor_token = (token == executor.get_stop_token());
+			++finished;
+		});
+		while (finished.load() != 1) {
+			std::this_thread::sleep_for(1ms);
+		}
+		DP_CHECK(skipped_ran == 0);
+		DP_CHECK(executor_token);
+	}
+
+	//A stop reaches every shard at once, and discards the tasks queued behind the running ones
+	{
+		std::atomic<int> started{ 0 };
+		std::atomic<int> stopped{ 0 };
+		std::atomic<int> queued_ran{ 0 };
+		{
+			dp::sharded_executor executor{ three_cpus() };
+			for (std::size_t s = 0; s < executor.size(); ++s) {
+				executor.submit_to(s, [&](dp::stop_token token) {
+					++started;
+					dp::this_thread::sleep_for(token, 1h);
+					stopped += token.stop_requested();
+				});
+				executor.submit_to(s, [&] { ++queued_ran; });
+			}
+			while (started.load() != 3) {
+				std::this_thread::sleep_for(1ms);
+			}
+			DP_CHECK(executor.request_stop());
+		}
+		DP_CHECK(stopped == 3);
+		DP_CHECK(queued_ran == 0);
+	}
+
+	return dp::test::result();
+}
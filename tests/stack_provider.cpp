@@ -0,0 +1,147 @@
+#include <atomic>
+#include <cstddef>
+#include <cstring>
+#include <memory>
+#include <vector>
+
+#include "check.h"
+#include "jthread.h"
+#include "stack_provider.h"
+#include "thread_attributes.h"
+
+namespace {
+
+	//Forwards to another provider, counting the stacks handed out and back and remembering the last one
+	class counting_provider : public dp::stack_provider {
+		std::shared_ptr<dp::stack_provider> m_upstream;
+
+	public:
+		std::atomic<int> allocated{ 0 };
+		std::atomic<int> deallocated{ 0 };
+		dp::thread_stack last{};
+
+		explicit counting_provider(std::shared_ptr<dp::stack_provider> upstream) : m_upstream{ std::move(upstream) } {}
+
+		dp::thread_stack allocate() override {
+			last = m_upstream->allocate();
+			++allocated;
+			return last;
+		}
+
+		void deallocate(dp::thread_stack stack) noexcept override {
+			++deallocated;
+			m_upstream->deallocate(stack);
+		}
+	};
+
+	bool contains(dp::thread_stack stack, const void* address) {
+		const auto* base{ static_cast<const std::byte*>(stack.base) };
+		const auto* ptr{ static_cast<const std::byte*>(address) };
+		return ptr >= base && ptr < base + stack.size;
+	}
+
+}
+
+int main() {
+	//Stacks from mmap are page-rounded, writable throughout, and can be handed straight back
+	{
+		dp::mmap_stack_provider provider{ dp::stack_options{ 100 * 1000, 1 } };
+		DP_CHECK(provider.options().size >= 100 * 1000);
+		DP_CHECK(provider.options().size % 4096 == 0);
+		DP_CHECK(provider.options().guard_size >= 1);
+
+		const auto stack{ provider.allocate() };
+		DP_CHECK(stack.base != nullptr);
+		DP_CHECK(stack.size == provider.options().size);
+		std::memset(stack.base, 0xAB, stack.size);
+		provider.deallocate(stack);
+	}
+
+	//A pool preallocates, reuses what is handed back, and keeps no more than max_free
+	{
+		auto upstream{ std::make_shared<counting_provider>(std::make_shared<dp::mmap_stack_provider>(dp::stack_options{ 64 * 1024 })) };
+		{
+			dp::stack_pool pool{ upstream, 2, 3 };
+			DP_CHECK(pool.available() == 2);
+			DP_CHECK(upstream->allocated == 2);
+
+			const auto first{ pool.allocate() };
+			DP_CHECK(pool.available() == 1);
+			pool.deallocate(first);
+			const auto again{ pool.allocate() };
+			DP_CHECK(again.base == first.base);
+			DP_CHECK(upstream->allocated == 2);
+
+			std::vector<dp::thread_stack> stacks{ again };
+			for (int i = 0; i < 4; ++i) {
+				stacks.push_back(pool.allocate());
+			}
+			DP_CHECK(pool.available() == 0);
+			DP_CHECK(upstream->allocated == 5);
+			for (const auto& stack : stacks) {
+				pool.deallocate(stack);
+			}
+			DP_CHECK(pool.available() == 3);
+			DP_CHECK(upstream->deallocated == 2);
+		}
+		//Destroying the pool hands everything back upstream
+		DP_CHECK(upstream->deallocated == upstream->allocated);
+	}
+
+	//Huge page stacks fall back rather than fail when the system has no huge pages to give
+	for (const auto pages : { dp::stack_pages::transparent_huge, dp::stack_pages::huge }) {
+		dp::stack_options options{};
+		options.size = 100 * 1024;
+		options.pages = pages;
+		options.numa_node = 0;
+		auto provider{ std::make_shared<dp::mmap_stack_provider>(options) };
+		DP_CHECK(provider->options().size >= options.size);
+
+		int result{ 0 };
+		{
+			dp::jthread worker{ dp::thread_attributes{}.set_stack_provider(provider), [&] {
+				volatile char buffer[64 * 1024]{};
+				buffer[sizeof(buffer) - 1] = 1;
+				result = buffer[sizeof(buffer) - 1];
+			} };
+		}
+		DP_CHECK(result == 1);
+	}
+
+#if defined(__linux__) || defined(__APPLE__)
+	//A thread runs on the stack its provider gave it, which is returned once the thread is joined
+	{
+		auto provider{ std::make_shared<counting_provider>(std::make_shared<dp::mmap_stack_provider>()) };
+		for (int i = 0; i < 10; ++i) {
+			const void* local{ nullptr };
+			{
+				dp::jthread worker{ dp::thread_attributes{}.set_stack_provider(provider), [&] {
+					int on_stack{ 0 };
+					local = &on_stack;
+				} };
+				DP_CHECK(provider->deallocated == i);
+			}
+			DP_CHECK(contains(provider->last, local));
+			DP_CHECK(provider->allocated == i + 1);
+			DP_CHECK(provider->deallocated == i + 1);
+		}
+	}
+
+	//Threads on pooled stacks reuse them rather than mapping more
+	{
+		auto upstream{ std::make_shared<counting_provider>(std::make_shared<dp::mmap_stack_provider>(dp::stack_options{ 32 * 1024 })) };
+		auto pool{ std::make_shared<dp::stack_pool>(upstream, 4) };
+		for (int round = 0; round < 5; ++round) {
+			std::vector<dp::jthread> workers{};
+			for (int i = 0; i < 4; ++i) {
+				workers.emplace_back(dp::thread_attributes{}.set_stack_provider(pool), [] {});
+			}
+			DP_CHECK(pool->available() == 0);
+		}
+		DP_CHECK(pool->available() == 4);
+		DP_CHECK(upstream->allocated == 4);
+	}
+#endif
+
+	return dp::test::result();
+}
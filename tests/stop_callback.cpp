@@ -0,0 +1,97 @@
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <thread>
+
+#include "check.h"
+#include "jthread.h"
+#include "stop_token.h"
+
+using namespace std::chrono_literals;
+
+namespace {
+	struct counter {
+		int* m_count;
+		void operator()() const noexcept {
+			++*m_count;
+		}
+	};
+}
+
+int main() {
+	//A registered callback runs once, on the thread which requests the stop
+	{
+		dp::stop_source source{};
+		int count{ 0 };
+		dp::stop_callback callback{ source.get_token(), counter{ &count } };
+		DP_CHECK(count == 0);
+		DP_CHECK(source.request_stop());
+		DP_CHECK(count == 1);
+		source.request_stop();
+		DP_CHECK(count == 1);
+	}
+
+	//A callback registered after the stop runs straight away, in its constructor
+	{
+		dp::stop_source source{};
+		source.request_stop();
+		int count{ 0 };
+		dp::stop_callback callback{ source.get_token(), counter{ &count } };
+		DP_CHECK(count == 1);
+	}
+
+	//A token with no stop state can never be stopped, so its callbacks are never invoked
+	{
+		const dp::stop_source source{ dp::nostopstate };
+		DP_CHECK(!source.get_token().stop_possible());
+		int count{ 0 };
+		{
+			dp::stop_callback callback{ source.get_token(), counter{ &count } };
+		}
+		DP_CHECK(count == 0);
+	}
+
+	//A callback destroyed before the stop is never run
+	{
+		dp::stop_source source{};
+		int count{ 0 };
+		{
+			dp::stop_callback callback{ source.get_token(), counter{ &count } };
+		}
+		source.request_stop();
+		DP_CHECK(count == 0);
+	}
+
+	//A callback may destroy its own stop_callback without deadlocking
+	{
+		dp::stop_source source{};
+		std::optional<dp::stop_callback<std::function<void()>>> callback{};
+		bool ran{ false };
+		callback.emplace(source.get_token(), [&] { ran = true; callback.reset(); });
+		source.request_stop();
+		DP_CHECK(ran);
+		DP_CHECK(!callback);
+	}
+
+	//Destroying a stop_callback on another thread while it runs waits for it to finish
+	{
+		dp::stop_source source{};
+		std::atomic<bool> started{ false };
+		std::atomic<bool> finished{ false };
+		auto callback{ std::make_unique<dp::stop_callback<std::function<void()>>>(source.get_token(), [&] {
+			started = true;
+			std::this_thread::sleep_for(20ms);
+			finished = true;
+		}) };
+		dp::jthread stopper{ [&] { source.request_stop(); } };
+		while (!started.load()) {
+			std::this_thread::yield();
+		}
+		callback.reset();
+		DP_CHECK(finished.load());
+	}
+
+	return dp::test::result();
+}
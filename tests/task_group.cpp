@@ -0,0 +1,168 @@
+#include <atomic>
+#include <chrono>
+#include <future>
+#include <stdexcept>
+#include <string>
+#include <thread>
+
+#include "check.h"
+#include "task_group.h"
+#include "this_thread.h"
+#include "thread_pool.h"
+
+using namespace std::chrono_literals;
+
+int main() {
+	//Tasks get their arguments and the group's token, and have all finished once wait() returns
+	{
+		std::atomic<int> sum{ 0 };
+		std::atomic<int> group_token{ 0 };
+		dp::task_group group{};
+		for (int i = 0; i < 8; ++i) {
+			group.spawn([&](dp::stop_token token, int value) {
+				sum += value;
+				group_token += token == group.get_stop_token() && dp::this_thread::get_stop_token() == token;
+			}, i);
+		}
+		group.wait();
+		DP_CHECK(sum == 28);
+		DP_CHECK(group_token == 8);
+		DP_CHECK(!group.stop_requested());
+	}
+
+	//The first exception stops the siblings and is rethrown by the destructor; later ones are dropped
+	{
+		std::atomic<int> stopped{ 0 };
+		std::string caught{};
+		const auto start{ std::chrono::steady_clock::now() };
+		try {
+			dp::task_group group{};
+			for (int i = 0; i < 3; ++i) {
+				group.spawn([&](dp::stop_token token) { stopped += dp::this_thread::sleep_for(token, 1h); });
+			}
+			group.spawn([] {
+				std::this_thread::sleep_for(5ms);
+				throw std::runtime_error{ "first" };
+			});
+			//Only throws once the first has stopped the group
+			group.spawn([](dp::stop_token token) {
+				dp::this_thread::sleep_for(token, 1h);
+				throw std::logic_error{ "second" };
+			});
+		}
+		catch (const std::runtime_error& error) {
+			caught = error.what();
+		}
+		catch (const std::logic_error& error) {
+			caught = error.what();
+		}
+		DP_CHECK(caught == "first");
+		DP_CHECK(stopped == 3);
+		DP_CHECK(std::chrono::steady_clock::now() - start < 10s);
+	}
+
+	//Once wait() has rethrown, the destructor doesn't throw again
+	{
+		bool rethrown{ false };
+		bool destructor_threw{ false };
+		try {
+			dp::task_group group{};
+			group.spawn([] { throw 5; });
+			try {
+				group.wait();
+			}
+			catch (int value) {
+				rethrown = value == 5;
+			}
+			DP_CHECK(group.stop_requested());
+		}
+		catch (...) {
+			destructor_threw = true;
+		}
+		DP_CHECK(rethrown);
+		DP_CHECK(!destructor_threw);
+	}
+
+	//A group unwound by another exception stops its tasks, waits for them, and lets that exception through
+	{
+		std::atomic<int> stopped{ 0 };
+		std::string caught{};
+		try {
+			dp::task_group group{};
+			group.spawn([&](dp::stop_token token) {
+				stopped += dp::this_thread::sleep_for(token, 1h);
+				throw 1;
+			});
+			throw std::string{ "outer" };
+		}
+		catch (const std::string& error) {
+			caught = error;
+		}
+		DP_CHECK(caught == "outer");
+		DP_CHECK(stopped == 1);
+	}
+
+	//On a pool, tasks may spawn more tasks into their own group, all of which are waited for
+	{
+		dp::thread_pool pool{ 2 };
+		std::atomic<int> ran{ 0 };
+		{
+			dp::task_group group{};
+			for (int i = 0; i < 100; ++i) {
+				group.spawn(pool, [&] {
+					++ran;
+					group.spawn(pool, [&] { ++ran; });
+				});
+			}
+			group.wait();
+			DP_CHECK(ran == 200);
+		}
+	}
+
+	//A task dropped unrun by a stopped executor fails the group with a broken promise
+	{
+		bool broken{ false };
+		try {
+			dp::task_group group{};
+			dp::thread_pool pool{ 1 };
+			std::atomic<bool> busy{ false };
+			std::atomic<bool> release{ false };
+			pool.submit([&] {
+				busy = true;
+				while (!release.load()) {
+					std::this_thread::sleep_for(1ms);
+				}
+			});
+			while (!busy.load()) {
+				std::this_thread::sleep_for(1ms);
+			}
+			group.spawn(pool, [] {});
+			pool.request_stop();
+			release = true;
+		}
+		catch (const std::future_error& error) {
+			broken = error.code() == std::future_errc::broken_promise;
+		}
+		DP_CHECK(broken);
+	}
+
+	//A stop on the parent token reaches the group's tasks
+	{
+		dp::stop_source parent{};
+		std::atomic<int> stopped{ 0 };
+		{
+			dp::task_group group{ parent.get_token() };
+			group.spawn([&] { stopped += dp::this_thread::sleep_for(dp::this_thread::get_stop_token(), 1h); });
+			std::this_thread::sleep_for(5ms);
+			parent.request_stop();
+			DP_CHECK(group.stop_requested());
+		}
+		DP_CHECK(stopped == 1);
+
+		//Or is already there if the parent was stopped before the group was made
+		dp::task_group late{ parent.get_token() };
+		DP_CHECK(late.stop_requested());
+	}
+
+	return dp::test::result();
+}
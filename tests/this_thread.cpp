@@ -0,0 +1,110 @@
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <thread>
+
+#include "check.h"
+#include "jthread.h"
+#include "stop_token.h"
+#include "this_thread.h"
+
+using namespace std::chrono_literals;
+
+namespace {
+	//Deep in a call stack, with no token passed down to it
+	void spin_until_stopped(std::atomic<int>& spins) {
+		while (!dp::this_thread::stop_requested()) {
+			++spins;
+			std::this_thread::sleep_for(1ms);
+		}
+	}
+}
+
+int main() {
+	//Threads not started by a jthread have no token, and are never asked to stop
+	{
+		DP_CHECK(!dp::this_thread::stop_possible());
+		DP_CHECK(!dp::this_thread::stop_requested());
+		DP_CHECK(!dp::this_thread::get_stop_token().stop_possible());
+		bool possible{ true };
+		std::thread{ [&] { possible = dp::this_thread::stop_possible(); } }.join();
+		DP_CHECK(!possible);
+	}
+
+	//A jthread's token is available to everything on its thread, whether or not its function takes the token itself
+	{
+		std::atomic<int> spins{ 0 };
+		std::atomic<bool> possible{ false };
+		{
+			dp::jthread worker{ [&] {
+				possible = dp::this_thread::stop_possible();
+				spin_until_stopped(spins);
+			} };
+			std::this_thread::sleep_for(10ms);
+		}
+		DP_CHECK(possible.load());
+		DP_CHECK(spins.load() > 0);
+
+		bool same_token{ false };
+		bool stopped{ false };
+		std::string received{};
+		{
+			dp::jthread worker{ [&](dp::stop_token token, std::string arg) {
+				same_token = (dp::this_thread::get_stop_token() == token);
+				received = arg;
+				dp::this_thread::sleep_for(dp::this_thread::get_stop_token(), 1h);
+				stopped = dp::this_thread::stop_requested();
+			}, std::string{ "argument" } };
+		}
+		DP_CHECK(same_token);
+		DP_CHECK(received == "argument");
+		DP_CHECK(stopped);
+	}
+
+	//A jthread sleeping in a loop on its token is stopped and joined promptly, however long it asked to sleep for
+	{
+		const auto start{ std::chrono::steady_clock::now() };
+		{
+			dp::jthread sleeper{ [](dp::stop_token token) {
+				while (!token.stop_requested()) {
+					dp::this_thread::sleep_for(token, 1h);
+				}
+			} };
+			std::this_thread::sleep_for(10ms);
+		}
+		DP_CHECK(std::chrono::steady_clock::now() - start < 1s);
+	}
+
+	//A sleep which runs its course reports that it wasn't interrupted, and lasts at least as long as asked
+	{
+		dp::stop_source source{};
+		const auto start{ std::chrono::steady_clock::now() };
+		DP_CHECK(!dp::this_thread::sleep_for(source.get_token(), 20ms));
+		DP_CHECK(std::chrono::steady_clock::now() - start >= 20ms);
+		DP_CHECK(!dp::this_thread::sleep_until(source.get_token(), std::chrono::steady_clock::now() - 1s));
+	}
+
+	//A stop requested before the sleep cuts it short straight away, as does one requested from another thread during it
+	{
+		dp::stop_source source{};
+		source.request_stop();
+		DP_CHECK(dp::this_thread::sleep_for(source.get_token(), 1h));
+
+		dp::stop_source later{};
+		dp::jthread stopper{ [&] {
+			std::this_thread::sleep_for(10ms);
+			later.request_stop();
+		} };
+		const auto start{ std::chrono::steady_clock::now() };
+		DP_CHECK(dp::this_thread::sleep_until(later.get_token(), std::chrono::system_clock::now() + 1h));
+		DP_CHECK(std::chrono::steady_clock::now() - start < 1s);
+	}
+
+	//A token which can never be stopped gives an ordinary sleep
+	{
+		const dp::stop_source source{ dp::nostopstate };
+		DP_CHECK(!dp::this_thread::sleep_for(source.get_token(), 1ms));
+	}
+
+	return dp::test::result();
+}
@@ -0,0 +1,98 @@
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+#include "check.h"
+#include "jthread.h"
+#include "this_thread.h"
+#include "thread_attributes.h"
+
+#if defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+using namespace std::chrono_literals;
+
+int main() {
+	//A thread with attributes runs its function with its arguments and token, and can be stopped, joined, detached and swapped as usual
+	{
+		int received{ 0 };
+		bool stopped{ false };
+		{
+			dp::jthread worker{ dp::thread_attributes{}.set_name("attributes"), [&](dp::stop_token token, int value) {
+				received = value;
+				dp::this_thread::sleep_for(token, 1h);
+				stopped = token.stop_requested();
+			}, 42 };
+			DP_CHECK(worker.joinable());
+			DP_CHECK(worker.get_id() != std::this_thread::get_id());
+			DP_CHECK(worker.get_id() != dp::jthread::id{});
+		}
+		DP_CHECK(received == 42);
+		DP_CHECK(stopped);
+
+		dp::jthread detached{ dp::thread_attributes{}, [] {} };
+		detached.detach();
+		DP_CHECK(!detached.joinable());
+
+		dp::jthread first{ dp::thread_attributes{}, [] {} };
+		dp::jthread second{};
+		second.swap(first);
+		DP_CHECK(second.joinable() && !first.joinable());
+		second.join();
+		DP_CHECK(!second.joinable());
+	}
+
+	//A real-time policy either applies or, without permission, throws rather than starting a thread which silently lacks it
+	{
+		try {
+			dp::jthread worker{ dp::thread_attributes{}.set_scheduling(dp::scheduling_policy::fifo, 1), [] {} };
+		}
+		catch (const std::system_error&) {
+		}
+	}
+
+#if defined(__linux__)
+	//Every attribute is in place before the function runs
+	{
+		cpu_set_t allowed{};
+		DP_CHECK(sched_getaffinity(0, sizeof(allowed), &allowed) == 0);
+		unsigned int first_cpu{ 0 };
+		while (!CPU_ISSET(first_cpu, &allowed)) {
+			++first_cpu;
+		}
+
+		char name[32]{};
+		std::size_t stack_size{ 0 };
+		std::vector<unsigned int> cpus{};
+		constexpr std::size_t requested_stack{ 512 * 1024 };
+		{
+			dp::jthread worker{ dp::thread_attributes{}.set_name("a-rather-long-thread-name").set_stack_size(requested_stack).set_affinity({ first_cpu }), [&] {
+				pthread_getname_np(pthread_self(), name, sizeof(name));
+				pthread_attr_t attr{};
+				if (pthread_getattr_np(pthread_self(), &attr) == 0) {
+					pthread_attr_getstacksize(&attr, &stack_size);
+					pthread_attr_destroy(&attr);
+				}
+				cpu_set_t mine{};
+				sched_getaffinity(0, sizeof(mine), &mine);
+				for (unsigned int cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+					if (CPU_ISSET(cpu, &mine)) {
+						cpus.push_back(cpu);
+					}
+				}
+			} };
+		}
+		//Truncated to the 15 characters Linux allows
+		DP_CHECK(std::string{ name } == "a-rather-long-t");
+		DP_CHECK(stack_size >= requested_stack);
+		DP_CHECK(cpus == std::vector<unsigned int>({ first_cpu }));
+	}
+#endif
+
+	return dp::test::result();
+}
@@ -0,0 +1,108 @@
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+#include "check.h"
+#include "jthread.h"
+#include "this_thread.h"
+#include "thread_cache.h"
+
+using namespace std::chrono_literals;
+
+namespace {
+	template<typename Pred>
+	bool eventually(Pred pred) {
+		const auto deadline{ std::chrono::steady_clock::now() + 5s };
+		while (!pred()) {
+			if (std::chrono::steady_clock::now() > deadline) {
+				return false;
+			}
+			std::this_thread::sleep_for(1ms);
+		}
+		return true;
+	}
+}
+
+int main() {
+	dp::thread_cache::enable(4, 200ms);
+	DP_CHECK(dp::thread_cache::enabled());
+
+	//A finished jthread's thread parks, and the next jthread borrows it
+	{
+		std::thread::id first{};
+		{
+			dp::jthread worker{ [&] { first = std::this_thread::get_id(); } };
+		}
+		DP_CHECK(eventually([] { return dp::thread_cache::parked() >= 1; }));
+		std::thread::id second{};
+		{
+			dp::jthread worker{ [&] { second = std::this_thread::get_id(); } };
+		}
+		DP_CHECK(first == second);
+	}
+
+	//Each borrower sees its own stop token, both passed in and as the thread's current token
+	{
+		for (int i = 0; i < 3; ++i) {
+			bool same_token{ false };
+			bool stopped{ false };
+			{
+				dp::jthread worker{ [&](dp::stop_token token) {
+					same_token = (dp::this_thread::get_stop_token() == token);
+					dp::this_thread::sleep_for(token, 1h);
+					stopped = dp::this_thread::stop_requested();
+				} };
+			}
+			DP_CHECK(same_token);
+			DP_CHECK(stopped);
+		}
+	}
+
+	//Joining waits for the function rather than the thread, and detached functions still run to completion
+	{
+		std::atomic<int> finished{ 0 };
+		for (int i = 0; i < 20; ++i) {
+			dp::jthread worker{ [&] {
+				std::this_thread::sleep_for(1ms);
+				++finished;
+			} };
+			if (i % 2) {
+				worker.detach();
+				DP_CHECK(!worker.joinable());
+			}
+			else {
+				worker.join();
+			}
+		}
+		DP_CHECK(eventually([&] { return finished.load() == 20; }));
+	}
+
+	//More threads than may park at once: the extra ones exit, and the rest exit once idle for the timeout
+	{
+		{
+			std::atomic<bool> release{ false };
+			dp::jthread workers[8]{};
+			for (auto& worker : workers) {
+				worker = dp::jthread{ [&] {
+					while (!release.load()) {
+						std::this_thread::sleep_for(1ms);
+					}
+				} };
+			}
+			release = true;
+		}
+		DP_CHECK(eventually([] { return dp::thread_cache::parked() > 0; }));
+		DP_CHECK(dp::thread_cache::parked() <= 4);
+		DP_CHECK(eventually([] { return dp::thread_cache::parked() == 0; }));
+	}
+
+	dp::thread_cache::disable();
+	DP_CHECK(!dp::thread_cache::enabled());
+	{
+		dp::jthread worker{ [] {} };
+	}
+	std::this_thread::sleep_for(10ms);
+	DP_CHECK(dp::thread_cache::parked() == 0);
+
+	return dp::test::result();
+}
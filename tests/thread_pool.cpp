@@ -0,0 +1,206 @@
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <thread>
+#include <vector>
+
+#include "check.h"
+#include "this_thread.h"
+#include "thread_pool.h"
+
+using namespace std::chrono_literals;
+
+namespace {
+
+	struct numbered_task : dp::detail::pool_task {
+		void run(const dp::stop_token&) override {}
+	};
+
+	//The owner pushes and takes while thieves steal, past the initial capacity so that the ring grows underneath them.
+	//Every task must come out exactly once.
+	void check_deque_contention() {
+		constexpr std::size_t count{ 100000 };
+		constexpr int thieves{ 3 };
+		std::vector<numbered_task> tasks(count);
+		std::vector<std::atomic<int>> seen(count);
+		dp::detail::work_stealing_deque deque{ 16 };
+		std::atomic<bool> pushing{ true };
+		std::atomic<std::size_t> stolen{ 0 };
+
+		const auto record{ [&](dp::detail::pool_task* task) {
+			seen[static_cast<std::size_t>(static_cast<numbered_task*>(task) - tasks.data())].fetch_add(1, std::memory_order_relaxed);
+		} };
+
+		std::vector<std::thread> threads{};
+		for (int i = 0; i < thieves; ++i) {
+			threads.emplace_back([&] {
+				while (pushing.load() || !deque.empty()) {
+					if (dp::detail::pool_task* task{ deque.steal() }) {
+						record(task);
+						stolen.fetch_add(1, std::memory_order_relaxed);
+					}
+				}
+			});
+		}
+		for (std::size_t i = 0; i < count; ++i) {
+			deque.push(&tasks[i]);
+			if (i % 3 == 0) {
+				if (dp::detail::pool_task* task{ deque.take() }) {
+					record(task);
+				}
+			}
+		}
+		while (dp::detail::pool_task* task{ deque.take() }) {
+			record(task);
+		}
+		pushing = false;
+		for (auto& thread : threads) {
+			thread.join();
+		}
+
+		bool once{ true };
+		for (const auto& count_seen : seen) {
+			once = once && count_seen.load() == 1;
+		}
+		DP_CHECK(once);
+		DP_CHECK(deque.empty());
+	}
+
+	void check_deque_order() {
+		numbered_task tasks[3]{};
+		dp::detail::work_stealing_deque deque{};
+		for (auto& task : tasks) {
+			deque.push(&task);
+		}
+		//The owner works newest first, thieves oldest first
+		DP_CHECK(deque.take() == &tasks[2]);
+		DP_CHECK(deque.steal() == &tasks[0]);
+		DP_CHECK(deque.take() == &tasks[1]);
+		DP_CHECK(deque.take() == nullptr);
+		DP_CHECK(deque.steal() == nullptr);
+		DP_CHECK(deque.empty());
+	}
+
+	long fib(dp::thread_pool& pool, int n) {
+		if (n < 12) {
+			return n < 2 ? n : fib(pool, n - 1) + fib(pool, n - 2);
+		}
+		std::atomic<bool> done{ false };
+		long left{ 0 };
+		pool.submit([&] {
+			left = fib(pool, n - 1);
+			done.store(true, std::memory_order_release);
+		});
+		const long right{ fib(pool, n - 2) };
+		pool.help_until([&] { return done.load(std::memory_order_acquire); });
+		return left + right;
+	}
+
+}
+
+int main() {
+	check_deque_order();
+	check_deque_contention();
+
+	//Every task submitted from outside or inside the pool runs exactly once
+	{
+		dp::thread_pool pool{ 4 };
+		DP_CHECK(pool.size() == 4);
+		constexpr int count{ 10000 };
+		std::vector<std::atomic<int>> ran(count);
+		std::atomic<int> finished{ 0 };
+		for (int i = 0; i < count; i += 2) {
+			pool.submit([&, i] {
+				++ran[static_cast<std::size_t>(i)];
+				pool.submit([&, i] {
+					++ran[static_cast<std::size_t>(i + 1)];
+					++finished;
+				});
+				++finished;
+			});
+		}
+		DP_CHECK(pool.help_until([&] { return finished.load() == count; }));
+		bool once{ true };
+		for (const auto& count_ran : ran) {
+			once = once && count_ran.load() == 1;
+		}
+		DP_CHECK(once);
+	}
+
+	//Tasks which wait on their children help run them rather than deadlocking the pool, even with a single worker
+	{
+		dp::thread_pool pool{ 1 };
+		DP_CHECK(fib(pool, 24) == 46368);
+	}
+
+	//A task gets its own token if it was submitted with one, and the pool's otherwise, and is skipped if its token is stopped first
+	{
+		dp::thread_pool pool{ 2 };
+		dp::stop_source stopped{};
+		stopped.request_stop();
+		dp::stop_source live{};
+		std::atomic<int> skipped_ran{ 0 };
+		std::atomic<int> finished{ 0 };
+		bool own_token{ false };
+		bool pool_token{ false };
+
+		pool.submit(stopped.get_token(), [&] { ++skipped_ran; });
+		pool.submit(live.get_token(), [&](dp::stop_token token) {
+			own_token = (token == live.get_token());
+			++finished;
+		});
+		pool.submit([&](dp::stop_token token) {
+			pool_token = (token == pool.get_stop_token());
+			++finished;
+		});
+		DP_CHECK(pool.help_until([&] { return finished.load() == 2; }));
+		DP_CHECK(skipped_ran == 0);
+		DP_CHECK(own_token);
+		DP_CHECK(pool_token);
+	}
+
+	//Stopping lets running tasks finish and discards the rest
+	{
+		std::atomic<int> started{ 0 };
+		std::atomic<int> stopped{ 0 };
+		std::atomic<int> queued_ran{ 0 };
+		{
+			dp::thread_pool pool{ 2 };
+			for (int i = 0; i < 2; ++i) {
+				pool.submit([&](dp::stop_token token) {
+					++started;
+					dp::this_thread::sleep_for(token, 1h);
+					stopped += token.stop_requested();
+				});
+			}
+			while (started.load() != 2) {
+				std::this_thread::sleep_for(1ms);
+			}
+			for (int i = 0; i < 100; ++i) {
+				pool.submit([&] { ++queued_ran; });
+			}
+			DP_CHECK(pool.request_stop());
+			DP_CHECK(pool.get_stop_token().stop_requested());
+			DP_CHECK(!pool.help_until([] { return false; }));
+		}
+		DP_CHECK(stopped == 2);
+		DP_CHECK(queued_ran == 0);
+	}
+
+	//Destroying a busy pool doesn't wait for its queue to drain, and doesn't leak it
+	{
+		std::atomic<int> ran{ 0 };
+		{
+			dp::thread_pool pool{ 2 };
+			for (int i = 0; i < 1000; ++i) {
+				pool.submit([&] {
+					std::this_thread::sleep_for(1ms);
+					++ran;
+				});
+			}
+		}
+		DP_CHECK(ran < 1000);
+	}
+
+	return dp::test::result();
+}
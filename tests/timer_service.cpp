@@ -0,0 +1,111 @@
+#include <atomic>
+#include <chrono>
+#include <system_error>
+#include <thread>
+
+#include "check.h"
+#include "stop_token.h"
+#include "timer_service.h"
+
+using namespace std::chrono_literals;
+
+namespace {
+	template<typename Pred>
+	bool wait_for_true(Pred pred, std::chrono::milliseconds timeout = 5000ms) {
+		const auto deadline{ std::chrono::steady_clock::now() + timeout };
+		while (!pred()) {
+			if (std::chrono::steady_clock::now() > deadline) {
+				return false;
+			}
+			std::this_thread::sleep_for(1ms);
+		}
+		return true;
+	}
+
+	bool rejects_period(dp::timer_service& timers, dp::timer_service::clock::duration period) {
+		try {
+			timers.schedule_every(period, [] {});
+		}
+		catch (const std::system_error& err) {
+			return err.code() == std::errc::invalid_argument;
+		}
+		return false;
+	}
+}
+
+int main() {
+	dp::timer_service timers{};
+
+	//A one-shot timer runs once, and not before its deadline
+	{
+		std::atomic<int> count{ 0 };
+		const auto start{ std::chrono::steady_clock::now() };
+		std::atomic<dp::timer_service::clock::time_point> ran_at{};
+		timers.schedule_after(20ms, [&] { ran_at = std::chrono::steady_clock::now(); ++count; });
+		DP_CHECK(wait_for_true([&] { return count.load() == 1; }));
+		DP_CHECK(ran_at.load() - start >= 20ms);
+		std::this_thread::sleep_for(30ms);
+		DP_CHECK(count.load() == 1);
+	}
+
+	//A periodic timer keeps firing until it is cancelled, and then stops
+	{
+		std::atomic<int> count{ 0 };
+		const auto id{ timers.schedule_every(2ms, [&] { ++count; }) };
+		DP_CHECK(wait_for_true([&] { return count.load() >= 5; }));
+		DP_CHECK(timers.cancel(id));
+		DP_CHECK(!timers.cancel(id));
+		//Allow for a run which was already under way when it was cancelled
+		std::this_thread::sleep_for(5ms);
+		const int after_cancel{ count.load() };
+		std::this_thread::sleep_for(20ms);
+		DP_CHECK(count.load() == after_cancel);
+	}
+
+	//A timer cancelled before its deadline never runs
+	{
+		std::atomic<bool> ran{ false };
+		const auto id{ timers.schedule_after(20ms, [&] { ran = true; }) };
+		DP_CHECK(timers.cancel(id));
+		std::this_thread::sleep_for(40ms);
+		DP_CHECK(!ran.load());
+	}
+
+	//A timer whose token is stopped is dropped without running
+	{
+		dp::stop_source source{};
+		std::atomic<bool> ran{ false };
+		timers.schedule_after(20ms, [&] { ran = true; }, source.get_token());
+		source.request_stop();
+		std::this_thread::sleep_for(40ms);
+		DP_CHECK(!ran.load());
+	}
+
+	//Non-positive periods are rejected
+	{
+		DP_CHECK(rejects_period(timers, 0ns));
+		DP_CHECK(rejects_period(timers, -1ms));
+	}
+
+	//A period shorter than the resolution is rounded up to it rather than firing back to back
+	{
+		std::atomic<int> count{ 0 };
+		const auto id{ timers.schedule_every(1ns, [&] { ++count; }) };
+		std::this_thread::sleep_for(50ms);
+		timers.cancel(id);
+		//At a 1ms resolution this can fire at most about 50 times, where a 1ns period would have fired millions of times
+		DP_CHECK(count.load() > 0 && count.load() < 500);
+	}
+
+	//Stopping the service discards pending timers
+	{
+		dp::timer_service local{};
+		std::atomic<bool> ran{ false };
+		local.schedule_after(20ms, [&] { ran = true; });
+		local.request_stop();
+		std::this_thread::sleep_for(40ms);
+		DP_CHECK(!ran.load());
+	}
+
+	return dp::test::result();
+}
@@ -0,0 +1,83 @@
+#include <algorithm>
+#include <set>
+#include <vector>
+
+#include "check.h"
+#include "topology.h"
+
+namespace {
+	using cpu = dp::topology::cpu;
+
+	//Two hardware threads per core, with CPU ids numbered core by core
+	std::vector<cpu> smt_pairs(const std::vector<unsigned int>& llc_of_core, const std::vector<unsigned int>& node_of_core) {
+		std::vector<cpu> cpus{};
+		for (unsigned int core = 0; core < llc_of_core.size(); ++core) {
+			for (unsigned int thread = 0; thread < 2; ++thread) {
+				cpus.push_back(cpu{ core * 2 + thread, core, 0, node_of_core[core], core, llc_of_core[core], 0, true });
+			}
+		}
+		return cpus;
+	}
+
+	bool is_first_thread(unsigned int id) {
+		return id % 2 == 0;
+	}
+}
+
+int main() {
+	//The machine we are running on: every placement is made up of CPUs we may use
+	{
+		const dp::topology& topo{ dp::topology::system() };
+		DP_CHECK(!topo.cpus().empty());
+		DP_CHECK(topo.core_count() >= 1);
+		for (unsigned int id : topo.spread(topo.cpus().size() * 2)) {
+			const cpu* entry{ topo.find(id) };
+			DP_CHECK(entry && entry->allowed);
+		}
+		DP_CHECK(topo.one_per_core().size() <= topo.core_count());
+	}
+
+	//One cache with a single core, and another with three. Every core's first thread comes before any sibling.
+	{
+		const dp::topology topo{ dp::topology::from_cpus(smt_pairs({ 0, 1, 1, 1 }, { 0, 0, 0, 0 })) };
+		DP_CHECK(topo.core_count() == 4);
+		DP_CHECK(topo.llc_count() == 2);
+		const std::vector<unsigned int> order{ topo.spread(8) };
+		DP_CHECK(std::all_of(order.begin(), order.begin() + 4, is_first_thread));
+		DP_CHECK(std::none_of(order.begin() + 4, order.end(), is_first_thread));
+		DP_CHECK(std::set<unsigned int>(order.begin(), order.end()).size() == 8);
+		//And the caches alternate
+		DP_CHECK(topo.find(order[0])->llc != topo.find(order[1])->llc);
+	}
+
+	//Two nodes: the first two threads go to different nodes
+	{
+		const dp::topology topo{ dp::topology::from_cpus(smt_pairs({ 0, 0, 1, 1 }, { 0, 0, 1, 1 })) };
+		const std::vector<unsigned int> order{ topo.spread(2) };
+		DP_CHECK(topo.find(order[0])->numa_node != topo.find(order[1])->numa_node);
+	}
+
+	//A core whose first hardware thread we may not use still gets a thread before anyone's sibling
+	{
+		std::vector<cpu> cpus{ smt_pairs({ 0, 0, 0 }, { 0, 0, 0 }) };
+		cpus[0].allowed = false;
+		const dp::topology topo{ dp::topology::from_cpus(cpus) };
+		const std::vector<unsigned int> order{ topo.spread(5) };
+		const std::set<unsigned int> first_three(order.begin(), order.begin() + 3);
+		DP_CHECK(first_three == std::set<unsigned int>({ 1, 2, 4 }));
+		DP_CHECK(std::find(order.begin(), order.end(), 0u) == order.end());
+	}
+
+	//compact fills each core before moving on, and the sibling queries agree with it
+	{
+		const dp::topology topo{ dp::topology::from_cpus(smt_pairs({ 0, 0, 1 }, { 0, 0, 0 })) };
+		DP_CHECK(topo.compact(3) == std::vector<unsigned int>({ 0, 1, 2 }));
+		DP_CHECK(topo.smt_siblings(3) == std::vector<unsigned int>({ 2, 3 }));
+		DP_CHECK(topo.llc_siblings(4) == std::vector<unsigned int>({ 4, 5 }));
+		DP_CHECK(topo.one_per_core() == std::vector<unsigned int>({ 0, 2, 4 }));
+		DP_CHECK(topo.one_per_llc() == std::vector<unsigned int>({ 0, 4 }));
+		DP_CHECK(topo.find(5)->smt_index == 1);
+	}
+
+	return dp::test::result();
+}
@@ -0,0 +1,105 @@
+#include <atomic>
+#include <chrono>
+#include <stdexcept>
+#include <type_traits>
+
+#include "check.h"
+#include "thread_pool.h"
+#include "when_any.h"
+
+using namespace std::chrono_literals;
+
+int main() {
+	//Tasks with different result types race for their common type
+	{
+		auto first{ dp::when_any([] { return 1.5; }, [](dp::stop_token token) { dp::this_thread::sleep_for(token, 5s); return 2; }) };
+		static_assert(std::is_same_v<decltype(first.get().value), double>);
+		const auto result{ first.get() };
+		DP_CHECK(result.index == 0);
+		DP_CHECK(result.value == 1.5);
+	}
+	{
+		dp::thread_pool pool{ 2 };
+		auto first{ dp::when_any(pool, [](dp::stop_token token) { dp::this_thread::sleep_for(token, 5s); return 1.5; }, [] { return 2; }) };
+		const auto result{ first.get() };
+		DP_CHECK(result.index == 1);
+		DP_CHECK(result.value == 2.0);
+	}
+
+	//The losers are asked to stop as soon as there is a winner
+	{
+		std::atomic<int> started{ 0 };
+		std::atomic<int> stopped{ 0 };
+		auto loser{ [&started, &stopped](dp::stop_token token) {
+			++started;
+			while (!token.stop_requested()) {
+				std::this_thread::sleep_for(1ms);
+			}
+			++stopped;
+			return 0;
+		} };
+		const auto start{ std::chrono::steady_clock::now() };
+		//A task which has not started by the time there is a winner never runs, so hold the winner back until both losers are running
+		auto first{ dp::when_any(loser, [&started] { while (started.load() != 2) { std::this_thread::yield(); } return 7; }, loser) };
+		DP_CHECK(first.get().value == 7);
+		while (stopped.load() != 2 && std::chrono::steady_clock::now() - start < 5s) {
+			std::this_thread::sleep_for(1ms);
+		}
+		DP_CHECK(stopped.load() == 2);
+	}
+
+	//A task which throws does not win, and if every task throws the first exception is kept
+	{
+		auto first{ dp::when_any([]() -> int { throw std::runtime_error{ "fails" }; }, [] { std::this_thread::sleep_for(5ms); return 3; }) };
+		DP_CHECK(first.get().value == 3);
+	}
+	{
+		auto first{ dp::when_any([]() -> int { throw std::runtime_error{ "first" }; }, []() -> int { std::this_thread::sleep_for(5ms); throw std::logic_error{ "second" }; }) };
+		bool threw_first{ false };
+		try {
+			first.get();
+		}
+		catch (const std::runtime_error&) {
+			threw_first = true;
+		}
+		DP_CHECK(threw_first);
+	}
+
+	//A primary which answers quickly means the backup is never started, even once the delay has passed
+	{
+		std::atomic<int> calls{ 0 };
+		DP_CHECK(dp::hedge([&calls] { ++calls; return 5; }, 20ms).get() == 5);
+		std::this_thread::sleep_for(50ms);
+		DP_CHECK(calls.load() == 1);
+	}
+
+	//A slow primary is overtaken by the backup, and then asked to stop
+	{
+		std::atomic<int> calls{ 0 };
+		std::atomic<bool> primary_stopped{ false };
+		const auto start{ std::chrono::steady_clock::now() };
+		auto hedged{ dp::hedge([&](dp::stop_token token) {
+			if (calls++ == 0) {
+				primary_stopped = dp::this_thread::sleep_for(token, 5s);
+				return -1;
+			}
+			return 7;
+		}, 10ms) };
+		DP_CHECK(hedged.get() == 7);
+		const auto elapsed{ std::chrono::steady_clock::now() - start };
+		DP_CHECK(elapsed >= 10ms);
+		DP_CHECK(elapsed < 1s);
+		while (!primary_stopped.load() && std::chrono::steady_clock::now() - start < 5s) {
+			std::this_thread::sleep_for(1ms);
+		}
+		DP_CHECK(primary_stopped.load());
+	}
+
+	{
+		std::atomic<int> calls{ 0 };
+		dp::hedge([&calls] { ++calls; }, 0ms).get();
+		DP_CHECK(calls.load() >= 1);
+	}
+
+	return dp::test::result();
+}